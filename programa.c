@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -8,14 +9,171 @@
 #include <ctype.h>
 #include <ncurses.h>
 #include <pthread.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
+#include <linux/futex.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
 #define FILE_PATH "registers.bin"
 #define FILE_SIZE 1024  // Tamanho do arquivo de registros
-#define LED_DISPLAY_REGISTERS 8
+// Layout do arquivo de registros:
+//   0x000-0x01F  R0 a R15
+//   0x020-0x023  contador de sequência (seqlock) dos registradores
+//   0x024-0x027  geração de alterações (palavra de futex para notificação)
+//   0x028-0x02B  indicador de assinantes esperando por alterações
+//   0x030-0x037  dono da seção de escrita (tid e início da thread), 0 se livre
+//   0x040-0x043  quadro atual do texto em rolagem (página visível = quadro & 1)
+//   0x048-0x05F  página 0 do texto em rolagem (12 registradores, como R4-R15)
+//   0x060-0x077  página 1 do texto em rolagem
+//   0x080-0x083  número de amostras de sensores já escritas
+//   0x084-0x087  contador de sequência (seqlock) dos agregados dos sensores
+//   0x088-0x0DB  agregados (mín., máx., média, percentis) por sensor e janela
+//   0x100-0x2FF  anel de amostras dos sensores (temperatura e carga da bateria)
+//   0x300-0x3FF  área livre
+// O bloco 0x000-0x03F (uma linha de cache) é o bloco de um dispositivo; no
+// banco de vários dispositivos (BANK_FILE_PATH) esses blocos ficam contíguos.
+#define SEQUENCE_OFFSET 0x20
+#define GENERATION_OFFSET 0x24
+#define WAITERS_OFFSET 0x28
+#define SEQ_OWNER_OFFSET 0x30 // Alinhado a 8 bytes (compare-and-swap de 64 bits)
+#define TEXT_REGISTERS 12   // Registradores de dados R4 a R15
+#define TEXT_FRAME_OFFSET 0x40
+#define TEXT_PAGE_OFFSET 0x48
+#define TEXT_PAGE_STRIDE 0x18
+#define SENSOR_HEAD_OFFSET 0x80
+#define SENSOR_AGGREGATE_SEQ_OFFSET 0x84
+#define SENSOR_AGGREGATE_OFFSET 0x88
+#define SENSOR_RING_OFFSET 0x100
+#define SENSOR_RING_SAMPLES 128
 #define OPERATION_LED_REGISTER 9
 #define RGB_LED_REGISTER 10
 #define TEMPERATURE_SENSOR_REGISTER 11
 #define BATTERY_REGISTER 12
-WINDOW *painel; // Painel global para uso na thread de animação
+#define REGISTER_COUNT 16   // Registradores R0 a R15
+#define CACHE_LINE_SIZE 64
+#define DEVICE_STRIDE 64     // Bytes por dispositivo: R0-R15 e palavras de controle
+#define BANK_FILE_PATH "registers_bank.bin"
+#define CHANGE_LOG_PATH "registers.log"  // Registro circular das escritas, ao lado de registers.bin
+#define CHANGE_LOG_CAPACITY 4096         // Registros no anel (potência de 2)
+#define REGISTER_SOCKET_PATH "registers.sock" // Socket do modo --daemon
+
+// Endereço do registrador Rn a partir do endereço base
+#define REG_PTR(base, n) ((unsigned short *)((base) + ((n) * sizeof(unsigned short))))
+#define SEQ_PTR(base) ((unsigned int *)((base) + SEQUENCE_OFFSET))
+#define GENERATION_PTR(base) ((unsigned int *)((base) + GENERATION_OFFSET))
+#define WAITERS_PTR(base) ((unsigned int *)((base) + WAITERS_OFFSET))
+#define SEQ_OWNER_PTR(base) ((unsigned long long *)((base) + SEQ_OWNER_OFFSET))
+#define TEXT_FRAME_PTR(base) ((unsigned int *)((base) + TEXT_FRAME_OFFSET))
+#define TEXT_PAGE_PTR(base, page) ((unsigned short *)((base) + TEXT_PAGE_OFFSET + (page) * TEXT_PAGE_STRIDE))
+
+// MAPA DE REGISTRADORES
+// Tabela única dos campos de R0-R15: X(arg, nome, registrador, bit inicial, largura).
+// A partir dela são gerados, em tempo de compilação, as constantes de cada
+// campo e acessores inline que fazem apenas máscara e deslocamento. As
+// verificações de largura e de sobreposição também são feitas em tempo de
+// compilação, por isso os acessores gerados não validam nada em tempo de
+// execução. A posição na tabela é o número do campo no protocolo do
+// servidor (--daemon): campos novos entram sempre no fim.
+#define REGISTER_FIELDS(X, arg) \
+    X(arg, red,           1, 11, 5)  /* Intensidade do vermelho (5 bits mais significativos) */ \
+    X(arg, green,         1,  5, 6)  /* Intensidade do verde (6 bits mais significativos) */ \
+    X(arg, blue,          2,  0, 8)  /* Intensidade do azul (8 bits) */ \
+    X(arg, led_status,    2,  9, 1)  /* LED ligado */ \
+    X(arg, red_on,        2, 10, 1)  /* Componente vermelho ligado */ \
+    X(arg, green_on,      2, 11, 1)  /* Componente verde ligado */ \
+    X(arg, blue_on,       2, 12, 1)  /* Componente azul ligado */ \
+    X(arg, battery_level, 3,  0, 2)  /* Nível de bateria (0-3) */ \
+    X(arg, temperature,   3,  6, 10) /* Temperatura do LED dividida por 10 */ \
+    X(arg, text_0,        4,  0, 16) /* Registradores de dados (texto conforme text_encoding) */ \
+    X(arg, text_1,        5,  0, 16) \
+    X(arg, text_2,        6,  0, 16) \
+    X(arg, text_3,        7,  0, 16) \
+    X(arg, text_4,        8,  0, 16) \
+    X(arg, text_5,        9,  0, 16) \
+    X(arg, text_6,       10,  0, 16) \
+    X(arg, text_7,       11,  0, 16) \
+    X(arg, text_8,       12,  0, 16) \
+    X(arg, text_9,       13,  0, 16) \
+    X(arg, text_10,      14,  0, 16) \
+    X(arg, text_11,      15,  0, 16) \
+    X(arg, text_encoding, 0,  0, 2)  /* Codificação do texto em R4-R15 (TEXT_ENCODING_*) */
+
+#define FIELD_BITS(offset, width) ((unsigned short)(((1u << (width)) - 1) << (offset)))
+
+// Constantes, verificações e acessores sobre uma cópia dos registradores
+#define DEFINE_FIELD_LAYOUT(arg, name, reg, offset, width) \
+    enum { \
+        FIELD_##name##_REG = (reg), \
+        FIELD_##name##_SHIFT = (offset), \
+        FIELD_##name##_WIDTH = (width), \
+        FIELD_##name##_MASK = FIELD_BITS(offset, width) \
+    }; \
+    _Static_assert((reg) >= 0 && (reg) < REGISTER_COUNT, "campo " #name ": registrador inexistente"); \
+    _Static_assert((width) > 0 && (offset) >= 0 && (offset) + (width) <= 16, "campo " #name " excede 16 bits"); \
+    static inline unsigned short field_get_##name(const unsigned short *regs) { \
+        return (regs[reg] & FIELD_BITS(offset, width)) >> (offset); \
+    } \
+    static inline void field_put_##name(unsigned short *regs, unsigned short value) { \
+        regs[reg] = (regs[reg] & ~FIELD_BITS(offset, width)) | ((value << (offset)) & FIELD_BITS(offset, width)); \
+    }
+REGISTER_FIELDS(DEFINE_FIELD_LAYOUT, 0)
+
+// Campos de um mesmo registrador não podem se sobrepor: a soma das máscaras
+// só é igual ao OU das máscaras quando nenhum bit se repete
+#define FIELD_MASK_SUM(r, name, reg, offset, width) + ((reg) == (r) ? (unsigned long)FIELD_BITS(offset, width) : 0)
+#define FIELD_MASK_OR(r, name, reg, offset, width) | ((reg) == (r) ? (unsigned long)FIELD_BITS(offset, width) : 0)
+#define CHECK_REGISTER_OVERLAP(r) \
+    _Static_assert((0 REGISTER_FIELDS(FIELD_MASK_SUM, r)) == (0 REGISTER_FIELDS(FIELD_MASK_OR, r)), \
+                   "campos sobrepostos no registrador R" #r);
+CHECK_REGISTER_OVERLAP(0)
+CHECK_REGISTER_OVERLAP(1)
+CHECK_REGISTER_OVERLAP(2)
+CHECK_REGISTER_OVERLAP(3)
+CHECK_REGISTER_OVERLAP(4)
+CHECK_REGISTER_OVERLAP(5)
+CHECK_REGISTER_OVERLAP(6)
+CHECK_REGISTER_OVERLAP(7)
+CHECK_REGISTER_OVERLAP(8)
+CHECK_REGISTER_OVERLAP(9)
+CHECK_REGISTER_OVERLAP(10)
+CHECK_REGISTER_OVERLAP(11)
+CHECK_REGISTER_OVERLAP(12)
+CHECK_REGISTER_OVERLAP(13)
+CHECK_REGISTER_OVERLAP(14)
+CHECK_REGISTER_OVERLAP(15)
+
+// Descrição dos campos em tempo de execução (diagnóstico e listagens)
+typedef struct {
+    const char *name;
+    int reg;
+    int offset;
+    int width;
+} RegisterField;
+
+#define DESCRIBE_FIELD(arg, name, reg, offset, width) {#name, reg, offset, width},
+const RegisterField register_fields[] = {
+    REGISTER_FIELDS(DESCRIBE_FIELD, 0)
+};
+#define REGISTER_FIELD_COUNT ((int)(sizeof(register_fields) / sizeof(register_fields[0])))
+
+// Posição de cada campo em register_fields: FIELD_<nome>_INDEX
+#define DEFINE_FIELD_INDEX(arg, name, reg, offset, width) FIELD_##name##_INDEX,
+enum { REGISTER_FIELDS(DEFINE_FIELD_INDEX, 0) };
+WINDOW *painel; // Painel global, usado apenas pela thread de renderização
 
 // Definindo enumeração para cores
 enum Colors {
@@ -24,11 +182,462 @@ enum Colors {
     BLUE
 };
 
-#define RED_MASK 0xF800
-#define GREEN_MASK 0x07E0
-#define BLUE_MASK   0xFF
+#define RED_MASK FIELD_red_MASK
+#define GREEN_MASK FIELD_green_MASK
+#define BLUE_MASK FIELD_blue_MASK
 
 int fd = -1; // Descritor de arquivo global
+int registers_verbose = 1; // Se 0, os setters não imprimem mensagens de depuração
+
+// Relógio monotônico em segundos e em nanossegundos
+double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// INSTRUMENTAÇÃO
+// Compilada apenas com -DREGISTER_STATS. Cada thread conta em um fragmento
+// próprio (sem atomics nem linhas de cache compartilhadas) as escritas por
+// registrador e por campo, os valores rejeitados pelas verificações de
+// intervalo dos setters e a latência de cada acessor em um histograma de
+// potências de 2. Os contadores são exatos; a latência é medida em uma a
+// cada STATS_SAMPLE_PERIOD chamadas, o que mantém o custo do relógio fora da
+// maioria das chamadas. registers_stats_dump soma os fragmentos de todas as
+// threads. Mesmo compilada, só conta com registers_stats_enabled ligado.
+#define REGISTER_ACCESSORS(X) \
+    X(set_valor_R) X(set_valor_G) X(set_valor_B) \
+    X(set_intensity_R) X(set_intensity_G) X(set_intensity_B) \
+    X(set_led_status) X(set_battery_level) X(set_led_temperature) \
+    X(write_message_registers) X(configure_text_display) X(set_text_encoding) \
+    X(tx_commit) X(registers_snapshot) X(reg_atomic_load) X(scene_apply)
+
+#define DEFINE_ACCESSOR_INDEX(name) ACCESSOR_##name,
+enum { REGISTER_ACCESSORS(DEFINE_ACCESSOR_INDEX) ACCESSOR_COUNT };
+
+int registers_stats_enabled = 0;
+
+#ifdef REGISTER_STATS
+#define STATS_BUCKETS 32
+#define STATS_SAMPLE_PERIOD 16 // Potência de 2
+
+#define DEFINE_ACCESSOR_NAME(name) #name,
+const char *accessor_names[ACCESSOR_COUNT] = {REGISTER_ACCESSORS(DEFINE_ACCESSOR_NAME)};
+
+typedef struct RegisterStatsShard {
+    struct RegisterStatsShard *next;
+    unsigned long register_writes[REGISTER_COUNT];
+    unsigned long field_writes[REGISTER_FIELD_COUNT];
+    unsigned long rejected[REGISTER_FIELD_COUNT];
+    unsigned long calls[ACCESSOR_COUNT];
+    unsigned long samples[ACCESSOR_COUNT];  // Chamadas com latência medida
+    unsigned long long ticks[ACCESSOR_COUNT];
+    unsigned long latency[ACCESSOR_COUNT][STATS_BUCKETS]; // Balde i: até 2^i ticks
+} RegisterStatsShard;
+
+RegisterStatsShard *stats_shards = NULL;   // Fragmentos de todas as threads
+static __thread RegisterStatsShard *stats_local = NULL;
+
+static RegisterStatsShard *stats_shard_create(void) {
+    RegisterStatsShard *shard = aligned_alloc(CACHE_LINE_SIZE, (sizeof(RegisterStatsShard) + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1));
+    memset(shard, 0, sizeof(*shard));
+    shard->next = __atomic_load_n(&stats_shards, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&stats_shards, &shard->next, shard, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    stats_local = shard;
+    return shard;
+}
+
+static inline RegisterStatsShard *stats_shard(void) {
+    return stats_local != NULL ? stats_local : stats_shard_create();
+}
+
+// Relógio barato para as latências: TSC em x86, nanossegundos nos demais
+static inline unsigned long long stats_clock(void) {
+#ifdef HAVE_X86_SIMD
+    return __rdtsc();
+#else
+    return (unsigned long long)monotonic_ns();
+#endif
+}
+
+// Conta a chamada e, se ela for amostrada, retorna o instante de início
+static inline unsigned long long stats_begin(int accessor) {
+    RegisterStatsShard *shard = stats_shard();
+    if ((++shard->calls[accessor] & (STATS_SAMPLE_PERIOD - 1)) != 0) {
+        return 0;
+    }
+    return stats_clock();
+}
+
+static inline void stats_record_latency(int accessor, unsigned long long ticks) {
+    RegisterStatsShard *shard = stats_shard();
+    int bucket = ticks ? 64 - __builtin_clzll(ticks) : 0;
+    shard->samples[accessor]++;
+    shard->ticks[accessor] += ticks;
+    shard->latency[accessor][bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1]++;
+}
+
+#define STATS_TIMER_START(timer, name) \
+    unsigned long long timer = registers_stats_enabled ? stats_begin(ACCESSOR_##name) : 0
+#define STATS_TIMER_STOP(timer, name) \
+    do { if (timer) stats_record_latency(ACCESSOR_##name, stats_clock() - (timer)); } while (0)
+#define STATS_COUNT_REGISTER(reg) \
+    do { if (registers_stats_enabled) stats_shard()->register_writes[reg]++; } while (0)
+#define STATS_COUNT_FIELD(index) \
+    do { if (registers_stats_enabled) stats_shard()->field_writes[index]++; } while (0)
+#define STATS_REJECT(name) \
+    do { if (registers_stats_enabled) stats_shard()->rejected[FIELD_##name##_INDEX]++; } while (0)
+
+// Ticks do relógio por nanossegundo, medidos uma vez
+double stats_ticks_per_ns(void) {
+#ifdef HAVE_X86_SIMD
+    static double ratio = 0;
+    if (ratio == 0) {
+        long started_ns = monotonic_ns();
+        unsigned long long started = __rdtsc();
+        usleep(20000);
+        ratio = (double)(__rdtsc() - started) / (monotonic_ns() - started_ns);
+    }
+    return ratio;
+#else
+    return 1.0;
+#endif
+}
+
+// Soma os fragmentos de todas as threads e imprime contadores e latências
+void registers_stats_dump(FILE *output) {
+    RegisterStatsShard total;
+    memset(&total, 0, sizeof(total));
+    int shards = 0;
+    for (RegisterStatsShard *shard = __atomic_load_n(&stats_shards, __ATOMIC_ACQUIRE); shard != NULL; shard = shard->next) {
+        for (int i = 0; i < REGISTER_COUNT; i++) {
+            total.register_writes[i] += shard->register_writes[i];
+        }
+        for (int i = 0; i < REGISTER_FIELD_COUNT; i++) {
+            total.field_writes[i] += shard->field_writes[i];
+            total.rejected[i] += shard->rejected[i];
+        }
+        for (int a = 0; a < ACCESSOR_COUNT; a++) {
+            total.calls[a] += shard->calls[a];
+            total.samples[a] += shard->samples[a];
+            total.ticks[a] += shard->ticks[a];
+            for (int b = 0; b < STATS_BUCKETS; b++) {
+                total.latency[a][b] += shard->latency[a][b];
+            }
+        }
+        shards++;
+    }
+
+    double ticks_per_ns = stats_ticks_per_ns();
+    fprintf(output, "estatísticas de %d thread(s)\n", shards);
+    fprintf(output, "registrador,escritas\n");
+    for (int i = 0; i < REGISTER_COUNT; i++) {
+        if (total.register_writes[i]) {
+            fprintf(output, "R%d,%lu\n", i, total.register_writes[i]);
+        }
+    }
+    fprintf(output, "campo,escritas,rejeitados\n");
+    for (int i = 0; i < REGISTER_FIELD_COUNT; i++) {
+        if (total.field_writes[i] || total.rejected[i]) {
+            fprintf(output, "%s,%lu,%lu\n", register_fields[i].name, total.field_writes[i], total.rejected[i]);
+        }
+    }
+    fprintf(output, "acessor,chamadas,media_ns,p50_ns,p99_ns,max_ns\n");
+    for (int a = 0; a < ACCESSOR_COUNT; a++) {
+        if (total.samples[a] == 0) {
+            if (total.calls[a]) {
+                fprintf(output, "%s,%lu,,,,\n", accessor_names[a], total.calls[a]);
+            }
+            continue;
+        }
+        long seen = 0;
+        int p50 = -1, p99 = -1, max = 0;
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            seen += total.latency[a][b];
+            if (p50 < 0 && seen * 2 >= (long)total.samples[a]) {
+                p50 = b;
+            }
+            if (p99 < 0 && seen * 100 >= (long)total.samples[a] * 99) {
+                p99 = b;
+            }
+            if (total.latency[a][b]) {
+                max = b;
+            }
+        }
+        fprintf(output, "%s,%lu,%.1f,%.0f,%.0f,%.0f\n", accessor_names[a], total.calls[a],
+                total.ticks[a] / ticks_per_ns / total.samples[a], (1ULL << p50) / ticks_per_ns,
+                (1ULL << p99) / ticks_per_ns, (1ULL << max) / ticks_per_ns);
+    }
+}
+#else
+#define STATS_TIMER_START(timer, name) do { } while (0)
+#define STATS_TIMER_STOP(timer, name) do { } while (0)
+#define STATS_COUNT_REGISTER(reg) do { } while (0)
+#define STATS_COUNT_FIELD(index) do { } while (0)
+#define STATS_REJECT(name) do { } while (0)
+
+void registers_stats_dump(FILE *output) {
+    fprintf(output, "Erro: instrumentação não compilada (use -DREGISTER_STATS)\n");
+}
+#endif
+
+void registers_stats_dump_stderr(void) {
+    registers_stats_dump(stderr);
+}
+
+// DURABILIDADE
+// Por padrão (none) quem decide quando as escritas chegam ao disco é o
+// writeback do kernel. Os outros modos chamam msync sobre o arquivo mapeado:
+//   periodic  uma thread grava a cada interval_ms, se houve escritas
+//   group     grava depois de group_writes commits ou group_ms desde o
+//             primeiro commit pendente, o que vier antes
+//   sync      cada commit (fim de seção de escrita) espera o seu msync
+// Os tempos de cada msync e o atraso entre um commit e a sua gravação vão
+// para histogramas em potências de 2 de microssegundos.
+
+#define DURABILITY_BUCKETS 24 // Até ~8 s
+
+enum DurabilityMode {
+    DURABILITY_NONE,
+    DURABILITY_PERIODIC,
+    DURABILITY_GROUP,
+    DURABILITY_SYNC
+};
+
+const char *durability_mode_names[] = {"none", "periodic", "group", "sync"};
+
+typedef struct {
+    int mode;
+    char *base_address;       // Mapeamento gravado (NULL se o modo for none)
+    size_t size;
+    int interval_ms;          // periodic
+    int group_writes;         // group
+    int group_ms;             // group
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    int running;
+    long pending;             // Commits ainda não gravados
+    long first_pending_ns;
+    long commits;
+    long flushes;
+    long flush_errors;
+    long flush_histogram[DURABILITY_BUCKETS]; // Duração de cada msync
+    long delay_histogram[DURABILITY_BUCKETS]; // Do commit pendente mais antigo até o fim do msync
+    long max_flush_ns;
+    long max_delay_ns;
+} Durability;
+
+Durability registers_durability = {
+    .mode = DURABILITY_NONE,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+static inline int durability_bucket(long ns) {
+    long us = ns / 1000;
+    int bucket = 0;
+    while (us > 0 && bucket < DURABILITY_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// Grava o mapeamento e contabiliza a duração; oldest_ns é o commit pendente mais antigo
+static void durability_flush(Durability *durability, long oldest_ns) {
+    long started = monotonic_ns();
+    int result = msync(durability->base_address, durability->size, MS_SYNC);
+    long finished = monotonic_ns();
+
+    pthread_mutex_lock(&durability->lock);
+    if (result == -1) {
+        durability->flush_errors++;
+    }
+    durability->flushes++;
+    durability->flush_histogram[durability_bucket(finished - started)]++;
+    durability->delay_histogram[durability_bucket(finished - oldest_ns)]++;
+    if (finished - started > durability->max_flush_ns) {
+        durability->max_flush_ns = finished - started;
+    }
+    if (finished - oldest_ns > durability->max_delay_ns) {
+        durability->max_delay_ns = finished - oldest_ns;
+    }
+    pthread_mutex_unlock(&durability->lock);
+}
+
+// Thread dos modos periodic e group
+void *durability_thread(void *arg) {
+    Durability *durability = (Durability *)arg;
+    long next_tick = monotonic_ns() + durability->interval_ms * 1000000L;
+
+    pthread_mutex_lock(&durability->lock);
+    while (durability->running) {
+        long deadline;
+        if (durability->mode == DURABILITY_PERIODIC) {
+            deadline = next_tick;
+        } else if (durability->pending > 0) {
+            deadline = durability->first_pending_ns + durability->group_ms * 1000000L;
+        } else {
+            deadline = monotonic_ns() + 1000000000L; // Nada pendente: só acorda por sinal
+        }
+
+        int due = monotonic_ns() >= deadline ||
+                  (durability->mode == DURABILITY_GROUP && durability->pending >= durability->group_writes);
+        if (!due) {
+            struct timespec wake = {deadline / 1000000000L, deadline % 1000000000L};
+            pthread_cond_timedwait(&durability->wake, &durability->lock, &wake);
+            continue;
+        }
+        if (durability->mode == DURABILITY_PERIODIC) {
+            next_tick += durability->interval_ms * 1000000L;
+            if (next_tick < monotonic_ns()) {
+                next_tick = monotonic_ns() + durability->interval_ms * 1000000L;
+            }
+        }
+        if (durability->pending == 0) {
+            continue;
+        }
+
+        long oldest = durability->first_pending_ns;
+        durability->pending = 0;
+        pthread_mutex_unlock(&durability->lock);
+        durability_flush(durability, oldest);
+        pthread_mutex_lock(&durability->lock);
+    }
+    pthread_mutex_unlock(&durability->lock);
+    return NULL;
+}
+
+// Chamada no fim de cada seção de escrita, fora do seqlock
+static inline void durability_after_commit(char *base_address) {
+    Durability *durability = &registers_durability;
+    if (durability->base_address != base_address) {
+        return;
+    }
+    if (durability->mode == DURABILITY_SYNC) {
+        long now = monotonic_ns();
+        __atomic_fetch_add(&durability->commits, 1, __ATOMIC_RELAXED);
+        durability_flush(durability, now);
+        return;
+    }
+
+    pthread_mutex_lock(&durability->lock);
+    durability->commits++;
+    if (durability->pending++ == 0) {
+        durability->first_pending_ns = monotonic_ns();
+    }
+    if (durability->mode == DURABILITY_GROUP && durability->pending == durability->group_writes) {
+        pthread_cond_signal(&durability->wake);
+    }
+    pthread_mutex_unlock(&durability->lock);
+}
+
+// Interpreta "none", "periodic[:ms]", "group[:escritas[:ms]]" ou "sync"
+int durability_parse(Durability *durability, const char *spec) {
+    durability->interval_ms = 100;
+    durability->group_writes = 64;
+    durability->group_ms = 10;
+    if (strcmp(spec, "none") == 0) {
+        durability->mode = DURABILITY_NONE;
+    } else if (strcmp(spec, "sync") == 0) {
+        durability->mode = DURABILITY_SYNC;
+    } else if (strncmp(spec, "periodic", 8) == 0 && (spec[8] == '\0' || sscanf(spec + 8, ":%d", &durability->interval_ms) == 1)) {
+        durability->mode = DURABILITY_PERIODIC;
+    } else if (strncmp(spec, "group", 5) == 0 &&
+               (spec[5] == '\0' || sscanf(spec + 5, ":%d:%d", &durability->group_writes, &durability->group_ms) >= 1)) {
+        durability->mode = DURABILITY_GROUP;
+    } else {
+        fprintf(stderr, "Erro: modo de durabilidade inválido: %s (none, periodic[:ms], group[:escritas[:ms]], sync)\n", spec);
+        return -1;
+    }
+    if (durability->interval_ms < 1 || durability->group_writes < 1 || durability->group_ms < 1) {
+        fprintf(stderr, "Erro: parâmetros de durabilidade devem ser positivos\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Liga o modo escolhido sobre o mapeamento (zera as estatísticas)
+int durability_start(Durability *durability, char *base_address, size_t size) {
+    durability->size = size;
+    durability->pending = durability->commits = durability->flushes = durability->flush_errors = 0;
+    durability->max_flush_ns = durability->max_delay_ns = 0;
+    memset(durability->flush_histogram, 0, sizeof(durability->flush_histogram));
+    memset(durability->delay_histogram, 0, sizeof(durability->delay_histogram));
+    if (durability->mode == DURABILITY_NONE) {
+        return 0;
+    }
+    if (durability->mode == DURABILITY_PERIODIC || durability->mode == DURABILITY_GROUP) {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&durability->wake, &attr);
+        pthread_condattr_destroy(&attr);
+        durability->running = 1;
+        if (pthread_create(&durability->thread, NULL, durability_thread, durability) != 0) {
+            perror("Erro ao criar a thread de durabilidade");
+            return -1;
+        }
+    }
+    __atomic_store_n(&durability->base_address, base_address, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Desliga o modo, gravando o que ainda estiver pendente
+void durability_stop(Durability *durability) {
+    if (durability->base_address == NULL) {
+        return;
+    }
+    if (durability->mode == DURABILITY_PERIODIC || durability->mode == DURABILITY_GROUP) {
+        pthread_mutex_lock(&durability->lock);
+        durability->running = 0;
+        pthread_cond_signal(&durability->wake);
+        pthread_mutex_unlock(&durability->lock);
+        pthread_join(durability->thread, NULL);
+        pthread_cond_destroy(&durability->wake);
+        if (durability->pending > 0) {
+            durability->pending = 0;
+            durability_flush(durability, durability->first_pending_ns);
+        }
+    }
+    __atomic_store_n(&durability->base_address, NULL, __ATOMIC_RELEASE);
+}
+
+// Valor (em us) do percentil p a partir do histograma: limite superior do balde
+static long durability_percentile_us(const long *histogram, double p) {
+    long total = 0, seen = 0;
+    for (int i = 0; i < DURABILITY_BUCKETS; i++) {
+        total += histogram[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    for (int i = 0; i < DURABILITY_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen * 100.0 >= p * total) {
+            return 1L << i;
+        }
+    }
+    return 1L << (DURABILITY_BUCKETS - 1);
+}
+
+void durability_print_histogram(FILE *output, const char *label, const long *histogram) {
+    fprintf(output, "%s:", label);
+    for (int i = 0; i < DURABILITY_BUCKETS; i++) {
+        if (histogram[i] != 0) {
+            fprintf(output, " <%ldus=%ld", 1L << i, histogram[i]);
+        }
+    }
+    fprintf(output, "\n");
+}
 
 // Função para abrir ou criar o arquivo e mapeá-lo na memória
 char* registers_map(const char* file_path, int file_size) {
@@ -57,7 +666,7 @@ char* registers_map(const char* file_path, int file_size) {
 }
 
 // Função para liberar a memória mapeada e fechar o descritor de arquivo
-int registers_release(void* map, int file_size) {
+int registers_unmap(void* map, int file_size) {
     if (munmap(map, file_size) == -1) {
         perror("Erro ao desmapear o arquivo");
         close(fd);
@@ -72,613 +681,8037 @@ int registers_release(void* map, int file_size) {
     return 0;
 }
 
-// Função para definir o valor do componente vermelho (R)
-void set_valor_R(char* base_address, int red_value) {
-    unsigned short control_register_value = *((unsigned short *)(base_address + (2 * sizeof(unsigned short))));
+// ARMAZENAMENTO DOS REGISTRADORES
+// Os setters operam sobre uma imagem em memória (base_address); o backend
+// decide de onde ela vem e como as escritas chegam ao armazenamento:
+//   mmap      arquivo mapeado com MAP_SHARED (padrão, compartilhado entre processos)
+//   memfd     memória anônima (memfd_create), sem arquivo em disco
+//   shm       memória compartilhada POSIX (/dev/shm/<nome do arquivo>), visível a outros processos
+//   pwrite[:N] cópia privada lida com pread; as alterações são gravadas com um
+//             único pwrite dos blocos alterados a cada N commits e no fechamento
+//   buffer    memória do processo, sem armazenamento (testes)
+// Só mmap e pwrite gravam registers.bin; os demais começam zerados.
+#define BACKEND_BLOCK 64 // Granularidade da comparação do backend pwrite
 
-    // Se red_value for 1, liga o bit 10 do registrador de controle, caso contrário, desliga
-    if (red_value == 1) {
-        control_register_value |= (1 << 10); // Bit 10: Controla o componente vermelho (R)
-    } else {
-        control_register_value &= ~(1 << 10);
+typedef struct RegisterBackend RegisterBackend;
+
+typedef struct {
+    const char *name;
+    int shared;  // A imagem é um mapeamento MAP_SHARED (msync e futex entre processos)
+    int on_disk; // Grava o arquivo indicado
+    int (*open)(RegisterBackend *backend, const char *path);
+    void (*commit)(RegisterBackend *backend); // Chamado ao fim de cada escrita (pode ser NULL)
+    int (*flush)(RegisterBackend *backend);   // Leva as escritas ao armazenamento
+    int (*close)(RegisterBackend *backend);
+} RegisterBackendOps;
+
+struct RegisterBackend {
+    const RegisterBackendOps *ops;
+    char *base_address; // Imagem usada pelos setters
+    int size;
+    int fd;
+    char *written;      // pwrite: conteúdo já gravado no arquivo
+    int batch_commits;  // pwrite: commits acumulados antes de gravar
+    int pending;
+    pthread_mutex_t flush_lock; // pwrite: serializa commits e gravações de várias threads
+    long flushes;       // Chamadas de sistema de gravação
+    long bytes_written;
+};
+
+RegisterBackend registers_backend = {NULL};
+
+// Mapeia um descritor já com o tamanho certo
+static int backend_map_fd(RegisterBackend *backend) {
+    if (ftruncate(backend->fd, backend->size) == -1) {
+        perror("Erro ao definir o tamanho do armazenamento");
+        close(backend->fd);
+        return -1;
+    }
+    backend->base_address = mmap(0, backend->size, PROT_READ | PROT_WRITE, MAP_SHARED, backend->fd, 0);
+    if (backend->base_address == MAP_FAILED) {
+        perror("Erro ao mapear o armazenamento");
+        backend->base_address = NULL;
+        close(backend->fd);
+        return -1;
+    }
+    return 0;
+}
+
+static int backend_unmap(RegisterBackend *backend) {
+    int result = munmap(backend->base_address, backend->size);
+    if (result == -1) {
+        perror("Erro ao desmapear o armazenamento");
     }
+    close(backend->fd);
+    return result;
+}
 
-    *((unsigned short *)(base_address + (2 * sizeof(unsigned short)))) = control_register_value;
+static int backend_no_flush(RegisterBackend *backend) {
+    (void)backend;
+    return 0;
 }
 
-// Função para definir o valor do componente verde (G)
-void set_valor_G(char* base_address, int green_value) {
-    unsigned short control_register_value = *((unsigned short *)(base_address + (2 * sizeof(unsigned short))));
+static int backend_mmap_open(RegisterBackend *backend, const char *path) {
+    backend->base_address = registers_map(path, backend->size);
+    backend->fd = fd;
+    return backend->base_address == NULL ? -1 : 0;
+}
 
-    // Se green_value for 1, liga o bit 11 do registrador de controle, caso contrário, desliga
-    if (green_value == 1) {
-        control_register_value |= (1 << 11); // Bit 11: Controla o componente verde (G)
-    } else {
-        control_register_value &= ~(1 << 11);
+static int backend_mmap_close(RegisterBackend *backend) {
+    return registers_unmap(backend->base_address, backend->size);
+}
+
+static int backend_memfd_open(RegisterBackend *backend, const char *path) {
+    (void)path;
+    backend->fd = memfd_create("registers", MFD_CLOEXEC);
+    if (backend->fd == -1) {
+        perror("Erro ao criar o memfd");
+        return -1;
     }
+    return backend_map_fd(backend);
+}
 
-    *((unsigned short *)(base_address + (2 * sizeof(unsigned short)))) = control_register_value;
+// Nome do objeto de memória compartilhada: "/" seguido do nome do arquivo
+static void backend_shm_name(const char *path, char *name, size_t size) {
+    const char *slash = strrchr(path, '/');
+    snprintf(name, size, "/%s", slash ? slash + 1 : path);
 }
 
-// Função para definir o valor do componente azul (B)
-void set_valor_B(char* base_address, int blue_value) {
-    unsigned short control_register_value = *((unsigned short *)(base_address + (2 * sizeof(unsigned short))));
+static int backend_shm_open(RegisterBackend *backend, const char *path) {
+    char name[256];
+    backend_shm_name(path, name, sizeof(name));
+    backend->fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (backend->fd == -1) {
+        perror("Erro ao abrir a memória compartilhada");
+        return -1;
+    }
+    return backend_map_fd(backend);
+}
 
-    // Se blue_value for 1, liga o bit 12 do registrador de controle, caso contrário, desliga
-    if (blue_value == 1) {
-        control_register_value |= (1 << 12); // Bit 12: Controla o componente azul (B)
-    } else {
-        control_register_value &= ~(1 << 12);
+static int backend_pwrite_open(RegisterBackend *backend, const char *path) {
+    backend->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (backend->fd == -1) {
+        perror("Erro ao abrir ou criar o arquivo");
+        return -1;
+    }
+    backend->base_address = aligned_alloc(CACHE_LINE_SIZE, backend->size);
+    backend->written = malloc(backend->size);
+    if (backend->base_address == NULL || backend->written == NULL) {
+        perror("Erro ao alocar a imagem dos registradores");
+        close(backend->fd);
+        free(backend->written);
+        free(backend->base_address);
+        backend->base_address = NULL;
+        return -1;
+    }
+    pthread_mutex_init(&backend->flush_lock, NULL);
+    memset(backend->base_address, 0, backend->size);
+    ssize_t loaded = pread(backend->fd, backend->base_address, backend->size, 0);
+    if (loaded == -1) {
+        perror("Erro ao ler o arquivo de registros");
+        close(backend->fd);
+        free(backend->written);
+        free(backend->base_address);
+        backend->base_address = NULL;
+        return -1;
+    }
+    // Um arquivo menor é completado com zeros na primeira gravação
+    memcpy(backend->written, backend->base_address, backend->size);
+    if (loaded < backend->size) {
+        memset(backend->written + loaded, 0xFF, backend->size - loaded);
+    }
+    return 0;
+}
+
+// Grava com um único pwrite o trecho entre o primeiro e o último bloco que
+// diferem do conteúdo do arquivo (os blocos iguais no meio são regravados
+// com o mesmo valor, o que custa menos que uma chamada por trecho).
+// Chamada com flush_lock.
+static int backend_pwrite_flush_locked(RegisterBackend *backend) {
+    int first = -1, end = 0;
+
+    backend->pending = 0;
+    for (int offset = 0; offset < backend->size; offset += BACKEND_BLOCK) {
+        int length = backend->size - offset < BACKEND_BLOCK ? backend->size - offset : BACKEND_BLOCK;
+        if (memcmp(backend->base_address + offset, backend->written + offset, length) != 0) {
+            if (first == -1) {
+                first = offset;
+            }
+            end = offset + length;
+        }
+    }
+    if (first == -1) {
+        return 0;
+    }
+
+    // Copia o trecho para written e grava a cópia. Uma escrita que outra
+    // thread faça na imagem durante a cópia deixa o bloco diferente de
+    // written, e ele é regravado na próxima gravação (no máximo no fechamento)
+    memcpy(backend->written + first, backend->base_address + first, end - first);
+    if (pwrite(backend->fd, backend->written + first, end - first, first) != end - first) {
+        perror("Erro ao gravar os registradores");
+        return -1;
     }
+    backend->flushes++;
+    backend->bytes_written += end - first;
+    return 0;
+}
 
-    *((unsigned short *)(base_address + (2 * sizeof(unsigned short)))) = control_register_value;
+static int backend_pwrite_flush(RegisterBackend *backend) {
+    pthread_mutex_lock(&backend->flush_lock);
+    int result = backend_pwrite_flush_locked(backend);
+    pthread_mutex_unlock(&backend->flush_lock);
+    return result;
 }
 
-void set_intensity_R(char* base_address, int intensity) {
-    // Garante que a intensidade esteja dentro do intervalo válido (0-255)
-    if (intensity < 0 || intensity > 255) {
-        fprintf(stderr, "Erro: Intensidade do componente R fora do intervalo válido (0-255)\n");
-        return;
+static void backend_pwrite_commit(RegisterBackend *backend) {
+    pthread_mutex_lock(&backend->flush_lock);
+    if (++backend->pending >= backend->batch_commits) {
+        backend_pwrite_flush_locked(backend);
     }
+    pthread_mutex_unlock(&backend->flush_lock);
+}
 
-    // Lê o valor atual do registrador R1
-    unsigned short value = *((unsigned short *)(base_address + (1 * sizeof(unsigned short))));
+static int backend_pwrite_close(RegisterBackend *backend) {
+    int result = backend_pwrite_flush(backend);
+    if (close(backend->fd) == -1) {
+        perror("Erro ao fechar o arquivo");
+        result = -1;
+    }
+    pthread_mutex_destroy(&backend->flush_lock);
+    free(backend->written);
+    free(backend->base_address);
+    return result;
+}
 
-    // Limpa os bits correspondentes ao componente vermelho
-    value &= ~RED_MASK;
+static int backend_buffer_open(RegisterBackend *backend, const char *path) {
+    (void)path;
+    backend->fd = -1;
+    backend->base_address = aligned_alloc(CACHE_LINE_SIZE, backend->size);
+    if (backend->base_address == NULL) {
+        perror("Erro ao alocar a imagem dos registradores");
+        return -1;
+    }
+    memset(backend->base_address, 0, backend->size);
+    return 0;
+}
 
-    // Define a intensidade do componente vermelho
-    value |= ((intensity << 8) & RED_MASK);
+static int backend_buffer_close(RegisterBackend *backend) {
+    free(backend->base_address);
+    return 0;
+}
 
-    // Escreve o novo valor no registrador R1
-    *((unsigned short *)(base_address + (1 * sizeof(unsigned short)))) = value;
+const RegisterBackendOps register_backends[] = {
+    {"mmap", 1, 1, backend_mmap_open, NULL, backend_no_flush, backend_mmap_close},
+    {"memfd", 1, 0, backend_memfd_open, NULL, backend_no_flush, backend_unmap},
+    {"shm", 1, 0, backend_shm_open, NULL, backend_no_flush, backend_unmap},
+    {"pwrite", 0, 1, backend_pwrite_open, backend_pwrite_commit, backend_pwrite_flush, backend_pwrite_close},
+    {"buffer", 0, 0, backend_buffer_open, NULL, backend_no_flush, backend_buffer_close},
+};
+#define REGISTER_BACKEND_COUNT ((int)(sizeof(register_backends) / sizeof(register_backends[0])))
 
-    printf("Valor do registrador R1 após definir a intensidade do componente vermelho: %hu\n", *((unsigned short *)(base_address + (1 * sizeof(unsigned short)))));
+// Interpreta "nome" ou "pwrite:N"; retorna -1 se o backend não existir
+int register_backend_parse(RegisterBackend *backend, const char *spec) {
+    size_t name_length = strcspn(spec, ":");
+    for (int i = 0; i < REGISTER_BACKEND_COUNT; i++) {
+        if (strlen(register_backends[i].name) == name_length && strncmp(spec, register_backends[i].name, name_length) == 0) {
+            backend->ops = &register_backends[i];
+            backend->batch_commits = spec[name_length] == ':' ? atoi(spec + name_length + 1) : 64;
+            if (backend->batch_commits < 1) {
+                fprintf(stderr, "Erro: o lote do backend deve ser positivo\n");
+                return -1;
+            }
+            return 0;
+        }
+    }
+    fprintf(stderr, "Erro: backend desconhecido '%s' (use mmap, memfd, shm, pwrite[:commits] ou buffer)\n", spec);
+    return -1;
 }
 
-void set_intensity_G(char* base_address, int intensity) {
-    // Garante que a intensidade esteja dentro do intervalo válido (0-255)
-    if (intensity < 0 || intensity > 255) {
-        fprintf(stderr, "Erro: Intensidade do componente G fora do intervalo válido (0-255)\n");
-        return;
+void seq_repair(char* base_address); // Definida com o seqlock
+
+// Abre o backend escolhido (mmap se nenhum foi escolhido) e retorna a imagem
+char *register_backend_open(RegisterBackend *backend, const char *path, int size) {
+    if (backend->ops == NULL) {
+        register_backend_parse(backend, "mmap");
     }
-    
-    // Lê o valor atual do registrador R1
-    unsigned short value = *((unsigned short *)(base_address + (1 * sizeof(unsigned short))));
+    backend->size = size;
+    backend->pending = 0;
+    backend->flushes = backend->bytes_written = 0;
+    if (backend->ops->open(backend, path) == -1) {
+        return NULL;
+    }
+    seq_repair(backend->base_address); // Seção deixada aberta por um processo que morreu
+    return backend->base_address;
+}
+
+int register_backend_close(RegisterBackend *backend) {
+    int result = backend->ops->close(backend);
+    backend->base_address = NULL;
+    return result;
+}
+
+// Chamado por seq_write_end ao fim de toda escrita na imagem
+static inline void register_backend_after_commit(char *base_address) {
+    if (registers_backend.base_address == base_address && registers_backend.ops->commit != NULL) {
+        registers_backend.ops->commit(&registers_backend);
+    }
+}
+
+// Função para liberar a imagem dos registradores, gravando o que estiver pendente
+int registers_release(void* map, int file_size) {
+    // Grava o que o modo de durabilidade ainda tiver pendente
+    if (registers_durability.base_address == map) {
+        durability_stop(&registers_durability);
+    }
+    if (registers_backend.base_address == map) {
+        return register_backend_close(&registers_backend);
+    }
+    return registers_unmap(map, file_size);
+}
 
-    // Limpa os bits correspondentes ao componente verde
-    value &= ~GREEN_MASK;
+// ATUALIZAÇÃO ATÔMICA DE CAMPOS
+// O arquivo é mapeado com MAP_SHARED, então o mesmo registrador pode ser
+// alterado por várias threads e por outros processos. Toda alteração de
+// campo é feita dentro da seção de escrita (abaixo), que tem um escritor por
+// vez: a leitura, a troca dos bits e o store da palavra mapeada não se
+// intercalam com outro escritor, então bits vizinhos (ex.: LED no bit 9 e
+// cores nos bits 10-12 de R2) nunca se perdem, sem laço de compare-and-swap.
 
-    // Define a intensidade do componente verde
-    value |= ((intensity << 2) & GREEN_MASK);
+//
+// Além disso, toda escrita nos registradores fica entre seq_write_begin e
+// seq_write_end: o contador de sequência em SEQUENCE_OFFSET fica ímpar
+// durante a escrita, e os leitores usam registers_snapshot para obter uma
+// cópia consistente de R0-R15 sem bloquear os escritores.
+//
+// Os escritores são serializados (o registro de alterações e a gravação de
+// sessões dependem de um produtor por vez) por uma trava cuja palavra, em
+// SEQ_OWNER_OFFSET, guarda o tid do dono e o instante em que essa thread
+// começou (campo starttime de /proc/<tid>/stat). Um processo que morre dentro
+// de uma seção não trava os demais para sempre: quem espera demais confere se
+// a thread dona ainda existe e, se não existir ou se o tid tiver sido
+// reaproveitado por outra tarefa (início diferente), assume a trava. Com a trava, um
+// contador ímpar só pode ser uma seção abandonada, que é fechada pela seção
+// seguinte. A imagem também é reparada ao ser aberta (seq_repair).
+#define SEQ_SPINS_BEFORE_CHECK 1024 // Voltas de espera entre as conferências do dono
 
-    // Escreve o novo valor no registrador R1
-    *((unsigned short *)(base_address + (1 * sizeof(unsigned short)))) = value;
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
 
-    printf("Valor do registrador R1 após definir a intensidade do componente verde: %hu\n", *((unsigned short *)(base_address + (1 * sizeof(unsigned short)))));
+// Lê um registrador de forma atômica
+unsigned short reg_atomic_load(char* base_address, int reg) {
+    STATS_TIMER_START(timer, reg_atomic_load);
+    unsigned short value = __atomic_load_n(REG_PTR(base_address, reg), __ATOMIC_ACQUIRE);
+    STATS_TIMER_STOP(timer, reg_atomic_load);
+    return value;
 }
 
-// Corrigindo a aplicação da máscara no método set_intensity_B
-void set_intensity_B(char* base_address, int intensity) {
-    // Garante que a intensidade esteja dentro do intervalo válido (0-255)
-    if (intensity < 0 || intensity > 255) {
-        fprintf(stderr, "Erro: Intensidade do componente B fora do intervalo válido (0-255)\n");
-        return;
+// Identificação do dono da trava: tid na metade baixa e os 32 bits baixos do
+// início da thread (em ticks desde o boot) na alta
+#define SEQ_OWNER_TID(owner) ((int)((owner) & 0xFFFFFFFFu))
+#define SEQ_OWNER_START(owner) ((unsigned int)((owner) >> 32))
+
+// Lê o início da tarefa (campo 22 de /proc/<tid>/stat). Retorna -1 com errno
+// em caso de erro (ENOENT: a tarefa não existe; ESRCH: já terminou).
+static int seq_task_start(int tid, unsigned int *start) {
+    char path[64], buffer[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", tid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0) {
+        errno = length == 0 ? ESRCH : errno;
+        return -1;
+    }
+    buffer[length] = '\0';
+
+    // O nome (campo 2) pode ter espaços; os campos seguintes vêm depois do último ')'
+    char *field = strrchr(buffer, ')');
+    if (field != NULL && (field[2] == 'Z' || field[2] == 'X')) {
+        errno = ESRCH; // Zumbi: morreu, só não foi recolhida
+        return -1;
+    }
+    for (int index = 2; field != NULL && index < 22; index++) {
+        field = strchr(field + 1, ' ');
+    }
+    if (field == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    *start = (unsigned int)strtoull(field + 1, NULL, 10);
+    return 0;
+}
+
+// Dono da thread atual, guardado por thread; o filho de um fork recalcula
+static __thread unsigned long long seq_thread_owner = 0;
+static pthread_once_t seq_atfork_once = PTHREAD_ONCE_INIT;
+
+static void seq_after_fork_child(void) {
+    seq_thread_owner = 0;
+}
+
+static void seq_register_atfork(void) {
+    pthread_atfork(NULL, NULL, seq_after_fork_child);
+}
+
+static inline unsigned long long seq_self(void) {
+    if (seq_thread_owner == 0) {
+        pthread_once(&seq_atfork_once, seq_register_atfork);
+        int tid = (int)syscall(SYS_gettid);
+        unsigned int start = 0;
+        seq_task_start(tid, &start); // Sem /proc, o início fica 0 e só o tid identifica
+        seq_thread_owner = ((unsigned long long)start << 32) | (unsigned int)tid;
+    }
+    return seq_thread_owner;
+}
+
+// A thread dona da trava ainda existe? Um tid reaproveitado por outra tarefa
+// tem outro início. Erros diferentes de ENOENT contam como vivo, para nunca
+// tomar a trava de quem ainda a usa.
+static int seq_owner_alive(unsigned long long owner) {
+    unsigned int start;
+    if (seq_task_start(SEQ_OWNER_TID(owner), &start) == -1) {
+        return errno != ENOENT && errno != ESRCH;
     }
+    return SEQ_OWNER_START(owner) == 0 || start == SEQ_OWNER_START(owner);
+}
+
+// Marca o início de uma escrita: assume a trava dos escritores e torna o
+// contador ímpar. Escritores concorrentes (threads ou processos) são
+// serializados aqui; a trava de um escritor que morreu é assumida.
+void seq_write_begin(char* base_address) {
+    unsigned long long *owner = SEQ_OWNER_PTR(base_address);
+    unsigned int *seq = SEQ_PTR(base_address);
+    unsigned long long self = seq_self();
+
+    for (int spins = 1;; spins++) {
+        unsigned long long current = 0;
+        if (__atomic_compare_exchange_n(owner, &current, self, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        if (spins % SEQ_SPINS_BEFORE_CHECK == 0) {
+            if (!seq_owner_alive(current) &&
+                __atomic_compare_exchange_n(owner, &current, self, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                break;
+            }
+            sched_yield();
+        } else {
+            cpu_relax();
+        }
+    }
+
+    // Contador já ímpar: seção abandonada, continuada por esta
+    unsigned int current = __atomic_load_n(seq, __ATOMIC_RELAXED);
+    if ((current & 1) == 0) {
+        __atomic_store_n(seq, current + 1, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE); // Os dados só mudam depois do contador ímpar
+}
+
+// Fecha uma seção de escrita abandonada: se a trava estiver livre ou com um
+// dono que não existe mais, assume a trava e deixa o contador par. Chamada
+// ao abrir a imagem e pelos leitores que esperam demais por um contador par.
+void seq_repair(char* base_address) {
+    unsigned long long *owner = SEQ_OWNER_PTR(base_address);
+    unsigned long long current = __atomic_load_n(owner, __ATOMIC_ACQUIRE);
+    if (current != 0 && seq_owner_alive(current)) {
+        return;
+    }
+    if (!__atomic_compare_exchange_n(owner, &current, seq_self(), 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return; // Outro escritor assumiu a trava
+    }
+    unsigned int sequence = __atomic_load_n(SEQ_PTR(base_address), __ATOMIC_RELAXED);
+    if (sequence & 1) {
+        __atomic_store_n(SEQ_PTR(base_address), sequence + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(owner, 0, __ATOMIC_RELEASE);
+}
+
+// NOTIFICAÇÃO DE ALTERAÇÕES
+// Cada escrita concluída incrementa a geração em GENERATION_OFFSET. Os
+// assinantes (de qualquer processo que mapeie o arquivo) dormem em um futex
+// sobre essa palavra, então não gastam CPU enquanto nada muda. O escritor só
+// faz a chamada de sistema de despertar quando há alguém esperando.
+//
+// Quem espera é indicado por um sinalizador (WAITERS_OFFSET), não por um
+// contador: cada assinante o liga antes de dormir e o escritor o desliga ao
+// acordar todos, que o religam se voltarem a esperar. Assim, um assinante
+// morto (ex.: --watch encerrado por um sinal) custa no máximo um despertar a
+// mais, em vez de deixar a chamada de sistema ligada para sempre.
+
+// Lê a geração atual das alterações
+unsigned int registers_generation(char* base_address) {
+    return __atomic_load_n(GENERATION_PTR(base_address), __ATOMIC_ACQUIRE);
+}
+
+// Sinaliza aos assinantes que os registradores mudaram
+void registers_notify(char* base_address) {
+    __atomic_fetch_add(GENERATION_PTR(base_address), 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(WAITERS_PTR(base_address), __ATOMIC_SEQ_CST) != 0 &&
+        __atomic_exchange_n(WAITERS_PTR(base_address), 0, __ATOMIC_SEQ_CST) != 0) {
+        syscall(SYS_futex, GENERATION_PTR(base_address), FUTEX_WAKE, 0x7FFFFFFF, NULL, NULL, 0);
+    }
+}
+
+// Bloqueia até a geração ser diferente de last_generation, até o tempo
+// limite (timeout_ms < 0 espera indefinidamente) ou até um sinal com
+// tratador interromper a espera. Retorna a nova geração, ou last_generation
+// se o tempo acabou ou a espera foi interrompida.
+unsigned int registers_wait_change(char* base_address, unsigned int last_generation, int timeout_ms) {
+    unsigned int *generation = GENERATION_PTR(base_address);
+    struct timespec timeout;
+    struct timespec *timeout_ptr = NULL;
+
+    if (timeout_ms >= 0) {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        timeout_ptr = &timeout;
+    }
+
+    unsigned int current = __atomic_load_n(generation, __ATOMIC_ACQUIRE);
+    while (current == last_generation) {
+        // Religa o sinalizador antes de cada espera; o escritor o desliga ao acordar
+        if (__atomic_load_n(WAITERS_PTR(base_address), __ATOMIC_SEQ_CST) == 0) {
+            __atomic_store_n(WAITERS_PTR(base_address), 1, __ATOMIC_SEQ_CST);
+        }
+        current = __atomic_load_n(generation, __ATOMIC_SEQ_CST);
+        if (current != last_generation) {
+            break;
+        }
+        long result = syscall(SYS_futex, generation, FUTEX_WAIT, last_generation, timeout_ptr, NULL, 0);
+        current = __atomic_load_n(generation, __ATOMIC_ACQUIRE);
+        if (result == -1 && (errno == ETIMEDOUT || errno == EINTR)) {
+            break;
+        }
+    }
+    return current;
+}
+
+// Observador de alterações para laços de eventos (poll/epoll): uma thread
+// dorme no futex de geração e incrementa um eventfd a cada alteração, feita
+// por este ou por outro processo
+typedef struct {
+    char *base_address;
+    int event_fd;
+    volatile int stopping;
+    int started; // A thread foi criada e precisa de pthread_join
+    pthread_t thread;
+} RegisterWatcher;
+
+void *register_watcher_thread(void *arg) {
+    RegisterWatcher *watcher = arg;
+    unsigned int generation = registers_generation(watcher->base_address);
+    unsigned long long one = 1;
+
+    while (!watcher->stopping) {
+        unsigned int current = registers_wait_change(watcher->base_address, generation, 200);
+        if (current != generation) {
+            generation = current;
+            if (write(watcher->event_fd, &one, sizeof(one)) < 0) {
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+int register_watcher_start(RegisterWatcher *watcher, char *base_address) {
+    watcher->base_address = base_address;
+    watcher->stopping = 0;
+    watcher->started = 0;
+    watcher->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (watcher->event_fd == -1) {
+        perror("Erro ao criar o eventfd");
+        return -1;
+    }
+    int error = pthread_create(&watcher->thread, NULL, register_watcher_thread, watcher);
+    if (error != 0) {
+        fprintf(stderr, "Erro ao criar a thread do observador: %s\n", strerror(error));
+        close(watcher->event_fd);
+        watcher->event_fd = -1;
+        return -1;
+    }
+    watcher->started = 1;
+    return 0;
+}
+
+void register_watcher_stop(RegisterWatcher *watcher) {
+    if (!watcher->started) {
+        return;
+    }
+    watcher->stopping = 1;
+    pthread_join(watcher->thread, NULL);
+    watcher->started = 0;
+    close(watcher->event_fd);
+    watcher->event_fd = -1;
+}
+
+// Chamado ao fim de cada seção de escrita, já fora do seqlock (motor de regras)
+void (*registers_commit_hook)(char *base_address) = NULL;
+
+// Marca o fim da escrita, tornando o contador par novamente, e avisa os assinantes
+void seq_write_end(char* base_address) {
+    __atomic_fetch_add(SEQ_PTR(base_address), 1, __ATOMIC_RELEASE);
+    __atomic_store_n(SEQ_OWNER_PTR(base_address), 0, __ATOMIC_RELEASE);
+    registers_notify(base_address);
+    durability_after_commit(base_address);
+    register_backend_after_commit(base_address);
+    if (registers_commit_hook != NULL) {
+        registers_commit_hook(base_address);
+    }
+}
+
+typedef struct {
+    unsigned short regs[REGISTER_COUNT];
+    unsigned int sequence; // Valor (par) do contador na leitura
+} RegisterSnapshot;
+
+// Copia R0-R15 de forma consistente, repetindo a leitura se um escritor
+// estiver ativo ou tiver terminado no meio da cópia. Retorna o número de
+// tentativas repetidas.
+int registers_snapshot(char* base_address, RegisterSnapshot *snapshot) {
+    unsigned int *seq = SEQ_PTR(base_address);
+    unsigned long long *words = (unsigned long long *)base_address;
+    unsigned long long copy[REGISTER_COUNT / 4];
+    int retries = 0;
+    STATS_TIMER_START(timer, registers_snapshot);
+
+    for (;;) {
+        unsigned int before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        if ((before & 1) == 0) {
+            for (int i = 0; i < REGISTER_COUNT / 4; i++) {
+                copy[i] = __atomic_load_n(&words[i], __ATOMIC_RELAXED);
+            }
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(seq, __ATOMIC_RELAXED) == before) {
+                memcpy(snapshot->regs, copy, sizeof(copy));
+                snapshot->sequence = before;
+                STATS_TIMER_STOP(timer, registers_snapshot);
+                return retries;
+            }
+        }
+        retries++;
+        if (retries % SEQ_SPINS_BEFORE_CHECK == 0) {
+            seq_repair(base_address); // O escritor pode ter morrido no meio da seção
+        }
+        cpu_relax();
+    }
+}
+
+// REGISTRO DE ALTERAÇÕES
+// Cada escrita em um registrador gera um registro (instante, registrador,
+// valor anterior e novo) em um anel no arquivo CHANGE_LOG_PATH, mapeado com
+// MAP_SHARED. Só há um produtor por vez: o registro é feito dentro da seção
+// de escrita do seqlock, que já serializa escritores de qualquer processo.
+// Os assinantes leem no próprio ritmo, sem travas; se o produtor der a volta
+// no anel antes de um assinante ler um registro, a perda é detectada pelo
+// número de sequência do registro e contada como overrun.
+
+#define CHANGE_LOG_MAGIC 0x474F4C52 // "RLOG"
+
+typedef struct {
+    unsigned int magic;
+    unsigned int capacity;
+    unsigned long long head;                // Próximo índice a ser escrito
+    char padding[CACHE_LINE_SIZE - 16];      // head sozinho em sua linha de cache
+} ChangeLogHeader;
+
+typedef struct {
+    unsigned long long sequence; // Índice + 1 quando válido, 0 durante a escrita
+    unsigned long long timestamp_ns;
+    unsigned short reg;
+    unsigned short old_value;
+    unsigned short new_value;
+    unsigned short padding;
+} ChangeRecord;
+
+typedef struct {
+    ChangeLogHeader *header;
+    ChangeRecord *records;
+    char *registers;   // Registradores cujas escritas são registradas
+    size_t size;
+    int fd;
+} ChangeLog;
+
+ChangeLog change_log = {NULL};
+
+// Abre (ou cria) o anel e o associa aos registradores mapeados em
+// registers_base. Escritas em outros endereços (bancos, buffers de
+// benchmark) não são registradas.
+int change_log_open(ChangeLog *log, const char *file_path, char *registers_base) {
+    log->size = sizeof(ChangeLogHeader) + CHANGE_LOG_CAPACITY * sizeof(ChangeRecord);
+    log->fd = open(file_path, O_RDWR | O_CREAT, 0666);
+    if (log->fd == -1) {
+        perror("Erro ao abrir ou criar o registro de alterações");
+        return -1;
+    }
+    if (ftruncate(log->fd, log->size) == -1) {
+        perror("Erro ao definir o tamanho do registro de alterações");
+        close(log->fd);
+        return -1;
+    }
+    char *map = mmap(0, log->size, PROT_READ | PROT_WRITE, MAP_SHARED, log->fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Erro ao mapear o registro de alterações");
+        close(log->fd);
+        return -1;
+    }
+    log->header = (ChangeLogHeader *)map;
+    log->records = (ChangeRecord *)(map + sizeof(ChangeLogHeader));
+    if (log->header->magic != CHANGE_LOG_MAGIC || log->header->capacity != CHANGE_LOG_CAPACITY) {
+        memset(map, 0, log->size);
+        log->header->capacity = CHANGE_LOG_CAPACITY;
+        __atomic_store_n(&log->header->magic, CHANGE_LOG_MAGIC, __ATOMIC_RELEASE);
+    }
+    log->registers = registers_base;
+    return 0;
+}
+
+int change_log_close(ChangeLog *log) {
+    if (log->header == NULL) {
+        return 0;
+    }
+    log->registers = NULL;
+    if (munmap(log->header, log->size) == -1) {
+        perror("Erro ao desmapear o registro de alterações");
+        close(log->fd);
+        return -1;
+    }
+    log->header = NULL;
+    return close(log->fd);
+}
+
+// Acrescenta um registro. Deve ser chamada apenas dentro de uma seção de escrita.
+void change_log_append(ChangeLog *log, int reg, unsigned short old_value, unsigned short new_value) {
+    unsigned long long index = __atomic_load_n(&log->header->head, __ATOMIC_RELAXED);
+    ChangeRecord *record = &log->records[index & (CHANGE_LOG_CAPACITY - 1)];
+
+    __atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&record->timestamp_ns, (unsigned long long)monotonic_ns(), __ATOMIC_RELAXED);
+    __atomic_store_n(&record->reg, (unsigned short)reg, __ATOMIC_RELAXED);
+    __atomic_store_n(&record->old_value, old_value, __ATOMIC_RELAXED);
+    __atomic_store_n(&record->new_value, new_value, __ATOMIC_RELAXED);
+    __atomic_store_n(&record->sequence, index + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&log->header->head, index + 1, __ATOMIC_RELEASE);
+}
+
+typedef struct {
+    ChangeLog *log;
+    unsigned long long next;     // Próximo índice a ler
+    unsigned long long overruns; // Registros perdidos por atraso do assinante
+} ChangeLogReader;
+
+// Posiciona o assinante no fim do anel (só novas escritas) ou no registro
+// mais antigo ainda disponível
+void change_log_reader_init(ChangeLogReader *reader, ChangeLog *log, int from_oldest) {
+    unsigned long long head = __atomic_load_n(&log->header->head, __ATOMIC_ACQUIRE);
+    reader->log = log;
+    reader->overruns = 0;
+    reader->next = head;
+    if (from_oldest) {
+        reader->next = head > CHANGE_LOG_CAPACITY ? head - CHANGE_LOG_CAPACITY : 0;
+    }
+}
+
+// Lê o próximo registro. Retorna 1 se leu, 0 se não há registros novos.
+int change_log_next(ChangeLogReader *reader, ChangeRecord *out) {
+    for (;;) {
+        unsigned long long head = __atomic_load_n(&reader->log->header->head, __ATOMIC_ACQUIRE);
+        if (reader->next >= head) {
+            return 0;
+        }
+        if (head - reader->next > CHANGE_LOG_CAPACITY) {
+            reader->overruns += head - CHANGE_LOG_CAPACITY - reader->next;
+            reader->next = head - CHANGE_LOG_CAPACITY;
+        }
+
+        ChangeRecord *record = &reader->log->records[reader->next & (CHANGE_LOG_CAPACITY - 1)];
+        unsigned long long expected = reader->next + 1;
+        if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) == expected) {
+            out->timestamp_ns = __atomic_load_n(&record->timestamp_ns, __ATOMIC_RELAXED);
+            out->reg = __atomic_load_n(&record->reg, __ATOMIC_RELAXED);
+            out->old_value = __atomic_load_n(&record->old_value, __ATOMIC_RELAXED);
+            out->new_value = __atomic_load_n(&record->new_value, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&record->sequence, __ATOMIC_RELAXED) == expected) {
+                out->sequence = expected;
+                reader->next++;
+                return 1;
+            }
+        }
+
+        // O produtor já sobrescreveu este registro
+        reader->overruns++;
+        reader->next++;
+    }
+}
+
+// GRAVAÇÃO DE SESSÕES
+// Com --record, toda escrita de registrador feita por este processo vai para
+// um arquivo de trace compacto:
+//   cabeçalho: "RTRC", versão, instante inicial e imagem inicial de R0-R15
+//   registros: registrador (1 byte), tempo desde o registro anterior em ns
+//              e XOR entre o valor novo e o último valor gravado do
+//              registrador, ambos em varint (7 bits por byte)
+//   rodapé:    byte 0xFF, número de registros e imagem final de R0-R15
+// Uma escrita típica ocupa de 3 a 6 bytes. O gravador mapeia o arquivo de
+// registros por conta própria para tirar a imagem final mesmo depois de o
+// programa liberar o seu mapeamento.
+
+#define TRACE_MAGIC 0x43525452 // "RTRC"
+#define TRACE_VERSION 1
+#define TRACE_END 0xFF
+
+typedef struct {
+    unsigned int magic;
+    unsigned short version;
+    unsigned short register_count;
+    unsigned long long start_ns;
+    unsigned short initial[REGISTER_COUNT];
+} TraceHeader;
+
+typedef struct {
+    FILE *output;
+    char *registers;     // Registradores cujas escritas são gravadas
+    char *view;          // Mapeamento próprio do arquivo de registros
+    long long last_ns;
+    unsigned long long records;
+    unsigned short last_value[REGISTER_COUNT];
+} TraceRecorder;
+
+TraceRecorder trace_recorder = {NULL};
+
+static inline void trace_put_varint(FILE *output, unsigned long long value) {
+    while (value >= 0x80) {
+        putc_unlocked((int)(value & 0x7F) | 0x80, output);
+        value >>= 7;
+    }
+    putc_unlocked((int)value, output);
+}
+
+// Grava uma escrita. Chamada dentro da seção de escrita, então os registros
+// já chegam serializados.
+static inline void trace_record(TraceRecorder *recorder, int reg, unsigned short new_value) {
+    long long now = monotonic_ns();
+    putc_unlocked(reg, recorder->output);
+    trace_put_varint(recorder->output, (unsigned long long)(now - recorder->last_ns));
+    trace_put_varint(recorder->output, new_value ^ recorder->last_value[reg]);
+    recorder->last_ns = now;
+    recorder->last_value[reg] = new_value;
+    recorder->records++;
+}
+
+// Fecha a gravação com a imagem final (chamada automaticamente na saída)
+void trace_recorder_stop(void) {
+    TraceRecorder *recorder = &trace_recorder;
+    if (recorder->output == NULL) {
+        return;
+    }
+    RegisterSnapshot snapshot;
+    seq_write_begin(recorder->view);
+    recorder->registers = NULL;
+    memcpy(snapshot.regs, recorder->view, sizeof(snapshot.regs));
+    seq_write_end(recorder->view);
+
+    putc(TRACE_END, recorder->output);
+    fwrite(&recorder->records, sizeof(recorder->records), 1, recorder->output);
+    fwrite(snapshot.regs, sizeof(snapshot.regs), 1, recorder->output);
+    if (fclose(recorder->output) != 0) {
+        perror("Erro ao gravar o arquivo de trace");
+    }
+    recorder->output = NULL;
+    munmap(recorder->view, FILE_SIZE);
+}
+
+int trace_recorder_start(TraceRecorder *recorder, const char *trace_path, const char *registers_path, char *registers_base) {
+    int view_fd = open(registers_path, O_RDWR);
+    if (view_fd == -1) {
+        perror("Erro ao abrir o arquivo de registros para a gravação");
+        return -1;
+    }
+    recorder->view = mmap(0, FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, view_fd, 0);
+    close(view_fd);
+    if (recorder->view == MAP_FAILED) {
+        perror("Erro ao mapear o arquivo de registros para a gravação");
+        return -1;
+    }
+    recorder->output = fopen(trace_path, "wb");
+    if (recorder->output == NULL) {
+        perror("Erro ao criar o arquivo de trace");
+        munmap(recorder->view, FILE_SIZE);
+        return -1;
+    }
+
+    RegisterSnapshot snapshot;
+    TraceHeader header = {.magic = TRACE_MAGIC, .version = TRACE_VERSION, .register_count = REGISTER_COUNT};
+    seq_write_begin(recorder->view); // Nenhuma escrita entre a imagem inicial e o início da gravação
+    memcpy(snapshot.regs, recorder->view, sizeof(snapshot.regs));
+    header.start_ns = monotonic_ns();
+    memcpy(header.initial, snapshot.regs, sizeof(header.initial));
+    memcpy(recorder->last_value, snapshot.regs, sizeof(recorder->last_value));
+    recorder->last_ns = header.start_ns;
+    recorder->records = 0;
+    fwrite(&header, sizeof(header), 1, recorder->output);
+    recorder->registers = registers_base;
+    seq_write_end(recorder->view);
+
+    atexit(trace_recorder_stop);
+    return 0;
+}
+
+// TABELAS DE COR
+// Conversões entre cor de 24 bits, os campos de R1/R2 e as sequências de
+// escape do terminal feitas só com consultas a tabelas constantes:
+//   color_gamma_encode: valor percebido (0-255) -> intensidade do LED, gama 2.2
+//   color_gamma_decode: inversa, intensidade -> valor percebido
+//   color_red_expand / color_green_expand: 5 e 6 bits -> 8 bits por replicação
+//   color_red_levels / color_green_levels: 8 bits -> 5 e 6 bits, com limiar
+//     de Bayer 4x4 (linhas 0-15) ou arredondamento ao mais próximo (linha 16)
+//   color_decimal: texto decimal de 0-255 seguido de ';'
+// As tabelas de gama foram geradas com floor(255 * (i / 255)^g + 0.5) e são
+// conferidas contra pow() por --color-tables; as demais são expandidas pelo
+// pré-processador a partir das fórmulas abaixo.
+#define COLOR_GAMMA  1 // Aplica a correção de gama
+#define COLOR_DITHER 2 // Pontilhamento ordenado (Bayer 4x4) na quantização
+#define COLOR_NEAREST_ROW 16
+
+#define COLOR_REPEAT4(F, a, i) F(a, (i)) F(a, (i) + 1) F(a, (i) + 2) F(a, (i) + 3)
+#define COLOR_REPEAT16(F, a, i) COLOR_REPEAT4(F, a, i) COLOR_REPEAT4(F, a, (i) + 4) \
+    COLOR_REPEAT4(F, a, (i) + 8) COLOR_REPEAT4(F, a, (i) + 12)
+#define COLOR_REPEAT64(F, a, i) COLOR_REPEAT16(F, a, i) COLOR_REPEAT16(F, a, (i) + 16) \
+    COLOR_REPEAT16(F, a, (i) + 32) COLOR_REPEAT16(F, a, (i) + 48)
+#define COLOR_REPEAT256(F, a, i) COLOR_REPEAT64(F, a, i) COLOR_REPEAT64(F, a, (i) + 64) \
+    COLOR_REPEAT64(F, a, (i) + 128) COLOR_REPEAT64(F, a, (i) + 192)
+
+// Matriz de Bayer 4x4 (um valor de 0-15 por nibble), indexada por (y % 4) * 4 + x % 4
+#define COLOR_BAYER(k) ((int)((0x5D7F91B36E4CA280ULL >> (4 * (k))) & 15))
+
+// Quantiza v (0-255) em 0..levels com limiar (t2 / 32) de um nível: t2 = 16
+// arredonda ao mais próximo, t2 = 2 * bayer + 1 espalha os limiares
+#define COLOR_QUANTIZE(levels, t2, v) (((v) * (levels) * 32 + (t2) * 255) / (255 * 32))
+#define COLOR_RED_LEVEL(t2, v) COLOR_QUANTIZE(31, t2, v),
+#define COLOR_GREEN_LEVEL(t2, v) COLOR_QUANTIZE(63, t2, v),
+#define COLOR_RED_ROW(t2) {COLOR_REPEAT256(COLOR_RED_LEVEL, t2, 0)},
+#define COLOR_GREEN_ROW(t2) {COLOR_REPEAT256(COLOR_GREEN_LEVEL, t2, 0)},
+#define COLOR_LEVEL_ROWS(ROW) \
+    ROW(2 * COLOR_BAYER(0) + 1)  ROW(2 * COLOR_BAYER(1) + 1)  ROW(2 * COLOR_BAYER(2) + 1)  ROW(2 * COLOR_BAYER(3) + 1) \
+    ROW(2 * COLOR_BAYER(4) + 1)  ROW(2 * COLOR_BAYER(5) + 1)  ROW(2 * COLOR_BAYER(6) + 1)  ROW(2 * COLOR_BAYER(7) + 1) \
+    ROW(2 * COLOR_BAYER(8) + 1)  ROW(2 * COLOR_BAYER(9) + 1)  ROW(2 * COLOR_BAYER(10) + 1) ROW(2 * COLOR_BAYER(11) + 1) \
+    ROW(2 * COLOR_BAYER(12) + 1) ROW(2 * COLOR_BAYER(13) + 1) ROW(2 * COLOR_BAYER(14) + 1) ROW(2 * COLOR_BAYER(15) + 1) \
+    ROW(16)
+
+#define COLOR_EXPAND5(unused, i) (((i) << 3) | ((i) >> 2)),
+#define COLOR_EXPAND6(unused, i) (((i) << 2) | ((i) >> 4)),
+
+const unsigned char color_gamma_encode[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+     12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+     20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+     30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+     42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+     56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+     91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
+
+const unsigned char color_gamma_decode[256] = {
+      0,  21,  28,  34,  39,  43,  46,  50,  53,  56,  59,  61,  64,  66,  68,  70,
+     72,  74,  76,  78,  80,  82,  84,  85,  87,  89,  90,  92,  93,  95,  96,  98,
+     99, 101, 102, 103, 105, 106, 107, 109, 110, 111, 112, 114, 115, 116, 117, 118,
+    119, 120, 122, 123, 124, 125, 126, 127, 128, 129, 130, 131, 132, 133, 134, 135,
+    136, 137, 138, 139, 140, 141, 142, 143, 144, 144, 145, 146, 147, 148, 149, 150,
+    151, 151, 152, 153, 154, 155, 156, 156, 157, 158, 159, 160, 160, 161, 162, 163,
+    164, 164, 165, 166, 167, 167, 168, 169, 170, 170, 171, 172, 173, 173, 174, 175,
+    175, 176, 177, 178, 178, 179, 180, 180, 181, 182, 182, 183, 184, 184, 185, 186,
+    186, 187, 188, 188, 189, 190, 190, 191, 192, 192, 193, 194, 194, 195, 195, 196,
+    197, 197, 198, 199, 199, 200, 200, 201, 202, 202, 203, 203, 204, 205, 205, 206,
+    206, 207, 207, 208, 209, 209, 210, 210, 211, 212, 212, 213, 213, 214, 214, 215,
+    215, 216, 217, 217, 218, 218, 219, 219, 220, 220, 221, 221, 222, 223, 223, 224,
+    224, 225, 225, 226, 226, 227, 227, 228, 228, 229, 229, 230, 230, 231, 231, 232,
+    232, 233, 233, 234, 234, 235, 235, 236, 236, 237, 237, 238, 238, 239, 239, 240,
+    240, 241, 241, 242, 242, 243, 243, 244, 244, 245, 245, 246, 246, 247, 247, 248,
+    248, 249, 249, 249, 250, 250, 251, 251, 252, 252, 253, 253, 254, 254, 255, 255,
+};
+
+const char color_decimal[256][4] = {
+    "0;", "1;", "2;", "3;", "4;", "5;", "6;", "7;", "8;", "9;", "10;", "11;", "12;", "13;", "14;", "15;",
+    "16;", "17;", "18;", "19;", "20;", "21;", "22;", "23;", "24;", "25;", "26;", "27;", "28;", "29;", "30;", "31;",
+    "32;", "33;", "34;", "35;", "36;", "37;", "38;", "39;", "40;", "41;", "42;", "43;", "44;", "45;", "46;", "47;",
+    "48;", "49;", "50;", "51;", "52;", "53;", "54;", "55;", "56;", "57;", "58;", "59;", "60;", "61;", "62;", "63;",
+    "64;", "65;", "66;", "67;", "68;", "69;", "70;", "71;", "72;", "73;", "74;", "75;", "76;", "77;", "78;", "79;",
+    "80;", "81;", "82;", "83;", "84;", "85;", "86;", "87;", "88;", "89;", "90;", "91;", "92;", "93;", "94;", "95;",
+    "96;", "97;", "98;", "99;", "100;", "101;", "102;", "103;", "104;", "105;", "106;", "107;", "108;", "109;", "110;", "111;",
+    "112;", "113;", "114;", "115;", "116;", "117;", "118;", "119;", "120;", "121;", "122;", "123;", "124;", "125;", "126;", "127;",
+    "128;", "129;", "130;", "131;", "132;", "133;", "134;", "135;", "136;", "137;", "138;", "139;", "140;", "141;", "142;", "143;",
+    "144;", "145;", "146;", "147;", "148;", "149;", "150;", "151;", "152;", "153;", "154;", "155;", "156;", "157;", "158;", "159;",
+    "160;", "161;", "162;", "163;", "164;", "165;", "166;", "167;", "168;", "169;", "170;", "171;", "172;", "173;", "174;", "175;",
+    "176;", "177;", "178;", "179;", "180;", "181;", "182;", "183;", "184;", "185;", "186;", "187;", "188;", "189;", "190;", "191;",
+    "192;", "193;", "194;", "195;", "196;", "197;", "198;", "199;", "200;", "201;", "202;", "203;", "204;", "205;", "206;", "207;",
+    "208;", "209;", "210;", "211;", "212;", "213;", "214;", "215;", "216;", "217;", "218;", "219;", "220;", "221;", "222;", "223;",
+    "224;", "225;", "226;", "227;", "228;", "229;", "230;", "231;", "232;", "233;", "234;", "235;", "236;", "237;", "238;", "239;",
+    "240;", "241;", "242;", "243;", "244;", "245;", "246;", "247;", "248;", "249;", "250;", "251;", "252;", "253;", "254;", "255;",
+};
+
+const unsigned char color_red_expand[32] = {COLOR_REPEAT16(COLOR_EXPAND5, 0, 0) COLOR_REPEAT16(COLOR_EXPAND5, 0, 16)};
+const unsigned char color_green_expand[64] = {COLOR_REPEAT64(COLOR_EXPAND6, 0, 0)};
+
+const unsigned char color_red_levels[17][256] = {COLOR_LEVEL_ROWS(COLOR_RED_ROW)};
+const unsigned char color_green_levels[17][256] = {COLOR_LEVEL_ROWS(COLOR_GREEN_ROW)};
+
+// Linha das tabelas de quantização para o dispositivo na posição (x, y)
+static inline int color_threshold_row(int x, int y, int flags) {
+    return (flags & COLOR_DITHER) ? ((y & 3) << 2) | (x & 3) : COLOR_NEAREST_ROW;
+}
+
+// Codifica uma cor de 24 bits nos campos de R1 (vermelho e verde) e R2 (azul),
+// retornando R1 na metade baixa e R2 na alta (apenas os bits de cor)
+static inline unsigned int color_encode_fields(unsigned int r, unsigned int g, unsigned int b, int row, int flags) {
+    if (flags & COLOR_GAMMA) {
+        r = color_gamma_encode[r];
+        g = color_gamma_encode[g];
+        b = color_gamma_encode[b];
+    }
+    return ((unsigned int)color_red_levels[row][r] << FIELD_red_SHIFT) |
+           ((unsigned int)color_green_levels[row][g] << FIELD_green_SHIFT) | (b << (16 + FIELD_blue_SHIFT));
+}
+
+// Decodifica os campos de cor de R1/R2 (mesmo formato de color_encode_fields)
+static inline void color_decode_fields(unsigned int fields, unsigned int *r, unsigned int *g, unsigned int *b, int flags) {
+    *r = color_red_expand[(fields >> FIELD_red_SHIFT) & 0x1F];
+    *g = color_green_expand[(fields >> FIELD_green_SHIFT) & 0x3F];
+    *b = (fields >> (16 + FIELD_blue_SHIFT)) & 0xFF;
+    if (flags & COLOR_GAMMA) {
+        *r = color_gamma_decode[*r];
+        *g = color_gamma_decode[*g];
+        *b = color_gamma_decode[*b];
+    }
+}
+
+// Escreve a sequência de escape de cor do texto (ESC[38;2;R;G;Bm) em out,
+// que deve ter espaço para COLOR_ESCAPE_MAX bytes. Retorna o tamanho, sem o '\0'.
+#define COLOR_ESCAPE_MAX 20
+
+static inline int color_decimal_length(unsigned int v) {
+    return 2 + (v >= 10) + (v >= 100); // Dígitos e o ';'
+}
+
+static inline int color_escape(char *out, unsigned int r, unsigned int g, unsigned int b) {
+    char *p = out;
+    memcpy(p, "\x1b[38;2;", 7);
+    p += 7;
+    memcpy(p, color_decimal[r], 4);
+    p += color_decimal_length(r);
+    memcpy(p, color_decimal[g], 4);
+    p += color_decimal_length(g);
+    memcpy(p, color_decimal[b], 4);
+    p += color_decimal_length(b);
+    p[-1] = 'm';
+    *p = '\0';
+    return p - out;
+}
+
+// BLOCOS ALTERADOS
+// Uma imagem mapeada (registers.bin ou um banco) pode ser acompanhada em
+// blocos de DEVICE_STRIDE bytes: cada escrita feita por este processo liga o
+// bit do bloco, e a captura de snapshots copia apenas os blocos marcados.
+typedef struct {
+    char *base_address;
+    size_t size;
+    int blocks;
+    unsigned long long *dirty; // Um bit por bloco
+} DirtyTracker;
+
+DirtyTracker dirty_tracker = {NULL};
+
+// Marca os blocos de [address, address + length) se estiverem na imagem acompanhada
+static inline void dirty_mark_range(char *address, size_t length) {
+    DirtyTracker *tracker = &dirty_tracker;
+    if (tracker->dirty == NULL || address < tracker->base_address ||
+        address >= tracker->base_address + tracker->size) {
+        return;
+    }
+    size_t first = (size_t)(address - tracker->base_address) / DEVICE_STRIDE;
+    size_t last = (size_t)(address + length - 1 - tracker->base_address) / DEVICE_STRIDE;
+    if (last >= (size_t)tracker->blocks) {
+        last = tracker->blocks - 1;
+    }
+    for (size_t block = first; block <= last; block++) {
+        __atomic_fetch_or(&tracker->dirty[block / 64], 1ULL << (block % 64), __ATOMIC_RELEASE);
+    }
+}
+
+// Ponto único chamado após cada escrita de registrador, ainda dentro da
+// seção de escrita: alimenta o registro de alterações, a gravação e os
+// blocos alterados
+static inline void registers_after_write(char* base_address, int reg, unsigned short old_value, unsigned short new_value) {
+    if (change_log.registers == base_address) {
+        change_log_append(&change_log, reg, old_value, new_value);
+    }
+    if (trace_recorder.registers == base_address) {
+        trace_record(&trace_recorder, reg, new_value);
+    }
+    dirty_mark_range((char *)REG_PTR(base_address, reg), sizeof(unsigned short));
+    STATS_COUNT_REGISTER(reg);
+}
+
+// Substitui os bits de mask de uma palavra de 16 bits pelo valor (já
+// deslocado) e retorna o novo valor. Só dentro da seção de escrita: o store
+// simples é seguro porque nenhum outro escritor altera a palavra ao mesmo tempo.
+unsigned short reg_locked_update_old(unsigned short *word, unsigned short mask,
+                                     unsigned short value, unsigned short *old_value) {
+    unsigned short previous = __atomic_load_n(word, __ATOMIC_RELAXED);
+    unsigned short desired = (previous & ~mask) | (value & mask);
+    __atomic_store_n(word, desired, __ATOMIC_RELAXED);
+
+    if (old_value != NULL) {
+        *old_value = previous;
+    }
+    return desired;
+}
+
+// Substitui os bits de mask do registrador pelo valor (já deslocado) e
+// retorna o novo valor. Se old_value não for NULL, recebe o valor anterior.
+unsigned short reg_atomic_update_old(char* base_address, int reg, unsigned short mask,
+                                     unsigned short value, unsigned short *old_value) {
+    unsigned short previous;
+    seq_write_begin(base_address);
+    unsigned short result = reg_locked_update_old(REG_PTR(base_address, reg), mask, value, &previous);
+    registers_after_write(base_address, reg, previous, result);
+    seq_write_end(base_address);
+    if (old_value != NULL) {
+        *old_value = previous;
+    }
+    return result;
+}
+
+unsigned short reg_atomic_update(char* base_address, int reg, unsigned short mask, unsigned short value) {
+    return reg_atomic_update_old(base_address, reg, mask, value, NULL);
+}
+
+// Escreve R0-R15 de uma vez (ex.: restauração após um benchmark), registrando
+// apenas os registradores que mudaram
+void registers_write_all(char* base_address, const unsigned short *values) {
+    seq_write_begin(base_address);
+    for (int reg = 0; reg < REGISTER_COUNT; reg++) {
+        unsigned short *word = REG_PTR(base_address, reg);
+        unsigned short previous = *word;
+        if (previous != values[reg]) {
+            __atomic_store_n(word, values[reg], __ATOMIC_RELAXED);
+            registers_after_write(base_address, reg, previous, values[reg]);
+        }
+    }
+    seq_write_end(base_address);
+}
+
+// Escrita atômica de cada campo do mapa de registradores: field_store_<nome>
+#define DEFINE_FIELD_STORE(arg, name, reg, offset, width) \
+    static inline unsigned short field_store_##name(char* base_address, unsigned short value) { \
+        STATS_COUNT_FIELD(FIELD_##name##_INDEX); \
+        return reg_atomic_update(base_address, reg, FIELD_BITS(offset, width), value << (offset)); \
+    }
+REGISTER_FIELDS(DEFINE_FIELD_STORE, 0)
+
+// Função para definir o valor do componente vermelho (R)
+void set_valor_R(char* base_address, int red_value) {
+    // Se red_value for 1, liga o bit 10 do registrador de controle, caso contrário, desliga
+    // Bit 10: Controla o componente vermelho (R)
+    STATS_TIMER_START(timer, set_valor_R);
+    field_store_red_on(base_address, red_value == 1);
+    STATS_TIMER_STOP(timer, set_valor_R);
+}
+
+// Função para definir o valor do componente verde (G)
+void set_valor_G(char* base_address, int green_value) {
+    // Se green_value for 1, liga o bit 11 do registrador de controle, caso contrário, desliga
+    // Bit 11: Controla o componente verde (G)
+    STATS_TIMER_START(timer, set_valor_G);
+    field_store_green_on(base_address, green_value == 1);
+    STATS_TIMER_STOP(timer, set_valor_G);
+}
+
+// Função para definir o valor do componente azul (B)
+void set_valor_B(char* base_address, int blue_value) {
+    // Se blue_value for 1, liga o bit 12 do registrador de controle, caso contrário, desliga
+    // Bit 12: Controla o componente azul (B)
+    STATS_TIMER_START(timer, set_valor_B);
+    field_store_blue_on(base_address, blue_value == 1);
+    STATS_TIMER_STOP(timer, set_valor_B);
+}
+
+void set_intensity_R(char* base_address, int intensity) {
+    // Garante que a intensidade esteja dentro do intervalo válido (0-255)
+    if (intensity < 0 || intensity > 255) {
+        STATS_REJECT(red);
+        fprintf(stderr, "Erro: Intensidade do componente R fora do intervalo válido (0-255)\n");
+        return;
+    }
+
+    STATS_TIMER_START(timer, set_intensity_R);
+    // Guarda os 5 bits mais significativos da intensidade no campo vermelho de R1
+    field_store_red(base_address, intensity >> (8 - FIELD_red_WIDTH));
+    STATS_TIMER_STOP(timer, set_intensity_R);
+
+    if (registers_verbose) {
+        printf("Valor do registrador R1 após definir a intensidade do componente vermelho: %hu\n", *((unsigned short *)(base_address + (1 * sizeof(unsigned short)))));
+    }
+}
+
+void set_intensity_G(char* base_address, int intensity) {
+    // Garante que a intensidade esteja dentro do intervalo válido (0-255)
+    if (intensity < 0 || intensity > 255) {
+        STATS_REJECT(green);
+        fprintf(stderr, "Erro: Intensidade do componente G fora do intervalo válido (0-255)\n");
+        return;
+    }
+    
+    STATS_TIMER_START(timer, set_intensity_G);
+    // Guarda os 6 bits mais significativos da intensidade no campo verde de R1
+    field_store_green(base_address, intensity >> (8 - FIELD_green_WIDTH));
+    STATS_TIMER_STOP(timer, set_intensity_G);
+
+    if (registers_verbose) {
+        printf("Valor do registrador R1 após definir a intensidade do componente verde: %hu\n", *((unsigned short *)(base_address + (1 * sizeof(unsigned short)))));
+    }
+}
+
+// Corrigindo a aplicação da máscara no método set_intensity_B
+void set_intensity_B(char* base_address, int intensity) {
+    // Garante que a intensidade esteja dentro do intervalo válido (0-255)
+    if (intensity < 0 || intensity > 255) {
+        STATS_REJECT(blue);
+        fprintf(stderr, "Erro: Intensidade do componente B fora do intervalo válido (0-255)\n");
+        return;
+    }
+
+    STATS_TIMER_START(timer, set_intensity_B);
+    // Substitui os bits do componente azul no registrador R2
+    field_store_blue(base_address, intensity);
+    STATS_TIMER_STOP(timer, set_intensity_B);
+    //printf("Valor do registrador R1 após definir a intensidade do componente azul: %hu\n", value);
+}
+
+void set_led_status(char* base_address, int status) {
+    // Verifica se o status é válido (0 ou 1)
+    if (status != 0 && status != 1) {
+        STATS_REJECT(led_status);
+        fprintf(stderr, "Erro: Status do LED inválido. Deve ser 0 (desligado) ou 1 (ligado).\n");
+        return;
+    }
+
+    STATS_TIMER_START(timer, set_led_status);
+    // Substitui o bit correspondente ao status do LED (bit 9) no registrador de controle
+    field_store_led_status(base_address, status);
+    STATS_TIMER_STOP(timer, set_led_status);
+
+    //printf("Status do LED atualizado para: %d\n", status);
+}
+
+void set_battery_level(char* base_address, int level) {
+    // Verifica se o nível de bateria é válido (0 a 3)
+    if (level < 0 || level > 3) {
+        STATS_REJECT(battery_level);
+        fprintf(stderr, "Erro: Nível de bateria inválido. Deve estar entre 0 e 3.\n");
+        return;
+    }
+
+    STATS_TIMER_START(timer, set_battery_level);
+    // Substitui os bits correspondentes ao nível de bateria (bits 0 e 1) no registrador R3
+    field_store_battery_level(base_address, level);
+    STATS_TIMER_STOP(timer, set_battery_level);
+}
+
+// CODIFICAÇÃO DO TEXTO
+// O campo text_encoding de R0 diz como a mensagem ocupa R4-R15:
+//   ASCII   um caractere por registrador (byte baixo), 12 caracteres
+//   PACKED  dois caracteres de 8 bits por registrador (o primeiro no byte
+//           baixo), 24 caracteres
+//   GLYPH   glifos de 6 bits da tabela text_glyphs (maiúsculas, dígitos e
+//           pontuação; minúsculas viram maiúsculas e o resto vira '?'), dez
+//           a cada 4 registradores, 30 caracteres
+// R4-R15 são três palavras alinhadas de 64 bits (R4-R7, R8-R11, R12-R15).
+// A mensagem é montada nessas palavras fora da seção de escrita e gravada
+// com três stores de 64 bits; a leitura decodifica as mesmas palavras.
+// O valor 3 é reservado e lido como ASCII.
+#define TEXT_ENCODING_ASCII  0
+#define TEXT_ENCODING_PACKED 1
+#define TEXT_ENCODING_GLYPH  2
+#define TEXT_WORDS (TEXT_REGISTERS / 4) // Palavras de 64 bits em R4-R15
+#define TEXT_CAPACITY_MAX 30
+#define TEXT_GLYPH_UNKNOWN 42 // Código de '?', usado para caracteres sem glifo
+
+const int text_capacity[4] = {TEXT_REGISTERS, TEXT_REGISTERS * 2, TEXT_WORDS * 10, TEXT_REGISTERS};
+const char *text_encoding_names[4] = {"ascii", "packed", "glyph", "ascii"};
+
+static const char text_glyphs[] = " ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789.,:;!?-+*/=<>()[]'\"#%&_@$^~";
+
+// Código de cada caractere mais 1 (0 = sem glifo)
+static const unsigned char text_glyph_codes[256] = {
+    [' '] = 1, ['A'] = 2, ['B'] = 3, ['C'] = 4, ['D'] = 5, ['E'] = 6, ['F'] = 7, ['G'] = 8, ['H'] = 9, ['I'] = 10,
+    ['J'] = 11, ['K'] = 12, ['L'] = 13, ['M'] = 14, ['N'] = 15, ['O'] = 16, ['P'] = 17, ['Q'] = 18, ['R'] = 19, ['S'] = 20,
+    ['T'] = 21, ['U'] = 22, ['V'] = 23, ['W'] = 24, ['X'] = 25, ['Y'] = 26, ['Z'] = 27, ['0'] = 28, ['1'] = 29, ['2'] = 30,
+    ['3'] = 31, ['4'] = 32, ['5'] = 33, ['6'] = 34, ['7'] = 35, ['8'] = 36, ['9'] = 37, ['.'] = 38, [','] = 39, [':'] = 40,
+    [';'] = 41, ['!'] = 42, ['?'] = 43, ['-'] = 44, ['+'] = 45, ['*'] = 46, ['/'] = 47, ['='] = 48, ['<'] = 49, ['>'] = 50,
+    ['('] = 51, [')'] = 52, ['['] = 53, [']'] = 54, ['\''] = 55, ['"'] = 56, ['#'] = 57, ['%'] = 58, ['&'] = 59, ['_'] = 60,
+    ['@'] = 61, ['$'] = 62, ['^'] = 63, ['~'] = 64, ['a'] = 2, ['b'] = 3, ['c'] = 4, ['d'] = 5, ['e'] = 6, ['f'] = 7,
+    ['g'] = 8, ['h'] = 9, ['i'] = 10, ['j'] = 11, ['k'] = 12, ['l'] = 13, ['m'] = 14, ['n'] = 15, ['o'] = 16, ['p'] = 17,
+    ['q'] = 18, ['r'] = 19, ['s'] = 20, ['t'] = 21, ['u'] = 22, ['v'] = 23, ['w'] = 24, ['x'] = 25, ['y'] = 26, ['z'] = 27,
+};
+
+// Monta a mensagem (completada com espaços) nas palavras de R4-R15
+void text_encode(const char *message, int encoding, unsigned long long *words) {
+    char padded[TEXT_CAPACITY_MAX];
+    int capacity = text_capacity[encoding & 3];
+    int length = strnlen(message, capacity);
+    memcpy(padded, message, length);
+    memset(padded + length, ' ', capacity - length);
+
+    for (int w = 0; w < TEXT_WORDS; w++) {
+        unsigned long long word = 0;
+        if (encoding == TEXT_ENCODING_PACKED) {
+            for (int k = 0; k < 8; k++) {
+                word |= (unsigned long long)(unsigned char)padded[w * 8 + k] << (8 * k);
+            }
+        } else if (encoding == TEXT_ENCODING_GLYPH) {
+            for (int k = 0; k < 10; k++) {
+                unsigned int code = text_glyph_codes[(unsigned char)padded[w * 10 + k]];
+                word |= (unsigned long long)(code ? code - 1 : TEXT_GLYPH_UNKNOWN) << (6 * k);
+            }
+        } else {
+            for (int k = 0; k < 4; k++) {
+                word |= (unsigned long long)(unsigned char)padded[w * 4 + k] << (16 * k);
+            }
+        }
+        words[w] = word;
+    }
+}
+
+// Decodifica R4-R15 (regs é a cópia de R0-R15) em out, com capacidade + 1
+// bytes. Retorna a capacidade da codificação em uso.
+int text_decode(const unsigned short *regs, char *out) {
+    int encoding = field_get_text_encoding(regs);
+    int capacity = text_capacity[encoding];
+    for (int w = 0; w < TEXT_WORDS; w++) {
+        const unsigned short *group = &regs[4 + w * 4];
+        unsigned long long word = group[0] | (unsigned long long)group[1] << 16 |
+                                  (unsigned long long)group[2] << 32 | (unsigned long long)group[3] << 48;
+        if (encoding == TEXT_ENCODING_PACKED) {
+            for (int k = 0; k < 8; k++) {
+                out[w * 8 + k] = (char)(word >> (8 * k));
+            }
+        } else if (encoding == TEXT_ENCODING_GLYPH) {
+            for (int k = 0; k < 10; k++) {
+                out[w * 10 + k] = text_glyphs[(word >> (6 * k)) & 0x3F];
+            }
+        } else {
+            for (int k = 0; k < 4; k++) {
+                out[w * 4 + k] = (char)(word >> (16 * k));
+            }
+        }
+    }
+    out[capacity] = '\0';
+    return capacity;
+}
+
+// Grava as palavras em R4-R15 (dentro de uma seção de escrita), um store de
+// 64 bits por palavra alterada
+static void text_store_words(char *base_address, const unsigned long long *words) {
+    for (int w = 0; w < TEXT_WORDS; w++) {
+        unsigned long long *word = (unsigned long long *)REG_PTR(base_address, 4 + w * 4);
+        unsigned long long previous = __atomic_load_n(word, __ATOMIC_RELAXED);
+        if (previous != words[w]) {
+            __atomic_store_n(word, words[w], __ATOMIC_RELAXED);
+            for (int k = 0; k < 4; k++) {
+                unsigned short before = (unsigned short)(previous >> (16 * k));
+                unsigned short after = (unsigned short)(words[w] >> (16 * k));
+                if (before != after) {
+                    registers_after_write(base_address, 4 + w * 4 + k, before, after);
+                }
+            }
+        }
+        for (int k = 0; k < 4; k++) {
+            STATS_COUNT_FIELD(FIELD_text_0_INDEX + w * 4 + k);
+        }
+    }
+}
+
+static inline int text_encoding_of(char *base_address) {
+    return (__atomic_load_n(REG_PTR(base_address, FIELD_text_encoding_REG), __ATOMIC_RELAXED) &
+            FIELD_text_encoding_MASK) >> FIELD_text_encoding_SHIFT;
+}
+
+// Interpreta "ascii", "packed", "glyph" ou o número da codificação; -1 se inválida
+int text_encoding_parse(const char *text) {
+    char name[16];
+    if (sscanf(text, "%15s", name) != 1) {
+        return -1;
+    }
+    for (int encoding = TEXT_ENCODING_ASCII; encoding <= TEXT_ENCODING_GLYPH; encoding++) {
+        if (strcmp(name, text_encoding_names[encoding]) == 0 || (name[0] == '0' + encoding && name[1] == '\0')) {
+            return encoding;
+        }
+    }
+    return -1;
+}
+
+// Escreve a mensagem nos registradores de dados (R4 a R15) na codificação
+// atual, completando com espaços
+void write_message_registers(char* base_address, const char* message) {
+    unsigned long long words[TEXT_WORDS];
+    STATS_TIMER_START(timer, write_message_registers);
+
+    // Monta a janela fora da seção de escrita
+    int encoding = text_encoding_of(base_address);
+    text_encode(message, encoding, words);
+
+    seq_write_begin(base_address);
+    if (text_encoding_of(base_address) != encoding) {
+        // A codificação mudou entre a montagem e a seção de escrita
+        encoding = text_encoding_of(base_address);
+        text_encode(message, encoding, words);
+    }
+    text_store_words(base_address, words);
+    seq_write_end(base_address);
+    STATS_TIMER_STOP(timer, write_message_registers);
+}
+
+// Troca a codificação do texto, recodificando a mensagem atual na mesma
+// seção de escrita (mensagens maiores que a nova capacidade são cortadas)
+int set_text_encoding(char* base_address, int encoding) {
+    if (encoding < TEXT_ENCODING_ASCII || encoding > TEXT_ENCODING_GLYPH) {
+        STATS_REJECT(text_encoding);
+        fprintf(stderr, "Erro: Codificação de texto inválida. Deve ser 0 (ascii), 1 (packed) ou 2 (glyph).\n");
+        return -1;
+    }
+    unsigned short regs[REGISTER_COUNT];
+    unsigned long long words[TEXT_WORDS];
+    char message[TEXT_CAPACITY_MAX + 1];
+    STATS_TIMER_START(timer, set_text_encoding);
+
+    seq_write_begin(base_address);
+    for (int reg = 0; reg < REGISTER_COUNT; reg++) {
+        regs[reg] = __atomic_load_n(REG_PTR(base_address, reg), __ATOMIC_RELAXED);
+    }
+    text_decode(regs, message);
+    text_encode(message, encoding, words);
+    unsigned short previous;
+    unsigned short updated = reg_locked_update_old(REG_PTR(base_address, FIELD_text_encoding_REG), FIELD_text_encoding_MASK,
+                                                   encoding << FIELD_text_encoding_SHIFT, &previous);
+    if (updated != previous) {
+        registers_after_write(base_address, FIELD_text_encoding_REG, previous, updated);
+    }
+    STATS_COUNT_FIELD(FIELD_text_encoding_INDEX);
+    text_store_words(base_address, words);
+    seq_write_end(base_address);
+    STATS_TIMER_STOP(timer, set_text_encoding);
+    return 0;
+}
+
+void print_message_with_color_and_rgb(const char* message, char* base_address) {
+    // Verifica o status do LED (bit 9)
+    unsigned short control_register_value = *((unsigned short *)(base_address + (2 * sizeof(unsigned short))));
+    int led_status = (control_register_value >> 9) & 0x01;
+
+    // Se o LED estiver desligado, não imprime a mensagem
+    if (led_status == 0) {
+        printf("Led está desligado!");
+        return;
+    }
+
+    // Mapeia a mensagem nos registradores de dados (R4 a R15)
+    write_message_registers(base_address, message);
+
+    // Lê cor e mensagem de um mesmo estado consistente dos registradores
+    RegisterSnapshot snapshot;
+    registers_snapshot(base_address, &snapshot);
+
+    // Cor de cada componente ligado, convertida das intensidades de R1/R2
+    // (intensidade do LED) para valores do terminal pelas tabelas de cor
+    unsigned int red, green, blue;
+    color_decode_fields(snapshot.regs[1] | ((unsigned int)snapshot.regs[2] << 16), &red, &green, &blue, COLOR_GAMMA);
+    char escape[COLOR_ESCAPE_MAX];
+    color_escape(escape, field_get_red_on(snapshot.regs) ? red : 0, field_get_green_on(snapshot.regs) ? green : 0,
+                 field_get_blue_on(snapshot.regs) ? blue : 0);
+
+    // Imprime a mensagem da cópia consistente, sem os espaços de preenchimento
+    char text[TEXT_CAPACITY_MAX + 1];
+    int visible = text_decode(snapshot.regs, text);
+    while (visible > 0 && text[visible - 1] == ' ') {
+        visible--;
+    }
+    fputs(escape, stdout);
+    fwrite(text, 1, visible, stdout);
+    printf("\x1b[0m\n");
+}
+
+// Função para configurar a mensagem no display de LED (R4 a R15). Mensagens
+// mais longas que a capacidade da codificação (12, 24 ou 30 caracteres)
+// mostram a primeira janela; para rolar o texto inteiro use
+// text_stream_open/text_stream_step.
+void configure_text_display(char* base_address, const char* message) {
+    STATS_TIMER_START(timer, configure_text_display);
+    write_message_registers(base_address, message);
+    STATS_TIMER_STOP(timer, configure_text_display);
+}
+
+
+// TEXTO EM ROLAGEM
+// Mensagens de qualquer tamanho passam pelo display como uma janela de
+// TEXT_REGISTERS caracteres que anda uma posição por quadro. Há duas páginas
+// no formato de R4-R15: o escritor monta o quadro seguinte na página
+// escondida com uma única cópia e então publica o novo número de quadro.
+// O leitor lê o quadro, copia a página visível e confere se o quadro não
+// mudou, então nunca vê uma janela pela metade.
+
+typedef struct {
+    char *base_address;
+    unsigned short *cells;  // Mensagem, espaços de separação e o início repetido
+    int cycle;              // Posições até a janela voltar ao início
+    int position;
+    unsigned int frame;
+} TextStream;
+
+// Prepara a mensagem para a rolagem: cada janela é um trecho contíguo de cells
+int text_stream_open(TextStream *stream, char *base_address, const char *message) {
+    int length = strlen(message);
+    stream->cycle = length + TEXT_REGISTERS;
+    stream->cells = malloc((stream->cycle + TEXT_REGISTERS) * sizeof(unsigned short));
+    if (stream->cells == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < stream->cycle + TEXT_REGISTERS; i++) {
+        int k = i % stream->cycle;
+        stream->cells[i] = k < length ? (unsigned char)message[k] : ' ';
+    }
+    stream->base_address = base_address;
+    stream->position = 0;
+    stream->frame = __atomic_load_n(TEXT_FRAME_PTR(base_address), __ATOMIC_ACQUIRE);
+    return 0;
+}
+
+void text_stream_close(TextStream *stream) {
+    free(stream->cells);
+    stream->cells = NULL;
+}
+
+// Publica o próximo quadro: uma cópia para a página escondida e a troca de
+// página. Só um escritor de texto por arquivo de registros.
+void text_stream_step(TextStream *stream) {
+    unsigned short *page = TEXT_PAGE_PTR(stream->base_address, (stream->frame + 1) & 1);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // A página só muda depois da publicação do quadro anterior
+    memcpy(page, &stream->cells[stream->position], TEXT_REGISTERS * sizeof(unsigned short));
+    stream->frame++;
+    __atomic_store_n(TEXT_FRAME_PTR(stream->base_address), stream->frame, __ATOMIC_RELEASE);
+    dirty_mark_range((char *)page, TEXT_REGISTERS * sizeof(unsigned short));
+    registers_notify(stream->base_address);
+
+    stream->position++;
+    if (stream->position == stream->cycle) {
+        stream->position = 0;
+    }
+}
+
+// Copia a página visível de forma consistente e retorna o número do quadro
+unsigned int text_page_read(char *base_address, unsigned short *window) {
+    unsigned int *frame = TEXT_FRAME_PTR(base_address);
+    for (;;) {
+        unsigned int before = __atomic_load_n(frame, __ATOMIC_ACQUIRE);
+        memcpy(window, TEXT_PAGE_PTR(base_address, before & 1), TEXT_REGISTERS * sizeof(unsigned short));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(frame, __ATOMIC_RELAXED) == before) {
+            return before;
+        }
+        cpu_relax();
+    }
+}
+
+// Função para exibir o menu de ajuste de intensidade
+void exibir_menu_intensidade(char componente) {
+    printf("\nAjuste a intensidade do componente %c (0-255), ou digite 0 para voltar ao menu principal: ", componente);
+}
+
+// Função para imprimir as intensidades de cada componente
+void print_component_intensities(char* base_address) {
+    // Lê o valor atual do registrador R1 (componentes R e G)
+    unsigned short r1_value = *((unsigned short *)(base_address + (1 * sizeof(unsigned short))));
+
+    // Lê o valor atual do registrador R2 (componente B)
+    unsigned short r2_value = *((unsigned short *)(base_address + (2 * sizeof(unsigned short))));
+
+    unsigned short regs[3] = {0, r1_value, r2_value};
+
+    // Extrai a intensidade do componente vermelho (5 bits, expandidos para 0-255)
+    int red = field_get_red(regs);
+    int intensity_R = (red << 3) | (red >> 2);
+
+    // Extrai a intensidade do componente verde (6 bits, expandidos para 0-255)
+    int green = field_get_green(regs);
+    int intensity_G = (green << 2) | (green >> 4);
+
+    // Extrai a intensidade do componente azul
+    int intensity_B = field_get_blue(regs);
+
+    // Imprime as intensidades de cada componente
+    printf("Intensidade do componente vermelho: %d\n", intensity_R);
+    printf("Intensidade do componente verde: %d\n", intensity_G);
+    printf("Intensidade do componente azul: %d\n", intensity_B);
+}
+
+// Função para exibir o sensor na tela com base no nível de bateria
+// AGREGADOS DOS SENSORES
+// A simulação de sensores (abaixo) publica no arquivo, para cada sensor e
+// janela deslizante, mínimo, máximo, média e percentis das amostras em
+// resolução completa. Os mostradores leem esses agregados; sem simulação
+// ativa (janela vazia) continuam usando os bits de R3.
+#define SENSOR_TEMPERATURE 0
+#define SENSOR_BATTERY 1     // Carga em décimos de porcento (0-1000)
+#define SENSOR_COUNT 2
+#define SENSOR_WINDOWS 3
+
+const int sensor_window_seconds[SENSOR_WINDOWS] = {1, 10, 60};
+
+typedef struct {
+    unsigned short count;   // Amostras na janela
+    unsigned short min;
+    unsigned short max;
+    unsigned short mean_x10; // Média multiplicada por 10
+    unsigned short p50;
+    unsigned short p95;
+    unsigned short p99;
+} SensorAggregate;
+
+typedef struct {
+    SensorAggregate windows[SENSOR_COUNT][SENSOR_WINDOWS];
+} SensorAggregates;
+
+_Static_assert(SENSOR_AGGREGATE_OFFSET + sizeof(SensorAggregates) <= SENSOR_RING_OFFSET,
+               "agregados dos sensores invadem o anel de amostras");
+_Static_assert(SENSOR_RING_OFFSET + SENSOR_RING_SAMPLES * sizeof(unsigned int) <= 0x300,
+               "anel de amostras invade a área livre");
+
+#define SENSOR_AGGREGATES_PTR(base) ((SensorAggregates *)((base) + SENSOR_AGGREGATE_OFFSET))
+
+// Copia os agregados de forma consistente (seqlock próprio dos agregados)
+void sensor_aggregates_read(char *base_address, SensorAggregates *out) {
+    unsigned int *seq = (unsigned int *)(base_address + SENSOR_AGGREGATE_SEQ_OFFSET);
+    for (;;) {
+        unsigned int before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        if ((before & 1) == 0) {
+            memcpy(out, SENSOR_AGGREGATES_PTR(base_address), sizeof(*out));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(seq, __ATOMIC_RELAXED) == before) {
+                return;
+            }
+        }
+        cpu_relax();
+    }
+}
+
+void display_battery_sensor(char* base_address) {
+    // Lê o valor atual do registrador R3
+    unsigned short register_value = *((unsigned short *)(base_address + (3 * sizeof(unsigned short))));
+
+    // Obtém os dois primeiros bits do valor do registrador R3 (bits 0 e 1)
+    int battery_level = (register_value & FIELD_battery_level_MASK) >> FIELD_battery_level_SHIFT;
+
+    // Com a simulação ativa, o nível vem da média de carga da janela de 1 s
+    SensorAggregates aggregates;
+    sensor_aggregates_read(base_address, &aggregates);
+    const SensorAggregate *charge = &aggregates.windows[SENSOR_BATTERY][0];
+    if (charge->count > 0) {
+        battery_level = charge->mean_x10 * 4 / 10001;
+    }
+
+    printf("Sensor de bateria: ");
+
+    // Determine a cor do sensor com base no nível de bateria
+    switch (battery_level) {
+        case 0:
+            printf("\033[0;31mCRÍTICO"); // Vermelho
+            break;
+        case 1:
+            printf("\033[0;33mBAIXO"); // Amarelo
+            break;
+        default:
+            printf("\033[0;32mNORMAL/ALTO"); // Verde
+            break;
+    }
+
+    printf("\033[0m\n"); // Restaura a cor padrão do terminal
+
+    if (charge->count > 0) {
+        for (int w = 0; w < SENSOR_WINDOWS; w++) {
+            const SensorAggregate *window = &aggregates.windows[SENSOR_BATTERY][w];
+            printf("  carga %2d s: média %5.1f%%  mín %5.1f%%  máx %5.1f%%  p50 %5.1f%%  (%d amostras)\n",
+                   sensor_window_seconds[w], window->mean_x10 / 100.0, window->min / 10.0, window->max / 10.0,
+                   window->p50 / 10.0, window->count);
+        }
+    }
+}
+
+// Mostrador de temperatura: agregados das janelas deslizantes em resolução
+// completa, ou o valor de R3 (multiplicado por 10) sem simulação ativa
+void display_temperature_sensor(char* base_address) {
+    SensorAggregates aggregates;
+    sensor_aggregates_read(base_address, &aggregates);
+    if (aggregates.windows[SENSOR_TEMPERATURE][0].count == 0) {
+        RegisterSnapshot snapshot;
+        registers_snapshot(base_address, &snapshot);
+        printf("Sensor de temperatura: %d\n", field_get_temperature(snapshot.regs) * 10);
+        return;
+    }
+
+    printf("Sensor de temperatura:\n");
+    for (int w = 0; w < SENSOR_WINDOWS; w++) {
+        const SensorAggregate *window = &aggregates.windows[SENSOR_TEMPERATURE][w];
+        printf("  %2d s: média %6.1f  mín %4d  máx %4d  p50 %4d  p95 %4d  p99 %4d  (%d amostras)\n",
+               sensor_window_seconds[w], window->mean_x10 / 10.0, window->min, window->max,
+               window->p50, window->p95, window->p99, window->count);
+    }
+}
+
+
+// Função para definir a temperatura do LED nos bits do 6 ao 15 do registrador R3
+void set_led_temperature(char* base_address, int temperature) {
+    // Garante que a temperatura esteja dentro do intervalo válido (0-1023)
+    if (temperature < 0 || temperature > 1023) {
+        STATS_REJECT(temperature);
+        fprintf(stderr, "Erro: Temperatura do LED fora do intervalo válido (0-1023)\n");
+        return;
+    }
+
+    STATS_TIMER_START(timer, set_led_temperature);
+    // Define a temperatura do LED nos bits do 6 ao 15 do registrador R3 (dividida por 10)
+    unsigned short previous_value;
+    unsigned short register_value = reg_atomic_update_old(base_address, FIELD_temperature_REG, FIELD_temperature_MASK,
+                                                          (temperature / 10) << FIELD_temperature_SHIFT, &previous_value);
+    STATS_COUNT_FIELD(FIELD_temperature_INDEX);
+    STATS_TIMER_STOP(timer, set_led_temperature);
+
+    if (registers_verbose) {
+        printf("Valor armazenado nos bits do 6 ao 15 antes da escrita: %d\n", previous_value);
+
+        printf("Valor armazenado nos bits do 6 ao 15 após a escrita: %d\n", register_value);
+
+        printf("Temperatura do LED definida como: %d\n", temperature);
+    }
+}
+
+// SIMULAÇÃO DE SENSORES
+// Uma thread gera amostras de temperatura (0-1023, sem a divisão por 10 de
+// R3) e de carga da bateria (décimos de porcento) na taxa pedida, grava
+// cada amostra no anel do arquivo e mantém janelas deslizantes de 1, 10 e
+// 60 s. Cada janela é atualizada incrementalmente a cada amostra:
+//   mínimo e máximo  filas monotônicas (O(1) amortizado)
+//   média            soma corrente
+//   percentis        árvore de Fenwick sobre os valores (O(log 1024))
+// A cada milissegundo os agregados são publicados no arquivo, e R3 só é
+// reescrito quando o valor reduzido (temperatura / 10, nível 0-3) muda.
+#define SENSOR_VALUE_DOMAIN 1024
+#define SENSOR_TICK_NS 1000000L
+
+typedef struct {
+    int capacity;
+    int count;
+    long next_index;          // Índice absoluto da próxima amostra
+    unsigned short *values;   // Amostra i em values[i % capacity]
+    long sum;
+    long *min_queue;          // Índices com valores crescentes
+    long *max_queue;          // Índices com valores decrescentes
+    long min_front, min_back;
+    long max_front, max_back;
+    int fenwick[SENSOR_VALUE_DOMAIN + 1];
+} SlidingWindow;
+
+int window_init(SlidingWindow *window, int capacity) {
+    memset(window, 0, sizeof(*window));
+    window->capacity = capacity;
+    window->values = malloc(capacity * sizeof(unsigned short));
+    window->min_queue = malloc(capacity * sizeof(long));
+    window->max_queue = malloc(capacity * sizeof(long));
+    if (window->values == NULL || window->min_queue == NULL || window->max_queue == NULL) {
+        free(window->values);
+        free(window->min_queue);
+        free(window->max_queue);
+        return -1;
+    }
+    return 0;
+}
+
+void window_free(SlidingWindow *window) {
+    free(window->values);
+    free(window->min_queue);
+    free(window->max_queue);
+}
+
+static inline void window_fenwick_add(SlidingWindow *window, int value, int delta) {
+    for (int i = value + 1; i <= SENSOR_VALUE_DOMAIN; i += i & -i) {
+        window->fenwick[i] += delta;
+    }
+}
+
+#define WINDOW_AT(window, index) ((window)->values[(index) % (window)->capacity])
+
+// Acrescenta uma amostra, descartando a mais antiga se a janela estiver cheia
+void window_push(SlidingWindow *window, unsigned short value) {
+    long index = window->next_index++;
+    if (window->count == window->capacity) {
+        long oldest = index - window->capacity;
+        unsigned short evicted = WINDOW_AT(window, oldest);
+        window->sum -= evicted;
+        window_fenwick_add(window, evicted, -1);
+        if (window->min_queue[window->min_front % window->capacity] == oldest) {
+            window->min_front++;
+        }
+        if (window->max_queue[window->max_front % window->capacity] == oldest) {
+            window->max_front++;
+        }
+        window->count--;
+    }
+
+    WINDOW_AT(window, index) = value;
+    window->sum += value;
+    window_fenwick_add(window, value, 1);
+    window->count++;
+
+    while (window->min_back > window->min_front &&
+           WINDOW_AT(window, window->min_queue[(window->min_back - 1) % window->capacity]) >= value) {
+        window->min_back--;
+    }
+    window->min_queue[window->min_back++ % window->capacity] = index;
+    while (window->max_back > window->max_front &&
+           WINDOW_AT(window, window->max_queue[(window->max_back - 1) % window->capacity]) <= value) {
+        window->max_back--;
+    }
+    window->max_queue[window->max_back++ % window->capacity] = index;
+}
+
+static inline unsigned short window_min(const SlidingWindow *window) {
+    return WINDOW_AT(window, window->min_queue[window->min_front % window->capacity]);
+}
+
+static inline unsigned short window_max(const SlidingWindow *window) {
+    return WINDOW_AT(window, window->max_queue[window->max_front % window->capacity]);
+}
+
+// Percentil por posição (nearest rank): menor valor com pelo menos p% das amostras até ele
+unsigned short window_percentile(const SlidingWindow *window, double p) {
+    int rank = (int)ceil(p * window->count / 100.0);
+    if (rank < 1) {
+        rank = 1;
+    }
+    int position = 0;
+    for (int step = SENSOR_VALUE_DOMAIN; step > 0; step >>= 1) {
+        if (position + step <= SENSOR_VALUE_DOMAIN && window->fenwick[position + step] < rank) {
+            position += step;
+            rank -= window->fenwick[position];
+        }
+    }
+    return (unsigned short)position;
+}
+
+void window_aggregate(const SlidingWindow *window, SensorAggregate *out) {
+    memset(out, 0, sizeof(*out));
+    if (window->count == 0) {
+        return;
+    }
+    out->count = window->count > 65535 ? 65535 : window->count;
+    out->min = window_min(window);
+    out->max = window_max(window);
+    out->mean_x10 = (unsigned short)((window->sum * 10 + window->count / 2) / window->count);
+    out->p50 = window_percentile(window, 50);
+    out->p95 = window_percentile(window, 95);
+    out->p99 = window_percentile(window, 99);
+}
+
+typedef struct {
+    char *base_address;
+    int rate_hz;
+    int running;
+    pthread_t thread;
+    SlidingWindow windows[SENSOR_COUNT][SENSOR_WINDOWS];
+    double temperature;
+    double charge;
+    unsigned int seed;
+    long samples;
+    long aggregate_ns;     // Tempo gasto atualizando as janelas
+    int written_temperature;
+    int written_level;
+} SensorSimulation;
+
+// Número pseudoaleatório em [-1, 1)
+static inline double sensor_noise(SensorSimulation *sim) {
+    sim->seed ^= sim->seed << 13;
+    sim->seed ^= sim->seed >> 17;
+    sim->seed ^= sim->seed << 5;
+    return (sim->seed & 0xFFFF) / 32768.0 - 1.0;
+}
+
+// Gera e registra uma amostra
+static void sensor_sample(SensorSimulation *sim, long now_ns) {
+    double target = 400.0 + 150.0 * sin(now_ns / 1e9 * 2 * M_PI / 10.0);
+    sim->temperature += (target - sim->temperature) * 0.01 + sensor_noise(sim) * 4.0;
+    if (sim->temperature < 0) {
+        sim->temperature = 0;
+    } else if (sim->temperature > SENSOR_VALUE_DOMAIN - 1) {
+        sim->temperature = SENSOR_VALUE_DOMAIN - 1;
+    }
+    sim->charge -= 10000.0 / (100.0 * sim->rate_hz) * 0.1; // Descarga completa em ~100 s
+    if (sim->charge < 0) {
+        sim->charge = 1000; // Recarga
+    }
+    unsigned short temperature = (unsigned short)lround(sim->temperature);
+    double noisy_charge = sim->charge + sensor_noise(sim) * 3.0;
+    unsigned short charge = (unsigned short)(noisy_charge < 0 ? 0 : noisy_charge > 1000 ? 1000 : lround(noisy_charge));
+
+    // Anel no arquivo: uma palavra de 32 bits por amostra
+    unsigned int *head = (unsigned int *)(sim->base_address + SENSOR_HEAD_OFFSET);
+    unsigned int *ring = (unsigned int *)(sim->base_address + SENSOR_RING_OFFSET);
+    unsigned int position = __atomic_load_n(head, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring[position % SENSOR_RING_SAMPLES], temperature | ((unsigned int)charge << 16), __ATOMIC_RELAXED);
+    __atomic_store_n(head, position + 1, __ATOMIC_RELEASE);
+
+    long started = monotonic_ns();
+    for (int w = 0; w < SENSOR_WINDOWS; w++) {
+        window_push(&sim->windows[SENSOR_TEMPERATURE][w], temperature);
+        window_push(&sim->windows[SENSOR_BATTERY][w], charge);
+    }
+    sim->aggregate_ns += monotonic_ns() - started;
+    sim->samples++;
+}
+
+// Publica os agregados e atualiza R3 se o valor reduzido mudou
+static void sensor_publish(SensorSimulation *sim) {
+    SensorAggregates aggregates;
+    for (int sensor = 0; sensor < SENSOR_COUNT; sensor++) {
+        for (int w = 0; w < SENSOR_WINDOWS; w++) {
+            window_aggregate(&sim->windows[sensor][w], &aggregates.windows[sensor][w]);
+        }
+    }
+    unsigned int *seq = (unsigned int *)(sim->base_address + SENSOR_AGGREGATE_SEQ_OFFSET);
+    __atomic_fetch_add(seq, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(SENSOR_AGGREGATES_PTR(sim->base_address), &aggregates, sizeof(aggregates));
+    __atomic_fetch_add(seq, 1, __ATOMIC_RELEASE);
+    dirty_mark_range(sim->base_address + SENSOR_HEAD_OFFSET, SENSOR_RING_OFFSET + SENSOR_RING_SAMPLES * sizeof(unsigned int) - SENSOR_HEAD_OFFSET);
+
+    int temperature = (int)lround(sim->temperature);
+    int level = aggregates.windows[SENSOR_BATTERY][0].mean_x10 * 4 / 10001;
+    if (temperature / 10 != sim->written_temperature / 10) {
+        set_led_temperature(sim->base_address, temperature);
+        sim->written_temperature = temperature;
+    }
+    if (level != sim->written_level) {
+        set_battery_level(sim->base_address, level);
+        sim->written_level = level;
+    }
+}
+
+void *sensor_simulation_thread(void *arg) {
+    SensorSimulation *sim = (SensorSimulation *)arg;
+    long tick_ns = 1000000000L / sim->rate_hz > SENSOR_TICK_NS ? 1000000000L / sim->rate_hz : SENSOR_TICK_NS;
+    long deadline = monotonic_ns();
+    long due_samples = 0;
+    long started = deadline;
+
+    prctl(PR_SET_TIMERSLACK, 1UL);
+    while (__atomic_load_n(&sim->running, __ATOMIC_ACQUIRE)) {
+        deadline += tick_ns;
+        struct timespec wake = {deadline / 1000000000L, deadline % 1000000000L};
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+
+        // Gera as amostras devidas até agora, mantendo a taxa média
+        long now = monotonic_ns();
+        long target = (long)((now - started) / 1e9 * sim->rate_hz);
+        while (due_samples < target) {
+            sensor_sample(sim, now);
+            due_samples++;
+        }
+        sensor_publish(sim);
+    }
+    return NULL;
+}
+
+int sensor_simulation_start(SensorSimulation *sim, char *base_address, int rate_hz) {
+    memset(sim, 0, sizeof(*sim));
+    sim->base_address = base_address;
+    sim->rate_hz = rate_hz;
+    sim->temperature = 400;
+    sim->charge = 1000;
+    sim->seed = 0x9E3779B9u;
+    sim->written_temperature = -10;
+    sim->written_level = -1;
+    for (int sensor = 0; sensor < SENSOR_COUNT; sensor++) {
+        for (int w = 0; w < SENSOR_WINDOWS; w++) {
+            if (window_init(&sim->windows[sensor][w], sensor_window_seconds[w] * rate_hz) == -1) {
+                return -1;
+            }
+        }
+    }
+    sim->running = 1;
+    return pthread_create(&sim->thread, NULL, sensor_simulation_thread, sim) == 0 ? 0 : -1;
+}
+
+// Para a simulação e zera os agregados publicados (os mostradores voltam a usar R3)
+void sensor_simulation_stop(SensorSimulation *sim, int keep_windows) {
+    __atomic_store_n(&sim->running, 0, __ATOMIC_RELEASE);
+    pthread_join(sim->thread, NULL);
+
+    unsigned int *seq = (unsigned int *)(sim->base_address + SENSOR_AGGREGATE_SEQ_OFFSET);
+    __atomic_fetch_add(seq, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memset(SENSOR_AGGREGATES_PTR(sim->base_address), 0, sizeof(SensorAggregates));
+    __atomic_fetch_add(seq, 1, __ATOMIC_RELEASE);
+
+    if (!keep_windows) {
+        for (int sensor = 0; sensor < SENSOR_COUNT; sensor++) {
+            for (int w = 0; w < SENSOR_WINDOWS; w++) {
+                window_free(&sim->windows[sensor][w]);
+            }
+        }
+    }
+}
+
+// TRANSAÇÕES DE REGISTRADORES
+// Uma transação copia o banco R0-R15 para uma cópia sombra, acumula as
+// alterações de campos e só no commit escreve no arquivo mapeado, com um
+// store de 64 bits por grupo de 4 registradores alterados.
+
+typedef struct {
+    char *base_address;
+    unsigned short shadow[REGISTER_COUNT];      // Cópia sombra dos registradores
+    unsigned short staged_mask[REGISTER_COUNT]; // Bits alterados em cada registrador
+    unsigned int dirty;                          // Bit n ligado = Rn alterado
+} RegisterTransaction;
+
+typedef struct {
+    int registers_written; // Registradores com algum campo alterado
+    int stores;            // Stores de 64 bits realizados
+    int bytes_touched;     // Bytes efetivamente escritos na memória mapeada
+    int cache_lines;       // Linhas de cache distintas tocadas
+} RegisterCommitStats;
+
+// Inicia uma transação lendo o banco de registradores de uma só vez
+void tx_begin(RegisterTransaction *tx, char *base_address) {
+    tx->base_address = base_address;
+    memcpy(tx->shadow, base_address, sizeof(tx->shadow));
+    memset(tx->staged_mask, 0, sizeof(tx->staged_mask));
+    tx->dirty = 0;
+}
+
+// Prepara a escrita de um campo (value já deslocado para a posição do campo)
+void tx_stage(RegisterTransaction *tx, int reg, unsigned short mask, unsigned short value) {
+    tx->shadow[reg] = (tx->shadow[reg] & ~mask) | (value & mask);
+    tx->staged_mask[reg] |= mask;
+    tx->dirty |= 1u << reg;
+}
+
+// Preparação de cada campo do mapa de registradores: tx_put_<nome>
+#define DEFINE_FIELD_STAGE(arg, name, reg, offset, width) \
+    static inline void tx_put_##name(RegisterTransaction *tx, unsigned short value) { \
+        STATS_COUNT_FIELD(FIELD_##name##_INDEX); \
+        tx_stage(tx, reg, FIELD_BITS(offset, width), value << (offset)); \
+    }
+REGISTER_FIELDS(DEFINE_FIELD_STAGE, 0)
+
+// Lê um registrador já considerando as alterações preparadas
+unsigned short tx_read(const RegisterTransaction *tx, int reg) {
+    return tx->shadow[reg];
+}
+
+// Descarta as alterações preparadas
+void tx_abort(RegisterTransaction *tx) {
+    memset(tx->staged_mask, 0, sizeof(tx->staged_mask));
+    tx->dirty = 0;
+}
+
+// Aplica todas as alterações preparadas. Cada grupo alinhado de 4
+// registradores (8 bytes) com alterações recebe um único store, e apenas os
+// bits preparados são substituídos no valor atual.
+int tx_commit(RegisterTransaction *tx, RegisterCommitStats *stats) {
+    RegisterCommitStats local = {0, 0, 0, 0};
+    int last_line = -1;
+    STATS_TIMER_START(timer, tx_commit);
+
+    if (tx->dirty != 0) {
+        seq_write_begin(tx->base_address);
+    }
+
+    for (int group = 0; group < REGISTER_COUNT / 4; group++) {
+        unsigned int group_dirty = (tx->dirty >> (group * 4)) & 0xF;
+        if (group_dirty == 0) {
+            continue;
+        }
+
+        unsigned long long mask = 0;
+        unsigned long long value = 0;
+        for (int k = 0; k < 4; k++) {
+            int reg = group * 4 + k;
+            if (group_dirty & (1u << k)) {
+                mask |= (unsigned long long)tx->staged_mask[reg] << (16 * k);
+                value |= (unsigned long long)tx->shadow[reg] << (16 * k);
+                local.registers_written++;
+            }
+        }
+
+        unsigned long long *word = (unsigned long long *)(tx->base_address + group * 8);
+        unsigned long long expected = __atomic_load_n(word, __ATOMIC_RELAXED);
+        unsigned long long written = (expected & ~mask) | (value & mask);
+        __atomic_store_n(word, written, __ATOMIC_RELAXED);
+        for (int k = 0; k < 4; k++) {
+            if (group_dirty & (1u << k)) {
+                registers_after_write(tx->base_address, group * 4 + k,
+                                      (unsigned short)(expected >> (16 * k)), (unsigned short)(written >> (16 * k)));
+            }
+        }
+
+        local.stores++;
+        local.bytes_touched += 8;
+        int line = (int)(((unsigned long)word) / CACHE_LINE_SIZE);
+        if (line != last_line) {
+            local.cache_lines++;
+            last_line = line;
+        }
+    }
+
+    if (tx->dirty != 0) {
+        seq_write_end(tx->base_address);
+    }
+
+    tx->dirty = 0;
+    memset(tx->staged_mask, 0, sizeof(tx->staged_mask));
+    if (stats != NULL) {
+        *stats = local;
+    }
+    STATS_TIMER_STOP(timer, tx_commit);
+    return local.registers_written;
+}
+
+// Versões transacionais dos setters: validam como os originais, mas apenas
+// preparam a alteração na cópia sombra
+void tx_set_valor_R(RegisterTransaction *tx, int red_value) {
+    tx_put_red_on(tx, red_value == 1);
+}
+
+void tx_set_valor_G(RegisterTransaction *tx, int green_value) {
+    tx_put_green_on(tx, green_value == 1);
+}
+
+void tx_set_valor_B(RegisterTransaction *tx, int blue_value) {
+    tx_put_blue_on(tx, blue_value == 1);
+}
+
+int tx_set_led_status(RegisterTransaction *tx, int status) {
+    if (status != 0 && status != 1) {
+        STATS_REJECT(led_status);
+        fprintf(stderr, "Erro: Status do LED inválido. Deve ser 0 (desligado) ou 1 (ligado).\n");
+        return -1;
+    }
+    tx_put_led_status(tx, status);
+    return 0;
+}
+
+int tx_set_intensity_R(RegisterTransaction *tx, int intensity) {
+    if (intensity < 0 || intensity > 255) {
+        STATS_REJECT(red);
+        fprintf(stderr, "Erro: Intensidade do componente R fora do intervalo válido (0-255)\n");
+        return -1;
+    }
+    tx_put_red(tx, intensity >> (8 - FIELD_red_WIDTH));
+    return 0;
+}
+
+int tx_set_intensity_G(RegisterTransaction *tx, int intensity) {
+    if (intensity < 0 || intensity > 255) {
+        STATS_REJECT(green);
+        fprintf(stderr, "Erro: Intensidade do componente G fora do intervalo válido (0-255)\n");
+        return -1;
+    }
+    tx_put_green(tx, intensity >> (8 - FIELD_green_WIDTH));
+    return 0;
+}
+
+int tx_set_intensity_B(RegisterTransaction *tx, int intensity) {
+    if (intensity < 0 || intensity > 255) {
+        STATS_REJECT(blue);
+        fprintf(stderr, "Erro: Intensidade do componente B fora do intervalo válido (0-255)\n");
+        return -1;
+    }
+    tx_put_blue(tx, intensity);
+    return 0;
+}
+
+int tx_set_battery_level(RegisterTransaction *tx, int level) {
+    if (level < 0 || level > 3) {
+        STATS_REJECT(battery_level);
+        fprintf(stderr, "Erro: Nível de bateria inválido. Deve estar entre 0 e 3.\n");
+        return -1;
+    }
+    tx_put_battery_level(tx, level);
+    return 0;
+}
+
+int tx_set_led_temperature(RegisterTransaction *tx, int temperature) {
+    if (temperature < 0 || temperature > 1023) {
+        STATS_REJECT(temperature);
+        fprintf(stderr, "Erro: Temperatura do LED fora do intervalo válido (0-1023)\n");
+        return -1;
+    }
+    tx_put_temperature(tx, temperature / 10);
+    return 0;
+}
+
+// Prepara a cor completa do LED (intensidades e bits de controle)
+int tx_set_color_rgb(RegisterTransaction *tx, int red, int green, int blue) {
+    if (tx_set_intensity_R(tx, red) == -1 || tx_set_intensity_G(tx, green) == -1 ||
+        tx_set_intensity_B(tx, blue) == -1) {
+        return -1;
+    }
+    tx_set_valor_R(tx, red > 0);
+    tx_set_valor_G(tx, green > 0);
+    tx_set_valor_B(tx, blue > 0);
+    return 0;
+}
+
+// Prepara a cor percebida (0-255 por componente): intensidades com correção
+// de gama e arredondamento pelas tabelas
+int tx_set_color_rgb_gamma(RegisterTransaction *tx, int red, int green, int blue) {
+    if (red < 0 || red > 255 || green < 0 || green > 255 || blue < 0 || blue > 255) {
+        fprintf(stderr, "Erro: Componentes da cor fora do intervalo válido (0-255)\n");
+        return -1;
+    }
+    unsigned int fields = color_encode_fields(red, green, blue, COLOR_NEAREST_ROW, COLOR_GAMMA);
+    tx_put_red(tx, (fields & FIELD_red_MASK) >> FIELD_red_SHIFT);
+    tx_put_green(tx, (fields & FIELD_green_MASK) >> FIELD_green_SHIFT);
+    tx_put_blue(tx, (fields >> 16) >> FIELD_blue_SHIFT);
+    tx_set_valor_R(tx, red > 0);
+    tx_set_valor_G(tx, green > 0);
+    tx_set_valor_B(tx, blue > 0);
+    return 0;
+}
+
+// Define a cor completa do LED (intensidades e bits de controle) em um único commit
+int set_color_rgb(char* base_address, int red, int green, int blue, RegisterCommitStats *stats) {
+    RegisterTransaction tx;
+    tx_begin(&tx, base_address);
+
+    if (tx_set_color_rgb(&tx, red, green, blue) == -1) {
+        tx_abort(&tx);
+        return -1;
+    }
+    tx_commit(&tx, stats);
+    return 0;
+}
+
+// Como set_color_rgb, mas recebe a cor percebida (0-255 por componente) e
+// grava as intensidades com correção de gama e arredondamento pelas tabelas
+int set_color_rgb_gamma(char* base_address, int red, int green, int blue, RegisterCommitStats *stats) {
+    RegisterTransaction tx;
+    tx_begin(&tx, base_address);
+
+    if (tx_set_color_rgb_gamma(&tx, red, green, blue) == -1) {
+        tx_abort(&tx);
+        return -1;
+    }
+    tx_commit(&tx, stats);
+    return 0;
+}
+
+// BANCO DE DISPOSITIVOS
+// Vários dispositivos em um único arquivo mapeado, cada um em um bloco de
+// DEVICE_STRIDE bytes com o mesmo layout do início de registers.bin. Assim
+// todos os setters funcionam sobre bank_device(bank, i), e uma operação sobre
+// um intervalo de dispositivos percorre a memória sequencialmente, uma
+// linha de cache por dispositivo.
+#define BANK_POPULATE   0x1 // Pré-carrega as páginas no mmap (MAP_POPULATE)
+#define BANK_HUGE_PAGES 0x2 // Pede páginas grandes ao kernel (MADV_HUGEPAGE)
+
+typedef struct {
+    char *base_address;
+    size_t size;
+    int devices;
+    int fd;
+} RegisterBank;
+
+// Abre ou cria o arquivo do banco com o número de dispositivos indicado
+int bank_open(RegisterBank *bank, const char *file_path, int devices, int flags) {
+    bank->size = (size_t)devices * DEVICE_STRIDE;
+    bank->devices = devices;
+    bank->fd = open(file_path, O_RDWR | O_CREAT, 0666);
+    if (bank->fd == -1) {
+        perror("Erro ao abrir ou criar o arquivo do banco");
+        return -1;
+    }
+
+    if (ftruncate(bank->fd, bank->size) == -1) {
+        perror("Erro ao definir o tamanho do arquivo do banco");
+        close(bank->fd);
+        return -1;
+    }
+
+    int map_flags = MAP_SHARED;
+    if (flags & BANK_POPULATE) {
+        map_flags |= MAP_POPULATE;
+    }
+    bank->base_address = mmap(0, bank->size, PROT_READ | PROT_WRITE, map_flags, bank->fd, 0);
+    if (bank->base_address == MAP_FAILED) {
+        perror("Erro ao mapear o arquivo do banco");
+        close(bank->fd);
+        return -1;
+    }
+
+    if ((flags & BANK_HUGE_PAGES) && madvise(bank->base_address, bank->size, MADV_HUGEPAGE) == -1) {
+        perror("Aviso: páginas grandes indisponíveis para o banco");
+    }
+    for (int device = 0; device < devices; device++) {
+        seq_repair(bank->base_address + (size_t)device * DEVICE_STRIDE);
+    }
+    return 0;
+}
+
+int bank_close(RegisterBank *bank) {
+    if (munmap(bank->base_address, bank->size) == -1) {
+        perror("Erro ao desmapear o arquivo do banco");
+        close(bank->fd);
+        return -1;
+    }
+    if (close(bank->fd) == -1) {
+        perror("Erro ao fechar o arquivo do banco");
+        return -1;
+    }
+    return 0;
+}
+
+// Endereço base dos registradores do dispositivo indicado
+static inline char *bank_device(const RegisterBank *bank, int index) {
+    return bank->base_address + (size_t)index * DEVICE_STRIDE;
+}
+
+// Aplica uma operação a cada dispositivo do intervalo [first, first + count)
+void bank_apply_range(RegisterBank *bank, int first, int count,
+                      void (*operation)(char *device_base, void *arg), void *arg) {
+    int last = first + count;
+    if (last > bank->devices) {
+        last = bank->devices;
+    }
+    for (int i = first; i < last; i++) {
+        operation(bank_device(bank, i), arg);
+    }
+}
+
+// Escreve o mesmo campo (mask e valor já deslocado) em um intervalo de
+// dispositivos: uma seção de escrita por dispositivo, em ordem de endereço
+void bank_store_field_range(RegisterBank *bank, int first, int count, int reg,
+                            unsigned short mask, unsigned short value) {
+    int last = first + count;
+    if (last > bank->devices) {
+        last = bank->devices;
+    }
+    for (int i = first; i < last; i++) {
+        reg_atomic_update(bank_device(bank, i), reg, mask, value);
+    }
+}
+
+// CENAS
+// Uma cena é um estado nomeado do display (LED, cores, texto, bateria e
+// temperatura), lido de um arquivo de texto com uma seção por cena:
+//   [alerta]
+//   led 1
+//   rgb 255 0 0
+//   text ALERTA
+//   battery 3
+// Os comandos são os do modo de script que escrevem campos (led, rgb, color,
+// red, green, blue, battery, temp, textmode, text). Cada cena é compilada uma única vez
+// pelos setters transacionais em uma imagem de R0-R15 e na máscara dos bits
+// que ela escreve, já agrupadas em palavras de 64 bits. Aplicar a cena é uma
+// cópia com máscara em uma única seção de escrita: um store por grupo de 4
+// registradores tocado, e nenhum store se o grupo já estiver na cena. As cenas
+// ficam em um índice por hash do nome (FNV-1a, endereçamento aberto).
+#define SCENE_NAME_MAX 32
+#define SCENE_GROUPS (REGISTER_COUNT / 4)
+
+typedef struct {
+    char name[SCENE_NAME_MAX];
+    unsigned int hash;
+    unsigned int groups;                    // Bit g ligado = grupo g (R4g a R4g+3) tocado
+    unsigned long long image[SCENE_GROUPS]; // Valores dos bits escritos
+    unsigned long long mask[SCENE_GROUPS];  // Bits escritos pela cena
+} Scene;
+
+typedef struct {
+    Scene *scenes;
+    int count;
+    int capacity;
+    int *index;     // Posição em scenes + 1 (0 = vazio)
+    int index_size; // Potência de 2, pelo menos o dobro de count
+} SceneLibrary;
+
+unsigned int scene_hash(const char *name) {
+    unsigned int hash = 2166136261u;
+    while (*name != '\0') {
+        hash = (hash ^ (unsigned char)*name++) * 16777619u;
+    }
+    return hash;
+}
+
+// Prepara um comando da cena. Retorna -1 se o comando for inválido.
+int scene_compile_line(RegisterTransaction *tx, char *line) {
+    char command[16];
+    int a, b, c, consumed = 0;
+
+    if (sscanf(line, "%15s%n", command, &consumed) != 1) {
+        return -1;
+    }
+    char *args = line + consumed;
+
+    if (strcmp(command, "led") == 0 && sscanf(args, "%d", &a) == 1) {
+        return tx_set_led_status(tx, a);
+    } else if (strcmp(command, "rgb") == 0 && sscanf(args, "%d %d %d", &a, &b, &c) == 3) {
+        return tx_set_color_rgb(tx, a, b, c);
+    } else if (strcmp(command, "color") == 0 && sscanf(args, "%d %d %d", &a, &b, &c) == 3) {
+        return tx_set_color_rgb_gamma(tx, a, b, c);
+    } else if (strcmp(command, "red") == 0 && sscanf(args, "%d", &a) == 1) {
+        return tx_set_intensity_R(tx, a);
+    } else if (strcmp(command, "green") == 0 && sscanf(args, "%d", &a) == 1) {
+        return tx_set_intensity_G(tx, a);
+    } else if (strcmp(command, "blue") == 0 && sscanf(args, "%d", &a) == 1) {
+        return tx_set_intensity_B(tx, a);
+    } else if (strcmp(command, "battery") == 0 && sscanf(args, "%d", &a) == 1) {
+        return tx_set_battery_level(tx, a);
+    } else if (strcmp(command, "temp") == 0 && sscanf(args, "%d", &a) == 1) {
+        return tx_set_led_temperature(tx, a);
+    } else if (strcmp(command, "textmode") == 0 && (a = text_encoding_parse(args)) != -1) {
+        tx_put_text_encoding(tx, a);
+        return 0;
+    } else if (strcmp(command, "text") == 0) {
+        // A cena grava também a codificação (ascii, se não houver textmode antes)
+        unsigned long long words[TEXT_WORDS];
+        int encoding = field_get_text_encoding(tx->shadow);
+        while (*args == ' ' || *args == '\t') {
+            args++;
+        }
+        text_encode(args, encoding, words);
+        tx_put_text_encoding(tx, encoding);
+        for (int i = 0; i < TEXT_REGISTERS; i++) {
+            tx_stage(tx, i + 4, 0xFFFF, (unsigned short)(words[i / 4] >> (16 * (i % 4))));
+        }
+        return 0;
+    }
+    return -1;
+}
+
+// Converte as alterações preparadas na imagem e na máscara da cena
+void scene_finish(Scene *scene, const RegisterTransaction *tx) {
+    scene->groups = 0;
+    for (int group = 0; group < SCENE_GROUPS; group++) {
+        scene->image[group] = 0;
+        scene->mask[group] = 0;
+        for (int k = 0; k < 4; k++) {
+            int reg = group * 4 + k;
+            scene->mask[group] |= (unsigned long long)tx->staged_mask[reg] << (16 * k);
+            scene->image[group] |= (unsigned long long)(tx->shadow[reg] & tx->staged_mask[reg]) << (16 * k);
+        }
+        if (scene->mask[group] != 0) {
+            scene->groups |= 1u << group;
+        }
+    }
+}
+
+// Procura a cena pelo nome; retorna NULL se ela não existir
+const Scene *scene_find(const SceneLibrary *library, const char *name) {
+    if (library->index_size == 0) {
+        return NULL;
+    }
+    unsigned int hash = scene_hash(name);
+    for (unsigned int slot = hash & (library->index_size - 1);; slot = (slot + 1) & (library->index_size - 1)) {
+        int position = library->index[slot];
+        if (position == 0) {
+            return NULL;
+        }
+        const Scene *scene = &library->scenes[position - 1];
+        if (scene->hash == hash && strcmp(scene->name, name) == 0) {
+            return scene;
+        }
+    }
+}
+
+// Reconstrói o índice com espaço para o dobro das cenas
+static int scene_library_reindex(SceneLibrary *library) {
+    int size = 16;
+    while (size < library->count * 2) {
+        size *= 2;
+    }
+    int *index = calloc(size, sizeof(int));
+    if (index == NULL) {
+        perror("Erro ao alocar o índice de cenas");
+        return -1;
+    }
+    free(library->index);
+    library->index = index;
+    library->index_size = size;
+    for (int i = 0; i < library->count; i++) {
+        unsigned int slot = library->scenes[i].hash & (size - 1);
+        while (index[slot] != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        index[slot] = i + 1;
+    }
+    return 0;
+}
+
+// Compila as cenas do texto (modificado no lugar) e as acrescenta à
+// biblioteca. Em caso de erro nenhuma cena do texto é acrescentada.
+int scene_library_parse(SceneLibrary *library, char *text, const char *source) {
+    int first = library->count;
+    int line_number = 0;
+    Scene *scene = NULL;
+    RegisterTransaction tx;
+
+    for (char *next = text; next != NULL;) {
+        char *line = next;
+        next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        line_number++;
+        line[strcspn(line, "\r")] = '\0';
+        while (isspace((unsigned char)*line)) {
+            line++;
+        }
+        if (*line == '\0' || *line == '#') {
+            continue;
+        }
+
+        if (*line != '[') {
+            if (scene == NULL || scene_compile_line(&tx, line) == -1) {
+                fprintf(stderr, "Erro: comando de cena inválido em %s:%d: %s\n", source, line_number, line);
+                library->count = first;
+                return -1;
+            }
+            continue;
+        }
+
+        char *end = strchr(line, ']');
+        if (end == NULL || end == line + 1 || end - line - 1 >= SCENE_NAME_MAX) {
+            fprintf(stderr, "Erro: nome de cena inválido em %s:%d: %s\n", source, line_number, line);
+            library->count = first;
+            return -1;
+        }
+        *end = '\0';
+        if (scene != NULL) {
+            scene_finish(scene, &tx);
+        }
+        if (library->count == library->capacity) {
+            int capacity = library->capacity ? library->capacity * 2 : 16;
+            Scene *scenes = realloc(library->scenes, capacity * sizeof(Scene));
+            if (scenes == NULL) {
+                perror("Erro ao alocar as cenas");
+                library->count = first;
+                return -1;
+            }
+            library->scenes = scenes;
+            library->capacity = capacity;
+        }
+        scene = &library->scenes[library->count++];
+        snprintf(scene->name, sizeof(scene->name), "%s", line + 1);
+        scene->hash = scene_hash(scene->name);
+        memset(&tx, 0, sizeof(tx));
+    }
+    if (scene != NULL) {
+        scene_finish(scene, &tx);
+    }
+
+    // Nomes repetidos são rejeitados (também contra as cenas já carregadas)
+    for (int i = first; i < library->count; i++) {
+        const Scene *existing = NULL;
+        for (int j = 0; j < i && existing == NULL; j++) {
+            if (library->scenes[j].hash == library->scenes[i].hash &&
+                strcmp(library->scenes[j].name, library->scenes[i].name) == 0) {
+                existing = &library->scenes[j];
+            }
+        }
+        if (existing != NULL) {
+            fprintf(stderr, "Erro: cena repetida em %s: %s\n", source, existing->name);
+            library->count = first;
+            return -1;
+        }
+    }
+    if (scene_library_reindex(library) == -1) {
+        library->count = first;
+        return -1;
+    }
+    return library->count - first;
+}
+
+// Lê o arquivo de cenas e compila todas. Retorna o número de cenas lidas ou -1.
+int scene_library_load(SceneLibrary *library, const char *path) {
+    FILE *input = fopen(path, "r");
+    if (input == NULL) {
+        perror("Erro ao abrir o arquivo de cenas");
+        return -1;
+    }
+    fseek(input, 0, SEEK_END);
+    long size = ftell(input);
+    rewind(input);
+    char *text = malloc(size + 1);
+    if (text == NULL || fread(text, 1, size, input) != (size_t)size) {
+        perror("Erro ao ler o arquivo de cenas");
+        free(text);
+        fclose(input);
+        return -1;
+    }
+    text[size] = '\0';
+    fclose(input);
+
+    int loaded = scene_library_parse(library, text, path);
+    free(text);
+    return loaded;
+}
+
+void scene_library_free(SceneLibrary *library) {
+    free(library->scenes);
+    free(library->index);
+    memset(library, 0, sizeof(*library));
+}
+
+// Aplica a cena aos registradores em uma única seção de escrita
+void scene_apply(char *base_address, const Scene *scene) {
+    if (scene->groups == 0) {
+        return;
+    }
+    STATS_TIMER_START(timer, scene_apply);
+    seq_write_begin(base_address);
+    for (unsigned int groups = scene->groups; groups != 0; groups &= groups - 1) {
+        int group = __builtin_ctz(groups);
+        unsigned long long *word = (unsigned long long *)(base_address + group * 8);
+        unsigned long long mask = scene->mask[group];
+        unsigned long long expected = __atomic_load_n(word, __ATOMIC_RELAXED);
+        if ((expected & mask) == scene->image[group]) {
+            continue; // Grupo já está na cena: nenhum store
+        }
+        // Um escritor por vez na seção de escrita: basta um store simples
+        unsigned long long desired = (expected & ~mask) | scene->image[group];
+        __atomic_store_n(word, desired, __ATOMIC_RELAXED);
+        for (int k = 0; k < 4; k++) {
+            unsigned short previous = (unsigned short)(expected >> (16 * k));
+            unsigned short written = (unsigned short)(desired >> (16 * k));
+            if (previous != written) {
+                registers_after_write(base_address, group * 4 + k, previous, written);
+            }
+        }
+    }
+    seq_write_end(base_address);
+    STATS_TIMER_STOP(timer, scene_apply);
+}
+
+// Aplica a cena a um intervalo de dispositivos do banco, em ordem de endereço
+void scene_apply_range(RegisterBank *bank, int first, int count, const Scene *scene) {
+    int last = first + count;
+    if (last > bank->devices) {
+        last = bank->devices;
+    }
+    for (int i = first; i < last; i++) {
+        scene_apply(bank_device(bank, i), scene);
+    }
+}
+
+// SNAPSHOTS DA IMAGEM DE REGISTROS
+// Um SnapshotStore guarda checkpoints de uma imagem mapeada (registers.bin
+// ou um banco). O primeiro snapshot copia a imagem inteira; os seguintes
+// guardam só os blocos marcados pelo DirtyTracker desde a captura anterior,
+// então capturar, comparar e restaurar custam proporcionalmente ao que
+// mudou. O conteúdo de um bloco em um snapshot é o da cópia mais recente
+// daquele bloco até ele.
+//
+// As palavras de controle de cada dispositivo (seqlock, geração, assinantes
+// e dono da trava em 0x20-0x37) não fazem parte da imagem: não são
+// comparadas nem restauradas.
+
+#define SNAPSHOT_CONTROL_WORDS (0xFFFu << (SEQUENCE_OFFSET / 2)) // Palavras 16-27 do bloco
+
+typedef struct {
+    long taken_ns;
+    int block_count;
+    int *blocks;   // Blocos copiados, em ordem crescente
+    char *data;    // block_count * DEVICE_STRIDE bytes
+} Snapshot;
+
+typedef struct {
+    char *base_address;
+    size_t size;
+    int blocks;
+    int devices;   // Blocos iniciais que são dispositivos (R0-R15 + controle)
+    Snapshot *snapshots;
+    int count;
+    int capacity;
+} SnapshotStore;
+
+// Máscara das palavras de 16 bits diferentes entre dois blocos (bit n = palavra n)
+static inline unsigned int block_diff_mask(const char *a, const char *b) {
+#ifdef HAVE_X86_SIMD
+    __m128i equal_low = _mm_packs_epi16(
+        _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)a), _mm_loadu_si128((const __m128i *)b)),
+        _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(a + 16)), _mm_loadu_si128((const __m128i *)(b + 16))));
+    __m128i equal_high = _mm_packs_epi16(
+        _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(a + 32)), _mm_loadu_si128((const __m128i *)(b + 32))),
+        _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(a + 48)), _mm_loadu_si128((const __m128i *)(b + 48))));
+    unsigned int equal = (unsigned int)_mm_movemask_epi8(equal_low) | ((unsigned int)_mm_movemask_epi8(equal_high) << 16);
+    return ~equal;
+#else
+    const unsigned short *x = (const unsigned short *)a;
+    const unsigned short *y = (const unsigned short *)b;
+    unsigned int mask = 0;
+    for (int i = 0; i < DEVICE_STRIDE / 2; i++) {
+        mask |= (unsigned int)(x[i] != y[i]) << i;
+    }
+    return mask;
+#endif
+}
+
+// Palavras que contam na comparação de um bloco
+static inline unsigned int snapshot_word_mask(const SnapshotStore *store, int block) {
+    return block < store->devices ? ~SNAPSHOT_CONTROL_WORDS : ~0u;
+}
+
+// Conteúdo de um bloco como estava no snapshot indicado
+const char *snapshot_block(const SnapshotStore *store, int id, int block) {
+    for (int i = id; i >= 0; i--) {
+        const Snapshot *snapshot = &store->snapshots[i];
+        int low = 0, high = snapshot->block_count - 1;
+        while (low <= high) {
+            int middle = (low + high) / 2;
+            if (snapshot->blocks[middle] == block) {
+                return snapshot->data + (size_t)middle * DEVICE_STRIDE;
+            }
+            if (snapshot->blocks[middle] < block) {
+                low = middle + 1;
+            } else {
+                high = middle - 1;
+            }
+        }
+    }
+    return NULL; // Não acontece: o snapshot 0 tem todos os blocos
+}
+
+// Copia um bloco; blocos de dispositivo são lidos de forma consistente pelo seqlock
+static void snapshot_copy_block(const SnapshotStore *store, int block, char *destination) {
+    char *source = store->base_address + (size_t)block * DEVICE_STRIDE;
+    if (block >= store->devices) {
+        memcpy(destination, source, DEVICE_STRIDE);
+        return;
+    }
+    unsigned int *seq = SEQ_PTR(source);
+    for (int spins = 1;; spins++) {
+        unsigned int before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        if ((before & 1) == 0) {
+            memcpy(destination, source, DEVICE_STRIDE);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(seq, __ATOMIC_RELAXED) == before) {
+                return;
+            }
+        }
+        if (spins % SEQ_SPINS_BEFORE_CHECK == 0) {
+            seq_repair(source);
+        }
+        cpu_relax();
+    }
+}
+
+// Cria um snapshot com os blocos indicados no mapa de bits e o retorna
+static int snapshot_append(SnapshotStore *store, const unsigned long long *bits) {
+    if (store->count == store->capacity) {
+        int capacity = store->capacity ? store->capacity * 2 : 16;
+        Snapshot *grown = realloc(store->snapshots, capacity * sizeof(Snapshot));
+        if (grown == NULL) {
+            return -1;
+        }
+        store->snapshots = grown;
+        store->capacity = capacity;
+    }
+
+    int words = (store->blocks + 63) / 64;
+    int count = 0;
+    for (int w = 0; w < words; w++) {
+        count += __builtin_popcountll(bits[w]);
+    }
+    Snapshot *snapshot = &store->snapshots[store->count];
+    snapshot->taken_ns = monotonic_ns();
+    snapshot->block_count = 0;
+    snapshot->blocks = malloc((count ? count : 1) * sizeof(int));
+    snapshot->data = malloc((size_t)(count ? count : 1) * DEVICE_STRIDE);
+    if (snapshot->blocks == NULL || snapshot->data == NULL) {
+        free(snapshot->blocks);
+        free(snapshot->data);
+        return -1;
+    }
+    for (int w = 0; w < words; w++) {
+        unsigned long long word = bits[w];
+        while (word) {
+            int block = w * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+            snapshot->blocks[snapshot->block_count] = block;
+            snapshot_copy_block(store, block, snapshot->data + (size_t)snapshot->block_count * DEVICE_STRIDE);
+            snapshot->block_count++;
+        }
+    }
+    return store->count++;
+}
+
+// Passa a acompanhar a imagem e tira o snapshot completo inicial (id 0)
+int snapshot_store_init(SnapshotStore *store, char *base_address, size_t size, int devices) {
+    store->base_address = base_address;
+    store->size = size;
+    store->blocks = (int)(size / DEVICE_STRIDE);
+    store->devices = devices;
+    store->snapshots = NULL;
+    store->count = store->capacity = 0;
+
+    int words = (store->blocks + 63) / 64;
+    unsigned long long *all = malloc(words * sizeof(unsigned long long));
+    unsigned long long *dirty = calloc(words, sizeof(unsigned long long));
+    if (all == NULL || dirty == NULL) {
+        free(all);
+        free(dirty);
+        return -1;
+    }
+    memset(all, 0xFF, words * sizeof(unsigned long long));
+    if (store->blocks % 64) {
+        all[words - 1] = (1ULL << (store->blocks % 64)) - 1;
+    }
+
+    dirty_tracker = (DirtyTracker){base_address, size, store->blocks, NULL};
+    __atomic_store_n(&dirty_tracker.dirty, dirty, __ATOMIC_RELEASE);
+    int result = snapshot_append(store, all);
+    free(all);
+    return result;
+}
+
+void snapshot_store_free(SnapshotStore *store) {
+    if (dirty_tracker.base_address == store->base_address) {
+        free(dirty_tracker.dirty);
+        dirty_tracker = (DirtyTracker){NULL};
+    }
+    for (int i = 0; i < store->count; i++) {
+        free(store->snapshots[i].blocks);
+        free(store->snapshots[i].data);
+    }
+    free(store->snapshots);
+    store->snapshots = NULL;
+    store->count = store->capacity = 0;
+}
+
+// Captura um snapshot. Normalmente só os blocos marcados são copiados; com
+// scan = 1 a imagem inteira é comparada com o último snapshot (para pegar
+// escritas de outros processos) e só os blocos diferentes são copiados.
+// Retorna o id do snapshot ou -1.
+int snapshot_capture(SnapshotStore *store, int scan) {
+    int words = (store->blocks + 63) / 64;
+    unsigned long long *bits = calloc(words, sizeof(unsigned long long));
+    if (bits == NULL) {
+        return -1;
+    }
+    for (int w = 0; w < words; w++) {
+        bits[w] = __atomic_exchange_n(&dirty_tracker.dirty[w], 0, __ATOMIC_ACQUIRE);
+    }
+    if (scan) {
+        int last = store->count - 1;
+        for (int block = 0; block < store->blocks; block++) {
+            const char *current = store->base_address + (size_t)block * DEVICE_STRIDE;
+            if (block_diff_mask(current, snapshot_block(store, last, block)) & snapshot_word_mask(store, block)) {
+                bits[block / 64] |= 1ULL << (block % 64);
+            }
+        }
+    }
+    int id = snapshot_append(store, bits);
+    free(bits);
+    return id;
+}
+
+// Liga em bits os blocos copiados pelos snapshots (first, last]
+static void snapshot_collect(const SnapshotStore *store, int first, int last, unsigned long long *bits) {
+    for (int i = first + 1; i <= last; i++) {
+        const Snapshot *snapshot = &store->snapshots[i];
+        for (int k = 0; k < snapshot->block_count; k++) {
+            bits[snapshot->blocks[k] / 64] |= 1ULL << (snapshot->blocks[k] % 64);
+        }
+    }
+}
+
+// Imprime uma palavra alterada; em blocos de dispositivo, com os campos do mapa
+static void snapshot_print_word(FILE *output, const SnapshotStore *store, int block, int word,
+                                unsigned short old_value, unsigned short new_value) {
+    if (block >= store->devices || word >= REGISTER_COUNT) {
+        fprintf(output, "0x%06zx: %04x -> %04x\n", (size_t)block * DEVICE_STRIDE + word * 2, old_value, new_value);
+        return;
+    }
+    fprintf(output, "dispositivo %d R%d: %04x -> %04x", block, word, old_value, new_value);
+    for (int i = 0; i < REGISTER_FIELD_COUNT; i++) {
+        const RegisterField *field = &register_fields[i];
+        unsigned short mask = FIELD_BITS(field->offset, field->width);
+        if (field->reg == word && ((old_value ^ new_value) & mask)) {
+            fprintf(output, " %s %d->%d", field->name, (old_value & mask) >> field->offset,
+                    (new_value & mask) >> field->offset);
+        }
+    }
+    fprintf(output, "\n");
+}
+
+// Compara dois snapshots olhando só os blocos copiados entre eles. Imprime as
+// palavras alteradas em output (se não for NULL) e retorna quantas são.
+long snapshot_diff(const SnapshotStore *store, int a, int b, FILE *output) {
+    if (a < 0 || b < 0 || a >= store->count || b >= store->count) {
+        return -1;
+    }
+    int words = (store->blocks + 63) / 64;
+    unsigned long long *bits = calloc(words, sizeof(unsigned long long));
+    if (bits == NULL) {
+        return -1;
+    }
+    snapshot_collect(store, a < b ? a : b, a < b ? b : a, bits);
+
+    long changed = 0;
+    for (int w = 0; w < words; w++) {
+        unsigned long long word = bits[w];
+        while (word) {
+            int block = w * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+            const char *before = snapshot_block(store, a, block);
+            const char *after = snapshot_block(store, b, block);
+            unsigned int mask = block_diff_mask(before, after) & snapshot_word_mask(store, block);
+            changed += __builtin_popcount(mask);
+            while (output != NULL && mask) {
+                int i = __builtin_ctz(mask);
+                mask &= mask - 1;
+                snapshot_print_word(output, store, block, i, ((const unsigned short *)before)[i],
+                                    ((const unsigned short *)after)[i]);
+            }
+        }
+    }
+    free(bits);
+    return changed;
+}
+
+// Restaura a imagem para o snapshot indicado. Só os blocos copiados depois
+// dele ou marcados desde a última captura são comparados e reescritos.
+// Retorna o número de blocos reescritos.
+int snapshot_restore(SnapshotStore *store, int id) {
+    if (id < 0 || id >= store->count) {
+        return -1;
+    }
+    int words = (store->blocks + 63) / 64;
+    unsigned long long *bits = calloc(words, sizeof(unsigned long long));
+    if (bits == NULL) {
+        return -1;
+    }
+    snapshot_collect(store, id, store->count - 1, bits);
+    for (int w = 0; w < words; w++) {
+        bits[w] |= __atomic_load_n(&dirty_tracker.dirty[w], __ATOMIC_ACQUIRE);
+    }
+
+    int restored = 0;
+    for (int w = 0; w < words; w++) {
+        unsigned long long word = bits[w];
+        while (word) {
+            int block = w * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+            char *current = store->base_address + (size_t)block * DEVICE_STRIDE;
+            const char *target = snapshot_block(store, id, block);
+            unsigned int mask = block_diff_mask(current, target) & snapshot_word_mask(store, block);
+            if (mask == 0) {
+                continue;
+            }
+            if (block < store->devices) {
+                // Registradores pelo seqlock do dispositivo; o resto do bloco direto
+                registers_write_all(current, (const unsigned short *)target);
+                size_t tail = SEQ_OWNER_OFFSET + sizeof(unsigned long long);
+                memcpy(current + tail, target + tail, DEVICE_STRIDE - tail);
+            } else {
+                memcpy(current, target, DEVICE_STRIDE);
+            }
+            dirty_mark_range(current, DEVICE_STRIDE);
+            restored++;
+        }
+    }
+    free(bits);
+    return restored;
+}
+
+// KERNELS DE COR EM LOTE
+// Operam sobre um vetor de blocos de dispositivo (passo DEVICE_STRIDE) e
+// tratam R1 e R2 de cada dispositivo como uma única palavra de 32 bits
+// (R1 na metade baixa, R2 na alta). Cada componente é expandido para 8 bits,
+// transformado e recodificado, e o par R1/R2 é gravado com um único store de
+// 32 bits. Os kernels não passam pelo seqlock, não notificam os assinantes e
+// não alimentam o registro de alterações, por isso só podem operar sobre
+// uma imagem privada (quadro em memória do processo), nunca sobre o arquivo
+// mapeado. Um quadro pronto é publicado dispositivo a dispositivo com
+// registers_write_all.
+//
+// Transformação aplicada a cada componente c (0-255), nesta ordem:
+//   brilho:  c = c * scale / 256                    (scale 0-256)
+//   mistura: c = (c * (256 - alpha) + t * alpha) / 256 (alpha 0-256, t = destino)
+//   gama:    c = (c * c + 255) / 256, se gamma != 0 (gama 2.0)
+typedef struct {
+    int scale;
+    int alpha;
+    unsigned char target[3]; // Cor de destino da mistura (R, G, B)
+    int gamma;
+} ColorKernelOp;
+
+#define COLOR_LANE_OFFSET (1 * sizeof(unsigned short)) // R1 e R2
+#define COLOR_LANE_KEEP (~((unsigned int)(RED_MASK | GREEN_MASK) | ((unsigned int)BLUE_MASK << 16)))
+
+static inline unsigned int color_lane_load(const char *device_base) {
+    unsigned int lane;
+    memcpy(&lane, device_base + COLOR_LANE_OFFSET, sizeof(lane));
+    return lane;
+}
+
+static inline void color_lane_store(char *device_base, unsigned int lane) {
+    memcpy(device_base + COLOR_LANE_OFFSET, &lane, sizeof(lane));
+}
+
+static inline unsigned int color_component_apply(unsigned int c, unsigned int target, const ColorKernelOp *op) {
+    c = (c * op->scale) >> 8;
+    c = (c * (256 - op->alpha) + target * op->alpha) >> 8;
+    if (op->gamma) {
+        c = (c * c + 255) >> 8;
+    }
+    return c;
+}
+
+// Recodifica componentes de 8 bits no par R1/R2, preservando os demais bits
+static inline unsigned int color_lane_encode(unsigned int lane, unsigned int r, unsigned int g, unsigned int b) {
+    return (lane & COLOR_LANE_KEEP) | ((r >> 3) << FIELD_red_SHIFT) | ((g >> 2) << FIELD_green_SHIFT) |
+           (b << (16 + FIELD_blue_SHIFT));
+}
+
+static inline void color_lane_decode(unsigned int lane, unsigned int *r, unsigned int *g, unsigned int *b) {
+    unsigned int r5 = (lane >> FIELD_red_SHIFT) & 0x1F;
+    unsigned int g6 = (lane >> FIELD_green_SHIFT) & 0x3F;
+    *r = (r5 << 3) | (r5 >> 2);
+    *g = (g6 << 2) | (g6 >> 4);
+    *b = (lane >> (16 + FIELD_blue_SHIFT)) & 0xFF;
+}
+
+void color_kernel_scalar(char *base_address, int count, const ColorKernelOp *op) {
+    for (int i = 0; i < count; i++) {
+        char *device = base_address + (size_t)i * DEVICE_STRIDE;
+        unsigned int lane = color_lane_load(device);
+        unsigned int r, g, b;
+        color_lane_decode(lane, &r, &g, &b);
+        r = color_component_apply(r, op->target[0], op);
+        g = color_component_apply(g, op->target[1], op);
+        b = color_component_apply(b, op->target[2], op);
+        color_lane_store(device, color_lane_encode(lane, r, g, b));
+    }
+}
+
+// Converte cores em vetores planares de 8 bits (R[], G[], B[]) para os registradores
+void color_pack_scalar(char *base_address, int count, const unsigned char *red,
+                       const unsigned char *green, const unsigned char *blue) {
+    for (int i = 0; i < count; i++) {
+        char *device = base_address + (size_t)i * DEVICE_STRIDE;
+        color_lane_store(device, color_lane_encode(color_lane_load(device), red[i], green[i], blue[i]));
+    }
+}
+
+// Converte os registradores para vetores planares de 8 bits
+void color_unpack_scalar(const char *base_address, int count, unsigned char *red,
+                         unsigned char *green, unsigned char *blue) {
+    for (int i = 0; i < count; i++) {
+        unsigned int r, g, b;
+        color_lane_decode(color_lane_load(base_address + (size_t)i * DEVICE_STRIDE), &r, &g, &b);
+        red[i] = r;
+        green[i] = g;
+        blue[i] = b;
+    }
+}
+
+// Versões por tabela: cada componente passa pelas tabelas de cor (gama e
+// quantização ao mais próximo ou pontilhada). Os dispositivos formam uma
+// grade de width colunas, que define o limiar de Bayer de cada um.
+void color_pack_lut(char *base_address, int count, int width, const unsigned char *red,
+                    const unsigned char *green, const unsigned char *blue, int flags) {
+    for (int i = 0, x = 0, y = 0; i < count; i++) {
+        char *device = base_address + (size_t)i * DEVICE_STRIDE;
+        unsigned int fields = color_encode_fields(red[i], green[i], blue[i], color_threshold_row(x, y, flags), flags);
+        color_lane_store(device, (color_lane_load(device) & COLOR_LANE_KEEP) | fields);
+        if (++x == width) {
+            x = 0;
+            y++;
+        }
+    }
+}
+
+void color_unpack_lut(const char *base_address, int count, unsigned char *red,
+                      unsigned char *green, unsigned char *blue, int flags) {
+    for (int i = 0; i < count; i++) {
+        unsigned int r, g, b;
+        color_decode_fields(color_lane_load(base_address + (size_t)i * DEVICE_STRIDE), &r, &g, &b, flags);
+        red[i] = r;
+        green[i] = g;
+        blue[i] = b;
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+// Versões SSE2: 4 dispositivos por vetor, um dispositivo por lane de 32 bits.
+// Todos os produtos cabem em 16 bits (no máximo 255 * 256), por isso as
+// multiplicações usam _mm_mullo_epi16 com a metade alta de cada lane zerada.
+static inline __m128i color_lanes_load_sse2(const char *device) {
+    return _mm_set_epi32((int)color_lane_load(device + 3 * DEVICE_STRIDE), (int)color_lane_load(device + 2 * DEVICE_STRIDE),
+                         (int)color_lane_load(device + DEVICE_STRIDE), (int)color_lane_load(device));
+}
+
+static inline void color_lanes_store_sse2(char *device, __m128i lanes) {
+    color_lane_store(device, (unsigned int)_mm_cvtsi128_si32(lanes));
+    color_lane_store(device + DEVICE_STRIDE, (unsigned int)_mm_cvtsi128_si32(_mm_shuffle_epi32(lanes, 1)));
+    color_lane_store(device + 2 * DEVICE_STRIDE, (unsigned int)_mm_cvtsi128_si32(_mm_shuffle_epi32(lanes, 2)));
+    color_lane_store(device + 3 * DEVICE_STRIDE, (unsigned int)_mm_cvtsi128_si32(_mm_shuffle_epi32(lanes, 3)));
+}
+
+static inline void color_lanes_decode_sse2(__m128i lanes, __m128i *r, __m128i *g, __m128i *b) {
+    __m128i r5 = _mm_and_si128(_mm_srli_epi32(lanes, FIELD_red_SHIFT), _mm_set1_epi32(0x1F));
+    __m128i g6 = _mm_and_si128(_mm_srli_epi32(lanes, FIELD_green_SHIFT), _mm_set1_epi32(0x3F));
+    *r = _mm_or_si128(_mm_slli_epi32(r5, 3), _mm_srli_epi32(r5, 2));
+    *g = _mm_or_si128(_mm_slli_epi32(g6, 2), _mm_srli_epi32(g6, 4));
+    *b = _mm_and_si128(_mm_srli_epi32(lanes, 16 + FIELD_blue_SHIFT), _mm_set1_epi32(0xFF));
+}
+
+static inline __m128i color_lanes_encode_sse2(__m128i lanes, __m128i r, __m128i g, __m128i b) {
+    __m128i packed = _mm_or_si128(_mm_slli_epi32(_mm_srli_epi32(r, 3), FIELD_red_SHIFT),
+                                  _mm_slli_epi32(_mm_srli_epi32(g, 2), FIELD_green_SHIFT));
+    packed = _mm_or_si128(packed, _mm_slli_epi32(b, 16 + FIELD_blue_SHIFT));
+    return _mm_or_si128(_mm_and_si128(lanes, _mm_set1_epi32((int)COLOR_LANE_KEEP)), packed);
+}
+
+static inline __m128i color_component_apply_sse2(__m128i c, __m128i scale, __m128i inverse_alpha,
+                                                 __m128i weighted_target, int gamma) {
+    c = _mm_srli_epi16(_mm_mullo_epi16(c, scale), 8);
+    c = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(c, inverse_alpha), weighted_target), 8);
+    if (gamma) {
+        c = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(c, c), _mm_set1_epi32(255)), 8);
+    }
+    return c;
+}
+
+void color_kernel_sse2(char *base_address, int count, const ColorKernelOp *op) {
+    __m128i scale = _mm_set1_epi32(op->scale);
+    __m128i inverse_alpha = _mm_set1_epi32(256 - op->alpha);
+    __m128i target_r = _mm_set1_epi32(op->target[0] * op->alpha);
+    __m128i target_g = _mm_set1_epi32(op->target[1] * op->alpha);
+    __m128i target_b = _mm_set1_epi32(op->target[2] * op->alpha);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        char *device = base_address + (size_t)i * DEVICE_STRIDE;
+        __m128i lanes = color_lanes_load_sse2(device);
+        __m128i r, g, b;
+        color_lanes_decode_sse2(lanes, &r, &g, &b);
+        r = color_component_apply_sse2(r, scale, inverse_alpha, target_r, op->gamma);
+        g = color_component_apply_sse2(g, scale, inverse_alpha, target_g, op->gamma);
+        b = color_component_apply_sse2(b, scale, inverse_alpha, target_b, op->gamma);
+        color_lanes_store_sse2(device, color_lanes_encode_sse2(lanes, r, g, b));
+    }
+    color_kernel_scalar(base_address + (size_t)i * DEVICE_STRIDE, count - i, op);
+}
+
+static inline __m128i color_bytes_to_lanes_sse2(const unsigned char *bytes) {
+    int packed;
+    memcpy(&packed, bytes, sizeof(packed));
+    __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+}
+
+static inline void color_lanes_to_bytes_sse2(__m128i lanes, unsigned char *bytes) {
+    __m128i words = _mm_packs_epi32(lanes, lanes);
+    int packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+    memcpy(bytes, &packed, sizeof(packed));
+}
+
+void color_pack_sse2(char *base_address, int count, const unsigned char *red,
+                     const unsigned char *green, const unsigned char *blue) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        char *device = base_address + (size_t)i * DEVICE_STRIDE;
+        __m128i lanes = color_lanes_load_sse2(device);
+        color_lanes_store_sse2(device, color_lanes_encode_sse2(lanes, color_bytes_to_lanes_sse2(red + i),
+                                                               color_bytes_to_lanes_sse2(green + i),
+                                                               color_bytes_to_lanes_sse2(blue + i)));
+    }
+    color_pack_scalar(base_address + (size_t)i * DEVICE_STRIDE, count - i, red + i, green + i, blue + i);
+}
+
+void color_unpack_sse2(const char *base_address, int count, unsigned char *red,
+                       unsigned char *green, unsigned char *blue) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i r, g, b;
+        color_lanes_decode_sse2(color_lanes_load_sse2(base_address + (size_t)i * DEVICE_STRIDE), &r, &g, &b);
+        color_lanes_to_bytes_sse2(r, red + i);
+        color_lanes_to_bytes_sse2(g, green + i);
+        color_lanes_to_bytes_sse2(b, blue + i);
+    }
+    color_unpack_scalar(base_address + (size_t)i * DEVICE_STRIDE, count - i, red + i, green + i, blue + i);
+}
+
+// Versão AVX2: 8 dispositivos por vetor, com carga por gather
+__attribute__((target("avx2")))
+static inline __m256i color_component_apply_avx2(__m256i c, __m256i scale, __m256i inverse_alpha,
+                                                 __m256i weighted_target, int gamma) {
+    c = _mm256_srli_epi16(_mm256_mullo_epi16(c, scale), 8);
+    c = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(c, inverse_alpha), weighted_target), 8);
+    if (gamma) {
+        c = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(c, c), _mm256_set1_epi32(255)), 8);
+    }
+    return c;
+}
+
+__attribute__((target("avx2")))
+void color_kernel_avx2(char *base_address, int count, const ColorKernelOp *op) {
+    __m256i scale = _mm256_set1_epi32(op->scale);
+    __m256i inverse_alpha = _mm256_set1_epi32(256 - op->alpha);
+    __m256i target_r = _mm256_set1_epi32(op->target[0] * op->alpha);
+    __m256i target_g = _mm256_set1_epi32(op->target[1] * op->alpha);
+    __m256i target_b = _mm256_set1_epi32(op->target[2] * op->alpha);
+    __m256i offsets = _mm256_setr_epi32(0, DEVICE_STRIDE, 2 * DEVICE_STRIDE, 3 * DEVICE_STRIDE, 4 * DEVICE_STRIDE,
+                                        5 * DEVICE_STRIDE, 6 * DEVICE_STRIDE, 7 * DEVICE_STRIDE);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        char *device = base_address + (size_t)i * DEVICE_STRIDE;
+        __m256i lanes = _mm256_i32gather_epi32((const int *)(device + COLOR_LANE_OFFSET), offsets, 1);
+
+        __m256i r5 = _mm256_and_si256(_mm256_srli_epi32(lanes, FIELD_red_SHIFT), _mm256_set1_epi32(0x1F));
+        __m256i g6 = _mm256_and_si256(_mm256_srli_epi32(lanes, FIELD_green_SHIFT), _mm256_set1_epi32(0x3F));
+        __m256i r = _mm256_or_si256(_mm256_slli_epi32(r5, 3), _mm256_srli_epi32(r5, 2));
+        __m256i g = _mm256_or_si256(_mm256_slli_epi32(g6, 2), _mm256_srli_epi32(g6, 4));
+        __m256i b = _mm256_and_si256(_mm256_srli_epi32(lanes, 16 + FIELD_blue_SHIFT), _mm256_set1_epi32(0xFF));
+
+        r = color_component_apply_avx2(r, scale, inverse_alpha, target_r, op->gamma);
+        g = color_component_apply_avx2(g, scale, inverse_alpha, target_g, op->gamma);
+        b = color_component_apply_avx2(b, scale, inverse_alpha, target_b, op->gamma);
+
+        __m256i packed = _mm256_or_si256(_mm256_slli_epi32(_mm256_srli_epi32(r, 3), FIELD_red_SHIFT),
+                                         _mm256_slli_epi32(_mm256_srli_epi32(g, 2), FIELD_green_SHIFT));
+        packed = _mm256_or_si256(packed, _mm256_slli_epi32(b, 16 + FIELD_blue_SHIFT));
+        lanes = _mm256_or_si256(_mm256_and_si256(lanes, _mm256_set1_epi32((int)COLOR_LANE_KEEP)), packed);
+
+        color_lanes_store_sse2(device, _mm256_castsi256_si128(lanes));
+        color_lanes_store_sse2(device + 4 * DEVICE_STRIDE, _mm256_extracti128_si256(lanes, 1));
+    }
+    color_kernel_sse2(base_address + (size_t)i * DEVICE_STRIDE, count - i, op);
+}
+#endif
+
+// RENDERIZAÇÃO
+// Só a thread de renderização chama o ncurses. As demais threads (menus,
+// entrada, animações) publicam pedidos de desenho em uma fila; a cada quadro
+// a thread aplica os pedidos pendentes em uma grade de caracteres, compara
+// com o que já está na tela e envia apenas os trechos alterados, com um
+// único wrefresh por quadro. Pedidos que não mudam a tela (ex.: apagar uma
+// linha já vazia) não geram nenhum byte para o terminal.
+#define RENDER_QUEUE_SIZE 1024
+#define RENDER_TEXT_MAX 64
+#define RENDER_MAX_ROWS 64
+#define RENDER_MAX_COLS 128
+#define RENDER_FPS 60
+
+typedef struct {
+    short row;
+    short column;
+    short length;
+    char text[RENDER_TEXT_MAX];
+} DrawRequest;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_t thread;
+    int running;
+    int started;
+    int direct;           // 1 = desenha cada pedido na hora (modo de comparação)
+    FILE *terminal;       // Saída do ncurses
+    int drain_fd;         // Leitura do pipe que substitui o terminal (benchmark)
+    pthread_t drain;
+    SCREEN *screen;
+    int rows;
+    int columns;
+    DrawRequest queue[RENDER_QUEUE_SIZE];
+    int queue_head;
+    int queue_count;
+    char back[RENDER_MAX_ROWS][RENDER_MAX_COLS];  // Estado desejado
+    char front[RENDER_MAX_ROWS][RENDER_MAX_COLS]; // Estado já enviado à tela
+    long requests;
+    long frames;
+    long cells;
+    long bytes;
+} Renderer;
+
+Renderer renderer = {.lock = PTHREAD_MUTEX_INITIALIZER, .ready = PTHREAD_COND_INITIALIZER};
+
+// Leitor do terminal descartável usado no benchmark: conta os bytes que o
+// ncurses enviaria ao terminal
+void *render_drain_thread(void *arg) {
+    Renderer *render = (Renderer *)arg;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(render->drain_fd, buffer, sizeof(buffer))) > 0) {
+        __atomic_fetch_add(&render->bytes, (long)count, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+// Aplica um pedido à grade desejada, recortando na área interna da borda
+void render_apply(Renderer *render, const DrawRequest *request) {
+    if (request->row < 1 || request->row >= render->rows - 1) {
+        return;
+    }
+    for (int i = 0; i < request->length; i++) {
+        int column = request->column + i;
+        if (column >= 1 && column < render->columns - 1) {
+            render->back[request->row][column] = request->text[i];
+        }
+    }
+}
+
+// Envia ao ncurses os trechos da grade que diferem da tela
+void render_flush(Renderer *render, char frame[RENDER_MAX_ROWS][RENDER_MAX_COLS]) {
+    int changed = 0;
+    for (int row = 1; row < render->rows - 1; row++) {
+        int column = 1;
+        while (column < render->columns - 1) {
+            if (frame[row][column] == render->front[row][column]) {
+                column++;
+                continue;
+            }
+            int start = column;
+            while (column < render->columns - 1 && frame[row][column] != render->front[row][column]) {
+                column++;
+            }
+            // Não divide caracteres UTF-8 de vários bytes
+            while (start > 1 && (frame[row][start] & 0xC0) == 0x80) {
+                start--;
+            }
+            while (column < render->columns - 1 && (frame[row][column] & 0xC0) == 0x80) {
+                column++;
+            }
+            mvwaddnstr(painel, row, start, &frame[row][start], column - start);
+            memcpy(&render->front[row][start], &frame[row][start], column - start);
+            render->cells += column - start;
+            changed = 1;
+        }
+    }
+    if (changed) {
+        wrefresh(painel);
+        render->frames++;
+    }
+}
+
+void *render_thread(void *arg) {
+    Renderer *render = (Renderer *)arg;
+    static char frame[RENDER_MAX_ROWS][RENDER_MAX_COLS];
+    long period = 1000000000L / RENDER_FPS;
+    long last_frame = 0;
+
+    pthread_mutex_lock(&render->lock);
+    while (render->running) {
+        // Sem pedidos a thread dorme até o próximo: a tela parada não custa CPU
+        while (render->running && render->queue_count == 0) {
+            pthread_cond_wait(&render->ready, &render->lock);
+        }
+
+        // Espera o instante do quadro seguinte, juntando os pedidos que chegarem até lá
+        long deadline = last_frame + period;
+        struct timespec wake = {deadline / 1000000000L, deadline % 1000000000L};
+        while (render->running && monotonic_ns() < deadline &&
+               pthread_cond_timedwait(&render->ready, &render->lock, &wake) != ETIMEDOUT) {
+        }
+
+        // Junta todos os pedidos desde o último quadro
+        while (render->queue_count > 0) {
+            render_apply(render, &render->queue[render->queue_head]);
+            render->queue_head = (render->queue_head + 1) % RENDER_QUEUE_SIZE;
+            render->queue_count--;
+        }
+        memcpy(frame, render->back, sizeof(frame));
+        pthread_mutex_unlock(&render->lock);
+
+        last_frame = monotonic_ns();
+        render_flush(render, frame);
+        pthread_mutex_lock(&render->lock);
+    }
+    pthread_mutex_unlock(&render->lock);
+    return NULL;
+}
+
+// Fecha o pipe do terminal descartado e espera a thread que o esvazia
+static void render_close_drain(Renderer *render) {
+    if (render->drain_fd == -1) {
+        return;
+    }
+    fclose(render->terminal);
+    pthread_join(render->drain, NULL);
+    close(render->drain_fd);
+    render->drain_fd = -1;
+    render->terminal = stdout;
+}
+
+// Inicializa o ncurses e a thread de renderização (apenas na primeira
+// chamada). Se discard_output for 1, a saída vai para um pipe cujos bytes
+// são só contados (usado no benchmark).
+int render_start(Renderer *render, int discard_output, int direct) {
+    if (render->started) {
+        return 0;
+    }
+    render->direct = direct;
+    render->terminal = stdout;
+    render->drain_fd = -1;
+    if (discard_output) {
+        int pipe_fds[2];
+        if (pipe(pipe_fds) == -1) {
+            perror("Erro ao criar pipe do terminal");
+            return -1;
+        }
+        FILE *terminal = fdopen(pipe_fds[1], "w");
+        if (terminal == NULL) {
+            perror("Erro ao abrir o pipe do terminal");
+            close(pipe_fds[0]);
+            close(pipe_fds[1]);
+            return -1;
+        }
+        render->drain_fd = pipe_fds[0];
+        int error = pthread_create(&render->drain, NULL, render_drain_thread, render);
+        if (error != 0) {
+            fprintf(stderr, "Erro ao criar a thread do terminal: %s\n", strerror(error));
+            fclose(terminal);
+            close(pipe_fds[0]);
+            render->drain_fd = -1;
+            return -1;
+        }
+        render->terminal = terminal;
+    }
+    const char *terminal_type = getenv("TERM") != NULL ? getenv("TERM") : "xterm";
+    render->screen = newterm(terminal_type, render->terminal, stdin);
+    if (render->screen == NULL) {
+        fprintf(stderr, "Erro: não foi possível inicializar o terminal %s\n", terminal_type);
+        render_close_drain(render);
+        return -1;
+    }
+    set_term(render->screen);
+
+    // Desativa o modo de eco de caracteres digitados
+    noecho();
+    keypad(stdscr, TRUE);
+
+    // Cria a janela do painel, limitada ao tamanho da tela (mínimo 1x1)
+    render->rows = LINES - 6 < 50 ? LINES - 6 : 50;
+    render->columns = COLS - 6 < 50 ? COLS - 6 : 50;
+    if (render->rows > RENDER_MAX_ROWS) {
+        render->rows = RENDER_MAX_ROWS;
+    }
+    if (render->columns > RENDER_MAX_COLS) {
+        render->columns = RENDER_MAX_COLS;
+    }
+    if (render->rows < 1) {
+        render->rows = 1;
+    }
+    if (render->columns < 1) {
+        render->columns = 1;
+    }
+    painel = newwin(render->rows, render->columns, 6, 6);
+    if (painel == NULL) {
+        fprintf(stderr, "Erro: terminal pequeno demais para o painel (%dx%d)\n", COLS, LINES);
+        endwin();
+        delscreen(render->screen);
+        render_close_drain(render);
+        return -1;
+    }
+    box(painel, 0, 0); // Adiciona uma borda à janela
+    wrefresh(painel);
+
+    memset(render->back, ' ', sizeof(render->back));
+    memset(render->front, ' ', sizeof(render->front));
+    render->queue_head = render->queue_count = 0;
+    render->requests = render->frames = render->cells = render->bytes = 0;
+    render->running = 1;
+    if (!direct) {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&render->ready, &attr);
+        pthread_condattr_destroy(&attr);
+        int error = pthread_create(&render->thread, NULL, render_thread, render);
+        if (error != 0) {
+            fprintf(stderr, "Erro ao criar a thread de renderização: %s\n", strerror(error));
+            render->running = 0;
+            delwin(painel);
+            endwin();
+            delscreen(render->screen);
+            render_close_drain(render);
+            return -1;
+        }
+    }
+    pthread_mutex_lock(&render->lock);
+    render->started = 1;
+    pthread_mutex_unlock(&render->lock);
+    return 0;
+}
+
+void render_stop(Renderer *render) {
+    if (!render->started) {
+        return;
+    }
+    pthread_mutex_lock(&render->lock);
+    render->running = 0;
+    pthread_cond_signal(&render->ready);
+    pthread_mutex_unlock(&render->lock);
+    if (!render->direct) {
+        pthread_join(render->thread, NULL);
+    }
+    pthread_mutex_lock(&render->lock);
+    render->started = 0;
+    pthread_mutex_unlock(&render->lock);
+    delwin(painel);
+    endwin();
+    delscreen(render->screen);
+    render_close_drain(render);
+}
+
+// Publica um texto na posição indicada do painel
+void render_text(int row, int column, const char *text) {
+    Renderer *render = &renderer;
+    int length = strlen(text);
+    if (length > RENDER_TEXT_MAX) {
+        length = RENDER_TEXT_MAX;
+    }
+
+    pthread_mutex_lock(&render->lock);
+    if (!render->started) {
+        pthread_mutex_unlock(&render->lock);
+        return;
+    }
+    render->requests++;
+    DrawRequest request = {.row = row, .column = column, .length = length};
+    memcpy(request.text, text, length);
+
+    if (render->direct) {
+        // Modo de comparação: desenha e atualiza a tela a cada pedido, como
+        // os menus faziam antes da fila
+        render_apply(render, &request);
+        if (row >= 1 && row < render->rows - 1) {
+            memcpy(render->front[row], render->back[row], RENDER_MAX_COLS);
+        }
+        mvwaddnstr(painel, row, column, request.text, length);
+        box(painel, 0, 0);
+        wrefresh(painel);
+        render->frames++;
+        render->cells += length;
+    } else if (render->queue_count == RENDER_QUEUE_SIZE) {
+        // Fila cheia: o próprio produtor junta o pedido à grade desejada
+        render_apply(render, &request);
+    } else {
+        render->queue[(render->queue_head + render->queue_count) % RENDER_QUEUE_SIZE] = request;
+        if (render->queue_count++ == 0) {
+            pthread_cond_signal(&render->ready);
+        }
+    }
+    pthread_mutex_unlock(&render->lock);
+}
+
+// Apaga length colunas a partir da posição indicada
+void render_clear(int row, int column, int length) {
+    char blank[RENDER_TEXT_MAX + 1];
+    if (length > RENDER_TEXT_MAX) {
+        length = RENDER_TEXT_MAX;
+    }
+    memset(blank, ' ', length);
+    blank[length] = '\0';
+    render_text(row, column, blank);
+}
+
+// MENUS VALIDOS PARA BAIXO
+
+void exibir_menu_painel_led(void) {
+    render_text(1, 2, "Seja bem vindo ao sistema de LED.");
+    render_text(2, 2, "Digite 0 para ligar ou desligar o LED");
+    render_text(3, 2, "Digite 1 para manipular as cores");
+    render_text(4, 2, "Digite 2 para controlar o nível da bateria");
+    render_text(5, 2, "Digite 3 para controlar o nível da temperatura");
+}
+
+void exibir_menu_liga_led(void){
+    render_text(1, 2, "Seja bem vindo ao sistema de LED.");
+    render_text(2, 2, "Digite 0 para desligar o LED");
+    render_text(3, 2, "Digite 1 para ligar o LED");
+}
+
+// Função para exibir o menu de manipulação das cores
+void exibir_menu_cores(void) {
+    render_text(1, 2, "Escolha qual componente você deseja manipular:");
+    render_text(2, 2, "R - 1");
+    render_text(3, 2, "G - 2");
+    render_text(4, 2, "B - 3");
+}
+
+void exibir_menu_bateria(void){
+    render_text(1, 2, "Defina o nível de bateria (0, 1, 2 ou 3): ");
+}
+
+void exibir_menu_temperatura(void){
+    render_text(1, 2, "Defina a temperatura do LED (de 0-1023):");
+}
+
+// Apaga as linhas de menu; linhas que já estão vazias não geram saída
+void limpar_linhas_painel(void){
+    for (int linha = 1; linha <= 7; linha++) {
+        render_clear(linha, 2, 47);
+    }
+}
+// Para implementar:
+// se o valor for 0, apresente o menu de controle do LED
+
+// ANIMAÇÕES
+// Um único escalonador (uma thread) executa todas as animações. Cada animação
+// tem o seu período; o escalonador mantém um heap ordenado pelo próximo prazo
+// (CLOCK_MONOTONIC) e dorme até o prazo mais próximo, ou até uma animação
+// nova ser adicionada. Quadros cujo prazo já passou são descartados (e
+// contados) em vez de acumular atraso.
+#define MAX_ANIMATIONS 256
+
+typedef struct Animation {
+    const char *name;
+    long period_ns;                       // Intervalo entre quadros
+    long deadline_ns;                     // Prazo do próximo quadro
+    void (*step)(struct Animation *self); // Desenha um quadro
+    void *state;
+    long frames;
+    long dropped;
+    long total_jitter_ns;                 // Soma dos atrasos em relação ao prazo
+    long max_jitter_ns;
+} Animation;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t thread;
+    int running;
+    int count;
+    Animation *heap[MAX_ANIMATIONS]; // Heap mínimo por deadline_ns
+    Animation *current;              // Quadro em execução, fora do heap
+} AnimationScheduler;
+
+AnimationScheduler animation_scheduler = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+void animation_heap_swap(AnimationScheduler *scheduler, int a, int b) {
+    Animation *tmp = scheduler->heap[a];
+    scheduler->heap[a] = scheduler->heap[b];
+    scheduler->heap[b] = tmp;
+}
+
+void animation_heap_up(AnimationScheduler *scheduler, int i) {
+    while (i > 0 && scheduler->heap[(i - 1) / 2]->deadline_ns > scheduler->heap[i]->deadline_ns) {
+        animation_heap_swap(scheduler, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+void animation_heap_down(AnimationScheduler *scheduler, int i) {
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1, right = 2 * i + 2;
+        if (left < scheduler->count && scheduler->heap[left]->deadline_ns < scheduler->heap[smallest]->deadline_ns) {
+            smallest = left;
+        }
+        if (right < scheduler->count && scheduler->heap[right]->deadline_ns < scheduler->heap[smallest]->deadline_ns) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        animation_heap_swap(scheduler, i, smallest);
+        i = smallest;
+    }
+}
+
+void *animation_scheduler_thread(void *arg) {
+    AnimationScheduler *scheduler = (AnimationScheduler *)arg;
+
+    // Folga mínima de temporizador, para acordar o mais perto possível do prazo
+    prctl(PR_SET_TIMERSLACK, 1UL);
+
+    pthread_mutex_lock(&scheduler->lock);
+    while (scheduler->running) {
+        if (scheduler->count == 0) {
+            pthread_cond_wait(&scheduler->changed, &scheduler->lock);
+            continue;
+        }
+
+        Animation *next = scheduler->heap[0];
+        long now = monotonic_ns();
+        if (now < next->deadline_ns) {
+            struct timespec deadline = {next->deadline_ns / 1000000000L, next->deadline_ns % 1000000000L};
+            pthread_cond_timedwait(&scheduler->changed, &scheduler->lock, &deadline);
+            continue;
+        }
+
+        // Retira a animação do heap e executa o quadro fora do lock, para não
+        // atrasar quem adiciona animações; prazo e contadores só mudam com o lock
+        scheduler->count--;
+        animation_heap_swap(scheduler, 0, scheduler->count);
+        animation_heap_down(scheduler, 0);
+        scheduler->current = next;
+        pthread_mutex_unlock(&scheduler->lock);
+        long jitter = now - next->deadline_ns;
+        next->step(next);
+        long finished = monotonic_ns();
+
+        pthread_mutex_lock(&scheduler->lock);
+        next->frames++;
+        next->total_jitter_ns += jitter;
+        if (jitter > next->max_jitter_ns) {
+            next->max_jitter_ns = jitter;
+        }
+
+        // Próximo prazo; se já passou, os quadros perdidos são descartados
+        next->deadline_ns += next->period_ns;
+        if (next->deadline_ns <= finished) {
+            long missed = (finished - next->deadline_ns) / next->period_ns + 1;
+            next->dropped += missed;
+            next->deadline_ns += missed * next->period_ns;
+        }
+        scheduler->current = NULL;
+        scheduler->heap[scheduler->count] = next;
+        animation_heap_up(scheduler, scheduler->count);
+        scheduler->count++;
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+    return NULL;
+}
+
+// Inicia a thread do escalonador (apenas na primeira chamada)
+int animation_scheduler_start(AnimationScheduler *scheduler) {
+    int result = 0;
+    pthread_mutex_lock(&scheduler->lock);
+    if (!scheduler->running) {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&scheduler->changed, &attr);
+        pthread_condattr_destroy(&attr);
+        scheduler->running = 1;
+        int error = pthread_create(&scheduler->thread, NULL, animation_scheduler_thread, scheduler);
+        if (error != 0) {
+            fprintf(stderr, "Erro ao criar a thread de animação: %s\n", strerror(error));
+            pthread_cond_destroy(&scheduler->changed);
+            scheduler->running = 0;
+            result = -1;
+        }
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+    return result;
+}
+
+void animation_scheduler_stop(AnimationScheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->lock);
+    if (!scheduler->running) {
+        pthread_mutex_unlock(&scheduler->lock);
+        return;
+    }
+    scheduler->running = 0;
+    pthread_cond_signal(&scheduler->changed);
+    pthread_mutex_unlock(&scheduler->lock);
+    pthread_join(scheduler->thread, NULL);
+    scheduler->count = 0;
+}
+
+// Adiciona uma animação com a taxa de quadros indicada
+int animation_add(AnimationScheduler *scheduler, Animation *animation, int frames_per_second) {
+    if (frames_per_second < 1) {
+        fprintf(stderr, "Erro: taxa de quadros da animação deve ser positiva\n");
+        return -1;
+    }
+    pthread_mutex_lock(&scheduler->lock);
+    if (scheduler->count + (scheduler->current != NULL) == MAX_ANIMATIONS) {
+        pthread_mutex_unlock(&scheduler->lock);
+        fprintf(stderr, "Erro: limite de animações atingido\n");
+        return -1;
+    }
+    animation->period_ns = 1000000000L / frames_per_second;
+    animation->deadline_ns = monotonic_ns();
+    animation->frames = animation->dropped = 0;
+    animation->total_jitter_ns = animation->max_jitter_ns = 0;
+    scheduler->heap[scheduler->count] = animation;
+    animation_heap_up(scheduler, scheduler->count);
+    scheduler->count++;
+    pthread_cond_signal(&scheduler->changed);
+    pthread_mutex_unlock(&scheduler->lock);
+    return 0;
+}
+
+// Imprime quadros, descartes e atraso de cada animação
+void animation_scheduler_report(AnimationScheduler *scheduler, FILE *output) {
+    pthread_mutex_lock(&scheduler->lock);
+    fprintf(output, "animation,period_us,frames,dropped,mean_jitter_us,max_jitter_us\n");
+    for (int i = 0; i <= scheduler->count; i++) {
+        Animation *animation = i < scheduler->count ? scheduler->heap[i] : scheduler->current;
+        if (animation == NULL) {
+            continue;
+        }
+        fprintf(output, "%s,%ld,%ld,%ld,%.1f,%.1f\n", animation->name, animation->period_ns / 1000,
+                animation->frames, animation->dropped,
+                animation->frames ? animation->total_jitter_ns / 1000.0 / animation->frames : 0.0,
+                animation->max_jitter_ns / 1000.0);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+// Letreiro: texto que percorre uma linha do painel
+typedef struct {
+    const char *text;
+    int row;
+    int column;   // Deslocamento atual em relação à coluna inicial
+} MarqueeState;
+
+void animation_marquee_step(Animation *self) {
+    MarqueeState *marquee = (MarqueeState *)self->state;
+    int length = strlen(marquee->text);
+    int width = renderer.columns - 4; // Largura do painel, descontando bordas
+
+    render_clear(marquee->row, 2 + marquee->column, length); // Apaga a posição anterior
+    marquee->column++;
+    if (marquee->column > width - length) {
+        marquee->column = 0;
+    }
+    render_text(marquee->row, 2 + marquee->column, marquee->text);
+}
+
+// Ciclo de cores: percorre o círculo de matizes nos registradores do LED
+typedef struct {
+    char *base_address;
+    int hue; // 0-767
+} ColorCycleState;
+
+void animation_color_cycle_step(Animation *self) {
+    ColorCycleState *cycle = (ColorCycleState *)self->state;
+    int phase = cycle->hue / 256, level = cycle->hue % 256;
+    int r = phase == 0 ? 255 - level : (phase == 2 ? level : 0);
+    int g = phase == 0 ? level : (phase == 1 ? 255 - level : 0);
+    int b = phase == 1 ? level : (phase == 2 ? 255 - level : 0);
+    set_color_rgb(cycle->base_address, r, g, b, NULL);
+    cycle->hue = (cycle->hue + 8) % 768;
+}
+
+// Piscar: liga e desliga o LED segundo um padrão de bits (bit 0 primeiro)
+typedef struct {
+    char *base_address;
+    unsigned int pattern;
+    int length;
+    int position;
+} BlinkState;
+
+void animation_blink_step(Animation *self) {
+    BlinkState *blink = (BlinkState *)self->state;
+    int length = __atomic_load_n(&blink->length, __ATOMIC_ACQUIRE);
+    if (length == 0) {
+        return; // Padrão vazio: parado
+    }
+    field_store_led_status(blink->base_address, (blink->pattern >> (blink->position % length)) & 1);
+    blink->position = (blink->position + 1) % length;
+}
+
+// Texto em rolagem nos registradores de dados
+void animation_text_stream_step(Animation *self) {
+    text_stream_step((TextStream *)self->state);
+}
+
+// SESSÃO DO PAINEL
+// Uma única sessão de interface por execução: o ncurses, a thread de
+// renderização, o escalonador de animações e o observador de alterações são
+// iniciados uma vez. Um laço com poll espera ao mesmo tempo a entrada
+// (linhas da entrada padrão), o temporizador das mensagens de confirmação e
+// as alterações dos registradores, e cada evento faz uma transição na
+// máquina de estados dos menus. Nada bloqueia: uma linha digitada durante a
+// confirmação passa direto para o submenu.
+#define UI_CONFIRM_MS 1000 // Tempo em que a confirmação fica na tela
+#define UI_STATUS_ROW 14
+#define UI_LINE_MAX 100
+
+typedef enum {
+    UI_MAIN,        // Menu principal
+    UI_CONFIRM,     // Confirmação da escolha, até o temporizador ou a próxima linha
+    UI_LED,
+    UI_COLOR,
+    UI_BATTERY,
+    UI_TEMPERATURE,
+    UI_WAIT_ENTER,  // Resultado na tela até o usuário pressionar Enter
+} UiState;
+
+typedef struct {
+    char *base_address;
+    UiState state;
+    UiState confirm_next;   // Submenu mostrado ao fim da confirmação
+    int input_fd;
+    int timer_fd;
+    RegisterWatcher watcher;
+    char line[UI_LINE_MAX];
+    int line_length;
+    long lines;             // Linhas processadas
+    long *processed_ns;     // Instante em que cada linha foi processada (medição, opcional)
+    long processed_capacity;
+} UiSession;
+
+// Liga (ms > 0) ou desliga o temporizador da confirmação
+void ui_arm_timer(UiSession *ui, int ms) {
+    struct itimerspec timer = {{0, 0}, {ms / 1000, (ms % 1000) * 1000000L}};
+    timerfd_settime(ui->timer_fd, 0, &timer, NULL);
+}
+
+// Linha de estado com os valores atuais, atualizada a cada alteração
+void ui_show_status(UiSession *ui) {
+    RegisterSnapshot snapshot;
+    char status[RENDER_TEXT_MAX];
+    registers_snapshot(ui->base_address, &snapshot);
+    snprintf(status, sizeof(status), "LED %d  RGB %3d %3d %3d  bat %d  temp %4d",
+             field_get_led_status(snapshot.regs), field_get_red(snapshot.regs) << 3,
+             field_get_green(snapshot.regs) << 2, field_get_blue(snapshot.regs),
+             field_get_battery_level(snapshot.regs), field_get_temperature(snapshot.regs) * 10);
+    render_clear(UI_STATUS_ROW, 2, 44);
+    render_text(UI_STATUS_ROW, 2, status);
+}
+
+void ui_show_main(UiSession *ui) {
+    limpar_linhas_painel();
+    exibir_menu_painel_led();
+    ui->state = UI_MAIN;
+}
+
+// Mostra o submenu escolhido no menu principal
+void ui_show_submenu(UiSession *ui, UiState submenu) {
+    ui_arm_timer(ui, 0);
+    limpar_linhas_painel();
+    switch (submenu) {
+    case UI_LED:
+        exibir_menu_liga_led();
+        break;
+    case UI_COLOR:
+        exibir_menu_cores();
+        break;
+    case UI_BATTERY:
+        exibir_menu_bateria();
+        break;
+    default:
+        exibir_menu_temperatura();
+        break;
+    }
+    ui->state = submenu;
+}
+
+// Aplica a linha digitada no submenu atual e espera o Enter
+void ui_submenu_input(UiSession *ui, const char *entrada) {
+    char *base_address = ui->base_address;
+    int opcao = atoi(entrada);
+
+    switch (ui->state) {
+    case UI_LED:
+        limpar_linhas_painel();
+        if (opcao == 0 || opcao == 1) {
+            render_text(7, 2, "Ligar ou desligar o LED");
+            render_text(8, 2, entrada);
+            set_led_status(base_address, opcao);
+        } else {
+            render_text(7, 2, "Entrada inválida");
+        }
+        break;
+    case UI_COLOR:
+        if (opcao == 1) {
+            set_valor_R(base_address, opcao);
+            render_text(7, 2, "VERMELHO");
+        } else if (opcao == 2) {
+            set_valor_G(base_address, opcao);
+            render_text(7, 2, "VERDE");
+        } else if (opcao == 3) {
+            set_intensity_B(base_address, opcao);
+            render_text(7, 2, "AZUL");
+        }
+        limpar_linhas_painel();
+        if (opcao >= 1 && opcao <= 3) {
+            render_text(8, 2, entrada);
+        } else {
+            render_text(7, 2, "Entrada inválida");
+        }
+        break;
+    case UI_BATTERY:
+        limpar_linhas_painel();
+        if (opcao >= 0 && opcao <= 3) {
+            render_text(7, 2, "Definicao do nivel de bateria");
+            render_text(8, 2, entrada);
+            set_battery_level(base_address, opcao);
+        } else {
+            render_text(7, 2, "Entrada inválida");
+        }
+        break;
+    default:
+        limpar_linhas_painel();
+        if (opcao <= 1033) {
+            render_text(7, 2, "Temperatura definida");
+            render_text(8, 2, entrada);
+            set_led_temperature(base_address, opcao);
+        } else {
+            render_text(7, 2, "Entrada inválida");
+        }
+        break;
+    }
+    ui->state = UI_WAIT_ENTER;
+}
+
+// Transição da máquina de estados para uma linha completa
+void ui_handle_line(UiSession *ui, char *entrada) {
+    static const UiState submenus[] = {UI_LED, UI_COLOR, UI_BATTERY, UI_TEMPERATURE};
+    static const char *confirmations[] = {
+        "Funcionou essa merda", "Funcionou essa merda da cor",
+        "Funcionou essa merda da bateria", "Funcionou essa merda da temperatura",
+    };
+
+    switch (ui->state) {
+    case UI_MAIN: {
+        render_text(6, 2, entrada);
+        int opcao = atoi(entrada);
+        if (entrada[0] != '\0' && opcao >= 0 && opcao <= 3) {
+            render_clear(6, 2, 32);
+            render_text(7, 2, confirmations[opcao]);
+            ui->confirm_next = submenus[opcao];
+            ui->state = UI_CONFIRM;
+            ui_arm_timer(ui, UI_CONFIRM_MS);
+        } else {
+            ui->state = UI_WAIT_ENTER;
+        }
+        break;
+    }
+    case UI_CONFIRM:
+        // Quem já digitou a resposta não espera a confirmação terminar
+        ui_show_submenu(ui, ui->confirm_next);
+        render_text(6, 2, entrada);
+        ui_submenu_input(ui, entrada);
+        break;
+    case UI_WAIT_ENTER:
+        render_text(9, 2, entrada);
+        ui_show_main(ui);
+        break;
+    default:
+        render_text(6, 2, entrada);
+        ui_submenu_input(ui, entrada);
+        break;
+    }
+
+    if (ui->processed_ns != NULL && ui->lines < ui->processed_capacity) {
+        ui->processed_ns[ui->lines] = monotonic_ns();
+    }
+    ui->lines++;
+}
+
+// Lê o que houver na entrada e processa as linhas completas. Retorna -1 no fim da entrada.
+int ui_read_input(UiSession *ui) {
+    char buffer[256];
+    ssize_t count = read(ui->input_fd, buffer, sizeof(buffer));
+    if (count == 0) {
+        return -1;
+    }
+    if (count < 0) {
+        return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    }
+    for (ssize_t i = 0; i < count; i++) {
+        if (buffer[i] == '\n') {
+            ui->line[ui->line_length] = '\0';
+            ui->line[strcspn(ui->line, "\r")] = '\0';
+            ui_handle_line(ui, ui->line);
+            ui->line_length = 0;
+        } else if (ui->line_length < UI_LINE_MAX - 1) {
+            ui->line[ui->line_length++] = buffer[i];
+        }
+    }
+    return 0;
+}
+
+// Inicia tudo o que a sessão usa; o custo é pago uma única vez
+int ui_session_start(UiSession *ui, char *base_address, int input_fd, int discard_output) {
+    ui->base_address = base_address;
+    ui->input_fd = input_fd;
+    ui->line_length = 0;
+    ui->lines = 0;
+
+    // Os setters não podem imprimir na saída padrão enquanto o painel está ativo
+    if (render_start(&renderer, discard_output, 0) == -1) {
+        return -1;
+    }
+    registers_verbose = 0;
+    ui->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (ui->timer_fd == -1 || register_watcher_start(&ui->watcher, base_address) == -1) {
+        perror("Erro ao iniciar a sessão do painel");
+        if (ui->timer_fd != -1) {
+            close(ui->timer_fd);
+        }
+        render_stop(&renderer);
+        registers_verbose = 1;
+        return -1;
+    }
+
+    // Animação "hello world" na linha 12 do painel
+    static MarqueeState hello_world = {"hello world", 12, 0};
+    static Animation hello_world_animation = {.name = "hello_world", .step = animation_marquee_step, .state = &hello_world};
+    hello_world.column = 0;
+    if (animation_scheduler_start(&animation_scheduler) == -1) {
+        register_watcher_stop(&ui->watcher);
+        close(ui->timer_fd);
+        render_stop(&renderer);
+        registers_verbose = 1;
+        return -1;
+    }
+    animation_add(&animation_scheduler, &hello_world_animation, 10);
+
+    ui_show_main(ui);
+    ui_show_status(ui);
+    return 0;
+}
+
+void ui_session_stop(UiSession *ui) {
+    animation_scheduler_stop(&animation_scheduler);
+    register_watcher_stop(&ui->watcher);
+    close(ui->timer_fd);
+    render_stop(&renderer);
+    registers_verbose = 1;
+}
+
+// Laço de eventos da sessão, até o fim da entrada
+int ui_session_run(UiSession *ui) {
+    struct pollfd fds[3] = {
+        {ui->input_fd, POLLIN, 0},
+        {ui->timer_fd, POLLIN, 0},
+        {ui->watcher.event_fd, POLLIN, 0},
+    };
+
+    for (;;) {
+        if (poll(fds, 3, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Erro no poll");
+            return -1;
+        }
+        if (fds[1].revents & POLLIN) {
+            unsigned long long expirations;
+            if (read(ui->timer_fd, &expirations, sizeof(expirations)) > 0 && ui->state == UI_CONFIRM) {
+                ui_show_submenu(ui, ui->confirm_next);
+            }
+        }
+        if (fds[2].revents & POLLIN) {
+            unsigned long long changes;
+            if (read(ui->watcher.event_fd, &changes, sizeof(changes)) > 0) {
+                ui_show_status(ui);
+            }
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (ui_read_input(ui) == -1) {
+                return 0;
+            }
+        }
+    }
+}
+
+// MODO DE SCRIPT (SEM NCURSES)
+// Lê comandos, um por linha, da entrada padrão ou de um arquivo e os aplica
+// diretamente pelos setters:
+//   led 0|1             liga ou desliga o LED
+//   rgb R G B           define a cor completa (0-255 cada) em um único commit
+//   color R G B         como rgb, com correção de gama (cor percebida)
+//   red|green|blue N    define a intensidade de um componente (0-255)
+//   battery N           nível de bateria (0-3)
+//   temp N              temperatura do LED (0-1023)
+//   text MENSAGEM       mensagem nos registradores R4 a R15
+//   textmode MODO       codificação do texto: ascii, packed ou glyph
+//   snapshot            captura um snapshot da imagem e imprime o seu id
+//   diff A B            lista os registradores e campos alterados entre dois snapshots
+//   restore A           restaura a imagem para o snapshot A
+//   stats               imprime os contadores da instrumentação
+//   scenes ARQUIVO      carrega e compila as cenas do arquivo
+//   scene NOME          aplica uma cena carregada
+// Linhas vazias e iniciadas por '#' são ignoradas.
+
+SnapshotStore script_snapshots = {NULL}; // Snapshots de registers.bin feitos pelo script
+SceneLibrary script_scenes = {NULL};     // Cenas carregadas pelo script
+
+// Executa um comando. Retorna 0 em caso de sucesso e -1 se o comando for inválido.
+int script_execute_line(char *base_address, char *line) {
+    char command[16];
+    char path[256];
+    int a, b, c, consumed = 0;
+
+    while (isspace((unsigned char)*line)) {
+        line++;
+    }
+    if (*line == '\0' || *line == '#') {
+        return 0;
+    }
+    if (sscanf(line, "%15s%n", command, &consumed) != 1) {
+        return -1;
+    }
+    char *args = line + consumed;
+
+    if (strcmp(command, "led") == 0 && sscanf(args, "%d", &a) == 1) {
+        if (a != 0 && a != 1) {
+            return -1;
+        }
+        set_led_status(base_address, a);
+    } else if (strcmp(command, "rgb") == 0 && sscanf(args, "%d %d %d", &a, &b, &c) == 3) {
+        return set_color_rgb(base_address, a, b, c, NULL);
+    } else if (strcmp(command, "color") == 0 && sscanf(args, "%d %d %d", &a, &b, &c) == 3) {
+        return set_color_rgb_gamma(base_address, a, b, c, NULL);
+    } else if (strcmp(command, "red") == 0 && sscanf(args, "%d", &a) == 1) {
+        set_intensity_R(base_address, a);
+    } else if (strcmp(command, "green") == 0 && sscanf(args, "%d", &a) == 1) {
+        set_intensity_G(base_address, a);
+    } else if (strcmp(command, "blue") == 0 && sscanf(args, "%d", &a) == 1) {
+        set_intensity_B(base_address, a);
+    } else if (strcmp(command, "battery") == 0 && sscanf(args, "%d", &a) == 1) {
+        set_battery_level(base_address, a);
+    } else if (strcmp(command, "temp") == 0 && sscanf(args, "%d", &a) == 1) {
+        set_led_temperature(base_address, a);
+    } else if (strcmp(command, "text") == 0) {
+        while (*args == ' ' || *args == '\t') {
+            args++;
+        }
+        args[strcspn(args, "\r\n")] = '\0';
+        write_message_registers(base_address, args);
+    } else if (strcmp(command, "textmode") == 0 && (a = text_encoding_parse(args)) != -1) {
+        return set_text_encoding(base_address, a);
+    } else if (strcmp(command, "snapshot") == 0) {
+        int id;
+        if (script_snapshots.base_address != base_address) {
+            id = snapshot_store_init(&script_snapshots, base_address, FILE_SIZE, 1);
+        } else {
+            id = snapshot_capture(&script_snapshots, 1);
+        }
+        if (id == -1) {
+            return -1;
+        }
+        printf("snapshot %d\n", id);
+    } else if (strcmp(command, "diff") == 0 && sscanf(args, "%d %d", &a, &b) == 2) {
+        long changed = snapshot_diff(&script_snapshots, a, b, stdout);
+        if (changed == -1) {
+            return -1;
+        }
+        printf("%ld palavras alteradas entre os snapshots %d e %d\n", changed, a, b);
+    } else if (strcmp(command, "restore") == 0 && sscanf(args, "%d", &a) == 1) {
+        if (snapshot_restore(&script_snapshots, a) == -1) {
+            return -1;
+        }
+    } else if (strcmp(command, "stats") == 0) {
+        registers_stats_dump(stdout);
+    } else if (strcmp(command, "scenes") == 0 && sscanf(args, "%255s", path) == 1) {
+        int loaded = scene_library_load(&script_scenes, path);
+        if (loaded == -1) {
+            return -1;
+        }
+        printf("%d cenas carregadas de %s\n", loaded, path);
+    } else if (strcmp(command, "scene") == 0 && sscanf(args, "%31s", path) == 1) {
+        const Scene *scene = scene_find(&script_scenes, path);
+        if (scene == NULL) {
+            fprintf(stderr, "Erro: cena desconhecida: %s\n", path);
+            return -1;
+        }
+        scene_apply(base_address, scene);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Executa todos os comandos do arquivo (ou da entrada padrão se path for NULL
+// ou "-") e informa a taxa sustentada de comandos em stderr
+int run_script(char *base_address, const char *path) {
+    FILE *input = stdin;
+    if (path != NULL && strcmp(path, "-") != 0) {
+        input = fopen(path, "r");
+        if (input == NULL) {
+            perror("Erro ao abrir o script");
+            return -1;
+        }
+    }
+
+    int previous_verbose = registers_verbose;
+    registers_verbose = 0;
+
+    char line[256];
+    long line_number = 0;
+    long executed = 0;
+    long errors = 0;
+    double start = monotonic_seconds();
+
+    while (fgets(line, sizeof(line), input) != NULL) {
+        line_number++;
+        if (script_execute_line(base_address, line) == -1) {
+            fprintf(stderr, "Erro: comando inválido na linha %ld: %s", line_number, line);
+            errors++;
+        } else {
+            executed++;
+        }
+    }
+
+    double elapsed = monotonic_seconds() - start;
+    registers_verbose = previous_verbose;
+    if (input != stdin) {
+        fclose(input);
+    }
+
+    fprintf(stderr, "%ld comandos em %.3f s (%.0f comandos/s), %ld erros\n",
+            executed, elapsed, elapsed > 0 ? executed / elapsed : 0.0, errors);
+    return errors == 0 ? 0 : -1;
+}
+
+// MOTOR DE REGRAS
+// Regras reagem às escritas nos campos do mapa de registradores, uma por linha:
+//   temperature > 80 -> rgb 255 0 0
+//   battery_level == 0 -> blink 0x5 4
+//   battery_level >= 1 and led_status == 1 -> noblink
+// Cada condição compara o valor do campo como ele está no registrador
+// (temperature em dezenas de graus, como em R3) usando <, <=, >, >=, == ou !=,
+// e as condições são ligadas por "and". A ação é um comando do modo de
+// script que escreve campos (led, rgb, color, red, green, blue, battery,
+// temp, text, textmode, scene), "blink PADRAO [BITS]" (pisca o LED segundo o padrão,
+// um bit a cada 250 ms) ou "noblink". Uma regra dispara quando passa a ser
+// verdadeira, e não de novo enquanto continuar verdadeira.
+//
+// As condições são compiladas em um índice por campo: limites (valor >= k,
+// possivelmente negado) e igualdades (valor == k, possivelmente negada),
+// cada grupo ordenado por k. Quando um campo muda de a para b, só são
+// visitadas as condições cujo resultado muda: limites com k em
+// (min(a, b), max(a, b)] e igualdades com k igual a a ou b, achados por busca
+// binária. Cada regra conta as suas condições verdadeiras e dispara quando a
+// contagem chega ao total.
+//
+// A reavaliação roda ao fim de cada seção de escrita deste processo (gancho
+// em seq_write_end), comparando R0-R15 com a última imagem avaliada. As
+// ações não reentram no motor: o que elas escrevem é avaliado na rodada
+// seguinte, até RULE_MAX_ROUNDS rodadas por escrita.
+#define RULE_MAX_CONDITIONS 4
+#define RULE_ACTION_MAX 64
+#define RULE_MAX_ROUNDS 16
+#define RULE_BLINK_FPS 4
+
+enum { RULE_THRESHOLD, RULE_EQUAL };
+enum { RULE_ACTION_SCRIPT, RULE_ACTION_BLINK, RULE_ACTION_NOBLINK };
+
+typedef struct {
+    int field;        // Índice em register_fields
+    int kind;         // RULE_THRESHOLD (valor >= key) ou RULE_EQUAL (valor == key)
+    int negate;
+    unsigned int key;
+    int rule;
+} RuleCondition;
+
+typedef struct {
+    int conditions; // Total de condições
+    int satisfied;  // Condições verdadeiras na última imagem avaliada
+    int queued;     // Já está na fila de disparo da rodada
+    long fired;
+    int action_kind;           // RULE_ACTION_*
+    unsigned int blink_pattern;
+    int blink_bits;
+    char action[RULE_ACTION_MAX];
+} Rule;
+
+typedef struct {
+    char *base_address;
+    pthread_mutex_t lock;
+    unsigned short values[REGISTER_COUNT];  // Última imagem avaliada
+    unsigned short watched[REGISTER_COUNT]; // Bits de campos com alguma condição
+    Rule *rules;
+    int count;
+    int capacity;
+    RuleCondition *conditions; // Na ordem em que foram lidas
+    int condition_count;
+    int condition_capacity;
+    RuleCondition *index;      // Agrupadas por campo e tipo, ordenadas por key
+    int index_start[REGISTER_FIELD_COUNT * 2 + 1]; // Grupo 2 * campo + tipo
+    int *queue;                // Regras que passaram a ser verdadeiras na rodada
+    int queue_count;
+    long evaluations;          // Condições visitadas
+    long fires;
+    FILE *log;                 // Se não for NULL, recebe uma linha por disparo
+    BlinkState blink;
+    Animation blink_animation;
+} RuleEngine;
+
+RuleEngine rule_engine = {.lock = PTHREAD_MUTEX_INITIALIZER};
+static __thread int rule_engine_running = 0; // Evita reentrar no motor pelas ações
+
+static inline unsigned int rule_field_value(const unsigned short *regs, int field) {
+    const RegisterField *f = &register_fields[field];
+    return (regs[f->reg] >> f->offset) & ((1u << f->width) - 1);
+}
+
+static inline int rule_condition_true(const RuleCondition *condition, unsigned int value) {
+    return (condition->kind == RULE_THRESHOLD ? value >= condition->key : value == condition->key) ^ condition->negate;
+}
+
+int compare_rule_condition(const void *a, const void *b) {
+    const RuleCondition *x = (const RuleCondition *)a;
+    const RuleCondition *y = (const RuleCondition *)b;
+    int gx = x->field * 2 + x->kind, gy = y->field * 2 + y->kind;
+    if (gx != gy) {
+        return gx - gy;
+    }
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+// Primeira condição de [begin, end) com key >= key
+static RuleCondition *rule_lower_bound(RuleCondition *begin, RuleCondition *end, unsigned int key) {
+    while (begin < end) {
+        RuleCondition *middle = begin + (end - begin) / 2;
+        if (middle->key < key) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    return begin;
+}
+
+// Reconstrói o índice por campo a partir de todas as condições
+static int rule_engine_reindex(RuleEngine *engine) {
+    RuleCondition *index = malloc((engine->condition_count ? engine->condition_count : 1) * sizeof(RuleCondition));
+    int *queue = malloc((engine->count ? engine->count : 1) * sizeof(int));
+    if (index == NULL || queue == NULL) {
+        perror("Erro ao alocar o índice de regras");
+        free(index);
+        free(queue);
+        return -1;
+    }
+    memcpy(index, engine->conditions, engine->condition_count * sizeof(RuleCondition));
+    qsort(index, engine->condition_count, sizeof(RuleCondition), compare_rule_condition);
+
+    memset(engine->watched, 0, sizeof(engine->watched));
+    int position = 0;
+    for (int group = 0; group <= REGISTER_FIELD_COUNT * 2; group++) {
+        engine->index_start[group] = position;
+        while (position < engine->condition_count && index[position].field * 2 + index[position].kind == group) {
+            const RegisterField *field = &register_fields[index[position].field];
+            engine->watched[field->reg] |= FIELD_BITS(field->offset, field->width);
+            position++;
+        }
+    }
+    free(engine->index);
+    free(engine->queue);
+    engine->index = index;
+    engine->queue = queue;
+    return 0;
+}
+
+// Interpreta uma regra e a acrescenta (ainda fora do índice)
+static int rule_parse_line(RuleEngine *engine, char *line) {
+    static const char *actions[] = {"led", "rgb", "color", "red", "green", "blue", "battery",
+                                    "temp", "text", "textmode", "scene", "blink", "noblink"};
+    char *arrow = strstr(line, "->");
+    if (arrow == NULL) {
+        return -1;
+    }
+    *arrow = '\0';
+    char *action = arrow + 2;
+    while (isspace((unsigned char)*action)) {
+        action++;
+    }
+    action[strcspn(action, "\r\n")] = '\0';
+    size_t command = strcspn(action, " \t");
+    int known = 0;
+    for (size_t i = 0; i < sizeof(actions) / sizeof(actions[0]); i++) {
+        known |= strlen(actions[i]) == command && strncmp(action, actions[i], command) == 0;
+    }
+    if (!known || strlen(action) >= RULE_ACTION_MAX) {
+        return -1;
+    }
+
+    if (engine->count == engine->capacity) {
+        int capacity = engine->capacity ? engine->capacity * 2 : 64;
+        Rule *rules = realloc(engine->rules, capacity * sizeof(Rule));
+        if (rules == NULL) {
+            return -1;
+        }
+        engine->rules = rules;
+        engine->capacity = capacity;
+    }
+    Rule *rule = &engine->rules[engine->count];
+    memset(rule, 0, sizeof(*rule));
+    snprintf(rule->action, sizeof(rule->action), "%s", action);
+    if (strcmp(action, "noblink") == 0) {
+        rule->action_kind = RULE_ACTION_NOBLINK;
+    } else if (command == 5 && strncmp(action, "blink", 5) == 0) {
+        rule->blink_bits = 8;
+        if (sscanf(action, "blink %i %d", &rule->blink_pattern, &rule->blink_bits) < 1 ||
+            rule->blink_bits < 1 || rule->blink_bits > 32) {
+            return -1;
+        }
+        rule->action_kind = RULE_ACTION_BLINK;
+    }
+
+    int first = engine->condition_count;
+    for (char *cursor = line;;) {
+        char name[32], op[3];
+        unsigned int value;
+        int consumed = 0, field = -1;
+        if (sscanf(cursor, " %31[a-z_0-9] %2[<>=!] %u%n", name, op, &value, &consumed) != 3 ||
+            rule->conditions == RULE_MAX_CONDITIONS || value > 0xFFFF) {
+            engine->condition_count = first;
+            return -1;
+        }
+        for (int i = 0; i < REGISTER_FIELD_COUNT; i++) {
+            if (strcmp(register_fields[i].name, name) == 0) {
+                field = i;
+            }
+        }
+
+        // <, <=, >, >= viram limites (valor >= k) e ==, != igualdades
+        RuleCondition condition = {field, RULE_THRESHOLD, 0, value, engine->count};
+        if (strcmp(op, ">") == 0 || strcmp(op, "<=") == 0) {
+            condition.key = value + 1;
+        }
+        if (strcmp(op, "<") == 0 || strcmp(op, "<=") == 0) {
+            condition.negate = 1;
+        }
+        if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0) {
+            condition.kind = RULE_EQUAL;
+            condition.negate = op[0] == '!';
+        } else if (strcmp(op, ">") != 0 && strcmp(op, ">=") != 0 && strcmp(op, "<") != 0 && strcmp(op, "<=") != 0) {
+            field = -1;
+        }
+        if (field == -1) {
+            engine->condition_count = first;
+            return -1;
+        }
+
+        if (engine->condition_count == engine->condition_capacity) {
+            int capacity = engine->condition_capacity ? engine->condition_capacity * 2 : 64;
+            RuleCondition *conditions = realloc(engine->conditions, capacity * sizeof(RuleCondition));
+            if (conditions == NULL) {
+                engine->condition_count = first;
+                return -1;
+            }
+            engine->conditions = conditions;
+            engine->condition_capacity = capacity;
+        }
+        engine->conditions[engine->condition_count++] = condition;
+        rule->conditions++;
+
+        cursor += consumed;
+        while (isspace((unsigned char)*cursor)) {
+            cursor++;
+        }
+        if (*cursor == '\0') {
+            break;
+        }
+        if (strncmp(cursor, "and", 3) != 0 || !isspace((unsigned char)cursor[3])) {
+            engine->condition_count = first;
+            return -1;
+        }
+        cursor += 3;
+    }
+    engine->count++;
+    return 0;
+}
+
+static void rule_condition_flip(RuleEngine *engine, const RuleCondition *condition, unsigned int value) {
+    Rule *rule = &engine->rules[condition->rule];
+    int now = rule_condition_true(condition, value);
+    rule->satisfied += now ? 1 : -1;
+    engine->evaluations++;
+    if (now && rule->satisfied == rule->conditions && !rule->queued) {
+        rule->queued = 1;
+        engine->queue[engine->queue_count++] = condition->rule;
+    }
+}
+
+// Visita as condições do campo cujo resultado muda de old_value para new_value
+static void rule_field_changed(RuleEngine *engine, int field, unsigned int old_value, unsigned int new_value) {
+    unsigned int low = old_value < new_value ? old_value : new_value;
+    unsigned int high = old_value ^ new_value ^ low;
+
+    RuleCondition *begin = engine->index + engine->index_start[field * 2 + RULE_THRESHOLD];
+    RuleCondition *end = engine->index + engine->index_start[field * 2 + RULE_THRESHOLD + 1];
+    for (RuleCondition *c = rule_lower_bound(begin, end, low + 1); c < end && c->key <= high; c++) {
+        rule_condition_flip(engine, c, new_value);
+    }
+
+    begin = engine->index + engine->index_start[field * 2 + RULE_EQUAL];
+    end = engine->index + engine->index_start[field * 2 + RULE_EQUAL + 1];
+    for (int side = 0; side < 2; side++) {
+        unsigned int key = side ? new_value : old_value;
+        for (RuleCondition *c = rule_lower_bound(begin, end, key); c < end && c->key == key; c++) {
+            rule_condition_flip(engine, c, new_value);
+        }
+    }
+}
+
+// Pisca o LED segundo o padrão (bit 0 primeiro); bits == 0 para a animação
+static void rule_engine_blink(RuleEngine *engine, unsigned int pattern, int bits) {
+    BlinkState *blink = &engine->blink;
+    __atomic_store_n(&blink->length, 0, __ATOMIC_RELEASE);
+    if (bits == 0) {
+        return;
+    }
+    blink->base_address = engine->base_address;
+    blink->pattern = pattern;
+    blink->position = 0;
+    __atomic_store_n(&blink->length, bits, __ATOMIC_RELEASE);
+    if (engine->blink_animation.step == NULL) {
+        engine->blink_animation = (Animation){.name = "rule_blink", .step = animation_blink_step, .state = blink};
+        if (animation_scheduler_start(&animation_scheduler) == -1 ||
+            animation_add(&animation_scheduler, &engine->blink_animation, RULE_BLINK_FPS) == -1) {
+            engine->blink_animation.step = NULL; // Tenta de novo no próximo disparo
+        }
+    }
+}
+
+static void rule_action_run(RuleEngine *engine, int index) {
+    Rule *rule = &engine->rules[index];
+    char line[RULE_ACTION_MAX];
+
+    rule->fired++;
+    engine->fires++;
+    if (engine->log != NULL) {
+        fprintf(engine->log, "regra %d: %s\n", index + 1, rule->action);
+        fflush(engine->log);
+    }
+    if (rule->action_kind == RULE_ACTION_BLINK) {
+        rule_engine_blink(engine, rule->blink_pattern, rule->blink_bits);
+    } else if (rule->action_kind == RULE_ACTION_NOBLINK) {
+        rule_engine_blink(engine, 0, 0);
+    } else {
+        memcpy(line, rule->action, sizeof(line)); // script_execute_line altera a linha
+        if (script_execute_line(engine->base_address, line) == -1) {
+            fprintf(stderr, "Erro: ação inválida na regra %d: %s\n", index + 1, rule->action);
+        }
+    }
+}
+
+// Compara R0-R15 com a última imagem avaliada, atualiza as condições dos
+// campos alterados e executa as ações das regras que passaram a ser verdadeiras
+void rule_engine_evaluate(RuleEngine *engine) {
+    if (rule_engine_running) {
+        return;
+    }
+    rule_engine_running = 1;
+    pthread_mutex_lock(&engine->lock);
+    for (int round = 0; engine->base_address != NULL; round++) {
+        RegisterSnapshot snapshot;
+        registers_snapshot(engine->base_address, &snapshot);
+        engine->queue_count = 0;
+        for (int reg = 0; reg < REGISTER_COUNT; reg++) {
+            unsigned short changed = (snapshot.regs[reg] ^ engine->values[reg]) & engine->watched[reg];
+            for (int field = 0; changed != 0 && field < REGISTER_FIELD_COUNT; field++) {
+                const RegisterField *f = &register_fields[field];
+                if (f->reg == reg && (changed & FIELD_BITS(f->offset, f->width))) {
+                    rule_field_changed(engine, field, rule_field_value(engine->values, field),
+                                       rule_field_value(snapshot.regs, field));
+                }
+            }
+        }
+        memcpy(engine->values, snapshot.regs, sizeof(engine->values));
+        if (engine->queue_count == 0) {
+            break;
+        }
+
+        for (int i = 0; i < engine->queue_count; i++) {
+            Rule *rule = &engine->rules[engine->queue[i]];
+            rule->queued = 0;
+            // Uma alteração posterior na mesma rodada pode ter desfeito a condição
+            if (round < RULE_MAX_ROUNDS && rule->satisfied == rule->conditions) {
+                rule_action_run(engine, engine->queue[i]);
+            }
+        }
+        if (round == RULE_MAX_ROUNDS) {
+            fprintf(stderr, "Erro: regras em ciclo; avaliação interrompida após %d rodadas\n", RULE_MAX_ROUNDS);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&engine->lock);
+    rule_engine_running = 0;
+}
+
+// Gancho de seq_write_end
+void rule_engine_after_commit(char *base_address) {
+    if (rule_engine.base_address == base_address) {
+        rule_engine_evaluate(&rule_engine);
+    }
+}
+
+// Lê as regras (uma por linha; vazias e iniciadas por '#' são ignoradas) e as
+// liga aos registradores de base_address. Em caso de erro nenhuma regra da
+// entrada é acrescentada. Retorna o número de regras lidas ou -1.
+int rule_engine_load_file(RuleEngine *engine, char *base_address, FILE *input, const char *source) {
+    char line[256];
+    int line_number = 0;
+
+    pthread_mutex_lock(&engine->lock);
+    if (engine->base_address != NULL && engine->base_address != base_address) {
+        pthread_mutex_unlock(&engine->lock);
+        fprintf(stderr, "Erro: as regras já estão ligadas a outra imagem\n");
+        return -1;
+    }
+    int first_rule = engine->count, first_condition = engine->condition_count;
+    while (fgets(line, sizeof(line), input) != NULL) {
+        line_number++;
+        char *text = line;
+        while (isspace((unsigned char)*text)) {
+            text++;
+        }
+        if (*text == '\0' || *text == '#') {
+            continue;
+        }
+        text[strcspn(text, "\r\n")] = '\0';
+        char parsed[sizeof(line)];
+        memcpy(parsed, text, strlen(text) + 1); // rule_parse_line altera a linha
+        if (rule_parse_line(engine, parsed) == -1) {
+            fprintf(stderr, "Erro: regra inválida em %s:%d: %s\n", source, line_number, text);
+            engine->count = first_rule;
+            engine->condition_count = first_condition;
+            pthread_mutex_unlock(&engine->lock);
+            return -1;
+        }
+    }
+
+    // Estado inicial das regras novas: as que já são verdadeiras não disparam
+    if (engine->base_address == NULL) {
+        RegisterSnapshot snapshot;
+        registers_snapshot(base_address, &snapshot);
+        memcpy(engine->values, snapshot.regs, sizeof(engine->values));
+    }
+    for (int i = first_condition; i < engine->condition_count; i++) {
+        RuleCondition *condition = &engine->conditions[i];
+        engine->rules[condition->rule].satisfied +=
+            rule_condition_true(condition, rule_field_value(engine->values, condition->field));
+    }
+    if (rule_engine_reindex(engine) == -1) {
+        engine->count = first_rule;
+        engine->condition_count = first_condition;
+        pthread_mutex_unlock(&engine->lock);
+        return -1;
+    }
+    engine->base_address = base_address;
+    if (engine == &rule_engine) {
+        registers_commit_hook = rule_engine_after_commit;
+    }
+    pthread_mutex_unlock(&engine->lock);
+    return engine->count - first_rule;
+}
+
+int rule_engine_load(RuleEngine *engine, char *base_address, const char *path) {
+    FILE *input = fopen(path, "r");
+    if (input == NULL) {
+        perror("Erro ao abrir o arquivo de regras");
+        return -1;
+    }
+    int loaded = rule_engine_load_file(engine, base_address, input, path);
+    fclose(input);
+    return loaded;
+}
+
+void rule_engine_free(RuleEngine *engine) {
+    pthread_mutex_lock(&engine->lock);
+    free(engine->rules);
+    free(engine->conditions);
+    free(engine->index);
+    free(engine->queue);
+    engine->rules = NULL;
+    engine->conditions = engine->index = NULL;
+    engine->queue = NULL;
+    engine->count = engine->capacity = 0;
+    engine->condition_count = engine->condition_capacity = 0;
+    engine->base_address = NULL;
+    memset(engine->watched, 0, sizeof(engine->watched));
+    pthread_mutex_unlock(&engine->lock);
+}
+
+// Condições verdadeiras de cada regra recalculadas do zero (conferência do
+// índice e referência de custo de um avaliador que relê tudo)
+long rule_engine_recount(RuleEngine *engine, const unsigned short *regs, int *satisfied) {
+    memset(satisfied, 0, engine->count * sizeof(int));
+    for (int i = 0; i < engine->condition_count; i++) {
+        const RuleCondition *condition = &engine->conditions[i];
+        satisfied[condition->rule] += rule_condition_true(condition, rule_field_value(regs, condition->field));
+    }
+    return engine->condition_count;
+}
+
+volatile sig_atomic_t rules_stop_requested = 0;
+
+void rules_signal_handler(int signal_number) {
+    (void)signal_number;
+    rules_stop_requested = 1; // A espera no futex é interrompida com EINTR
+}
+
+// Modo --rules-run: reavalia as regras a cada alteração feita por qualquer
+// processo (notificação pelo futex de geração) e imprime os disparos, até
+// receber SIGINT ou SIGTERM
+int run_rules(char *base_address) {
+    unsigned int generation = registers_generation(base_address);
+    rule_engine.log = stdout;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = rules_signal_handler;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("%d regras carregadas; aguardando alterações\n", rule_engine.count);
+    fflush(stdout);
+    while (!rules_stop_requested) {
+        rule_engine_evaluate(&rule_engine);
+        generation = registers_wait_change(base_address, generation, -1);
+    }
+    printf("regras encerradas: %ld condições avaliadas, %ld disparos\n", rule_engine.evaluations, rule_engine.fires);
+    return 0;
+}
+
+// REPRODUÇÃO DE SESSÕES
+// Aplica um trace gravado com --record ao arquivo mapeado, no ritmo original
+// (realtime) ou o mais rápido possível (fast), e confere se a imagem final de
+// R0-R15 é idêntica à gravada no rodapé.
+
+static inline unsigned long long trace_get_varint(const unsigned char **cursor, const unsigned char *end) {
+    unsigned long long value = 0;
+    int shift = 0;
+    while (*cursor < end) {
+        unsigned char byte = *(*cursor)++;
+        value |= (unsigned long long)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+        shift += 7;
+    }
+    return value;
+}
+
+int run_replay(char *base_address, const char *trace_path, int realtime) {
+    FILE *input = fopen(trace_path, "rb");
+    if (input == NULL) {
+        perror("Erro ao abrir o arquivo de trace");
+        return -1;
+    }
+    fseek(input, 0, SEEK_END);
+    long size = ftell(input);
+    fseek(input, 0, SEEK_SET);
+    unsigned char *data = malloc(size > 0 ? size : 1);
+    if (size < (long)sizeof(TraceHeader) || fread(data, 1, size, input) != (size_t)size) {
+        fprintf(stderr, "Erro: arquivo de trace inválido\n");
+        free(data);
+        fclose(input);
+        return -1;
+    }
+    fclose(input);
+
+    TraceHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != TRACE_MAGIC || header.version != TRACE_VERSION || header.register_count != REGISTER_COUNT) {
+        fprintf(stderr, "Erro: arquivo de trace inválido\n");
+        free(data);
+        return -1;
+    }
+
+    // Parte da imagem inicial gravada
+    unsigned short image[REGISTER_COUNT];
+    memcpy(image, header.initial, sizeof(image));
+    registers_write_all(base_address, image);
+
+    const unsigned char *cursor = data + sizeof(header);
+    const unsigned char *end = data + size;
+    unsigned long long applied = 0;
+    long long trace_ns = 0;
+    long long late_ns = 0;
+    int complete = 0;
+    unsigned long long recorded_count = 0;
+    unsigned short final_image[REGISTER_COUNT];
+    long started = monotonic_ns();
+
+    while (cursor < end) {
+        int reg = *cursor++;
+        if (reg == TRACE_END) {
+            if (end - cursor >= (long)(sizeof(recorded_count) + sizeof(final_image))) {
+                memcpy(&recorded_count, cursor, sizeof(recorded_count));
+                memcpy(final_image, cursor + sizeof(recorded_count), sizeof(final_image));
+                complete = 1;
+            }
+            break;
+        }
+        if (reg >= REGISTER_COUNT) {
+            fprintf(stderr, "Erro: registro inválido no trace (registrador %d)\n", reg);
+            break;
+        }
+        trace_ns += (long long)trace_get_varint(&cursor, end);
+        image[reg] ^= (unsigned short)trace_get_varint(&cursor, end);
+
+        if (realtime) {
+            long long due = started + trace_ns;
+            long long now = monotonic_ns();
+            if (due > now) {
+                struct timespec wake = {due / 1000000000LL, due % 1000000000LL};
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+            } else {
+                late_ns += now - due;
+            }
+        }
+        reg_atomic_update(base_address, reg, 0xFFFF, image[reg]);
+        applied++;
+    }
+    double seconds = (monotonic_ns() - started) / 1e9;
+
+    RegisterSnapshot snapshot;
+    registers_snapshot(base_address, &snapshot);
+    printf("mode,records,trace_bytes,bytes_per_record,trace_seconds,replay_seconds,records_per_s,mean_late_us\n");
+    printf("%s,%llu,%ld,%.2f,%.3f,%.3f,%.0f,%.1f\n", realtime ? "realtime" : "fast", applied, size,
+           applied ? (double)(size - sizeof(header)) / applied : 0.0, trace_ns / 1e9, seconds,
+           seconds > 0 ? applied / seconds : 0.0, applied ? late_ns / 1000.0 / applied : 0.0);
+    free(data);
+
+    if (!complete) {
+        fprintf(stderr, "Erro: trace incompleto (sem rodapé); imagem final não verificada\n");
+        return -1;
+    }
+    if (recorded_count != applied) {
+        fprintf(stderr, "Erro: trace com %llu registros, %llu aplicados\n", recorded_count, applied);
+        return -1;
+    }
+    if (memcmp(snapshot.regs, final_image, sizeof(final_image)) != 0) {
+        for (int reg = 0; reg < REGISTER_COUNT; reg++) {
+            if (snapshot.regs[reg] != final_image[reg]) {
+                fprintf(stderr, "Erro: R%d = %04x após a reprodução, %04x na gravação\n", reg, snapshot.regs[reg], final_image[reg]);
+            }
+        }
+        return -1;
+    }
+    printf("imagem final idêntica à gravada (%d bytes)\n", (int)sizeof(final_image));
+    return 0;
+}
+
+// TEXTO EM ROLAGEM NO TERMINAL
+// Rola a mensagem pelas páginas de texto no ritmo pedido, mostra a janela
+// visível no terminal e, em paralelo, um leitor confere que todo quadro lido
+// é uma janela completa da mensagem.
+typedef struct {
+    char *base_address;
+    const TextStream *stream;
+    unsigned int first_frame;
+    int running;
+    long reads;
+    long torn;
+} TextStreamChecker;
+
+void *text_stream_checker_thread(void *arg) {
+    TextStreamChecker *checker = (TextStreamChecker *)arg;
+    unsigned short window[TEXT_REGISTERS];
+    while (__atomic_load_n(&checker->running, __ATOMIC_ACQUIRE)) {
+        unsigned int frame = text_page_read(checker->base_address, window);
+        if (frame != checker->first_frame) {
+            int position = (int)((frame - checker->first_frame - 1) % checker->stream->cycle);
+            if (memcmp(window, &checker->stream->cells[position], sizeof(window)) != 0) {
+                checker->torn++;
+            }
+        }
+        checker->reads++;
+        if ((checker->reads & 63) == 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+int run_marquee(char *base_address, const char *message, int fps, double seconds) {
+    TextStream stream;
+    if (text_stream_open(&stream, base_address, message) == -1) {
+        return -1;
+    }
+
+    // Custo de um quadro, sobre um buffer em memória
+    static char scratch[FILE_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+    TextStream timing;
+    text_stream_open(&timing, scratch, message);
+    long started = monotonic_ns();
+    for (int i = 0; i < 1000000; i++) {
+        text_stream_step(&timing);
+    }
+    double ns_per_frame = (monotonic_ns() - started) / 1e6;
+    text_stream_close(&timing);
+
+    TextStreamChecker checker = {base_address, &stream, stream.frame, 1, 0, 0};
+    pthread_t checker_thread;
+    pthread_create(&checker_thread, NULL, text_stream_checker_thread, &checker);
+
+    AnimationScheduler scheduler = {.lock = PTHREAD_MUTEX_INITIALIZER};
+    Animation animation = {.name = "text_stream", .step = animation_text_stream_step, .state = &stream};
+    if (animation_scheduler_start(&scheduler) == -1 || animation_add(&scheduler, &animation, fps) == -1) {
+        animation_scheduler_stop(&scheduler);
+        __atomic_store_n(&checker.running, 0, __ATOMIC_RELEASE);
+        pthread_join(checker_thread, NULL);
+        text_stream_close(&stream);
+        return -1;
+    }
+
+    // Mostra cada quadro novo, dormindo no futex de geração entre eles
+    unsigned short window[TEXT_REGISTERS];
+    unsigned int shown = stream.frame;
+    unsigned int generation = registers_generation(base_address);
+    started = monotonic_ns();
+    while (monotonic_ns() - started < (long)(seconds * 1e9)) {
+        generation = registers_wait_change(base_address, generation, 100);
+        unsigned int frame = text_page_read(base_address, window);
+        if (frame != shown) {
+            printf("\r[");
+            for (int i = 0; i < TEXT_REGISTERS; i++) {
+                putchar((char)window[i]);
+            }
+            printf("]");
+            fflush(stdout);
+            shown = frame;
+        }
+    }
+
+    animation_scheduler_stop(&scheduler);
+    pthread_cond_destroy(&scheduler.changed);
+    __atomic_store_n(&checker.running, 0, __ATOMIC_RELEASE);
+    pthread_join(checker_thread, NULL);
+
+    printf("\nframes,dropped,reads,torn,ns_per_frame\n");
+    printf("%ld,%ld,%ld,%ld,%.1f\n", animation.frames, animation.dropped, checker.reads, checker.torn, ns_per_frame);
+    text_stream_close(&stream);
+    return checker.torn == 0 ? 0 : -1;
+}
+
+// MODO DE SENSORES
+// Roda a simulação, mostra os mostradores de temperatura e bateria a cada
+// segundo e, no fim, confere os agregados incrementais contra um recálculo
+// completo de cada janela.
+int compare_ushort(const void *a, const void *b) {
+    return (int)*(const unsigned short *)a - (int)*(const unsigned short *)b;
+}
+
+// Recalcula os agregados de uma janela varrendo todas as amostras
+void window_aggregate_rescan(const SlidingWindow *window, SensorAggregate *out) {
+    memset(out, 0, sizeof(*out));
+    if (window->count == 0) {
+        return;
+    }
+    unsigned short *sorted = malloc(window->count * sizeof(unsigned short));
+    long sum = 0;
+    for (int i = 0; i < window->count; i++) {
+        sorted[i] = WINDOW_AT(window, window->next_index - window->count + i);
+        sum += sorted[i];
+    }
+    qsort(sorted, window->count, sizeof(unsigned short), compare_ushort);
+    const double percentiles[3] = {50, 95, 99};
+    unsigned short values[3];
+    for (int k = 0; k < 3; k++) {
+        int rank = (int)ceil(percentiles[k] * window->count / 100.0);
+        values[k] = sorted[(rank < 1 ? 1 : rank) - 1];
+    }
+    out->count = window->count > 65535 ? 65535 : window->count;
+    out->min = sorted[0];
+    out->max = sorted[window->count - 1];
+    out->mean_x10 = (unsigned short)((sum * 10 + window->count / 2) / window->count);
+    out->p50 = values[0];
+    out->p95 = values[1];
+    out->p99 = values[2];
+    free(sorted);
+}
+
+int run_sensors(char *base_address, double seconds, int rate_hz) {
+    SensorSimulation sim;
+    int previous_verbose = registers_verbose;
+    registers_verbose = 0;
+    if (sensor_simulation_start(&sim, base_address, rate_hz) == -1) {
+        fprintf(stderr, "Erro: não foi possível iniciar a simulação de sensores\n");
+        return -1;
+    }
+
+    long started = monotonic_ns();
+    for (int second = 1; second <= (int)ceil(seconds); second++) {
+        long until = started + (long)((second < seconds ? second : seconds) * 1e9);
+        struct timespec wake = {until / 1000000000L, until % 1000000000L};
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+        printf("--- %d s ---\n", second);
+        display_temperature_sensor(base_address);
+        display_battery_sensor(base_address);
+    }
+    sensor_simulation_stop(&sim, 1);
+
+    int mismatches = 0;
+    double rescan_ns = 0;
+    for (int sensor = 0; sensor < SENSOR_COUNT; sensor++) {
+        for (int w = 0; w < SENSOR_WINDOWS; w++) {
+            SensorAggregate incremental, rescanned;
+            window_aggregate(&sim.windows[sensor][w], &incremental);
+            long rescan_started = monotonic_ns();
+            window_aggregate_rescan(&sim.windows[sensor][w], &rescanned);
+            rescan_ns += monotonic_ns() - rescan_started;
+            if (memcmp(&incremental, &rescanned, sizeof(incremental)) != 0) {
+                fprintf(stderr, "Erro: agregados divergentes no sensor %d, janela de %d s\n", sensor, sensor_window_seconds[w]);
+                mismatches++;
+            }
+        }
+        window_free(&sim.windows[sensor][0]);
+        window_free(&sim.windows[sensor][1]);
+        window_free(&sim.windows[sensor][2]);
+    }
+
+    printf("samples,samples_per_s,incremental_ns_per_sample,rescan_ns_per_publish,mismatches\n");
+    printf("%ld,%.0f,%.1f,%.0f,%d\n", sim.samples, sim.samples / seconds,
+           sim.samples ? (double)sim.aggregate_ns / sim.samples : 0.0, rescan_ns, mismatches);
+    registers_verbose = previous_verbose;
+    return mismatches == 0 ? 0 : -1;
+}
+
+// MODO DE ESTRESSE
+// Executa N escritores sobre os registradores de dados R4-R15 pelo mesmo
+// caminho dos setters (reg_atomic_update_old: seqlock, notificação e
+// registro de alterações). Cada escritor incrementa o seu próprio contador
+// de 8 bits, e dois escritores dividem o mesmo registrador. Como só o dono
+// altera o contador, o valor anterior devolvido tem que ser sempre o último
+// valor escrito por ele; qualquer diferença é uma atualização perdida.
+// Os registradores são restaurados ao fim.
+#define STRESS_FIRST_REG 4
+#define STRESS_MAX_WRITERS (TEXT_REGISTERS * 2) // Um byte de R4-R15 por escritor
+
+typedef struct {
+    char *base_address;
+    int id;
+    long iterations;
+    long lost;
+} StressWriter;
+
+long stress_writer_run(char *base_address, int id, long iterations) {
+    int reg = STRESS_FIRST_REG + id / 2;
+    int shift = (id % 2) * 8;
+    unsigned short mask = 0xFF << shift;
+    unsigned short count = (reg_atomic_load(base_address, reg) & mask) >> shift;
+    long lost = 0;
+
+    for (long i = 0; i < iterations; i++) {
+        unsigned short old_value;
+        unsigned short next = (count + 1) & 0xFF;
+        reg_atomic_update_old(base_address, reg, mask, next << shift, &old_value);
+        if (((old_value & mask) >> shift) != count) {
+            lost++;
+        }
+        count = next;
+    }
+    return lost;
+}
+
+void *stress_writer_thread(void *arg) {
+    StressWriter *writer = (StressWriter *)arg;
+    writer->lost = stress_writer_run(writer->base_address, writer->id, writer->iterations);
+    return NULL;
+}
+
+// Executa uma rodada com o número de escritores indicado e retorna as atualizações perdidas
+long stress_round(char *base_address, int writers, long iterations, int use_processes, double *ops_per_sec) {
+    RegisterTransaction reset;
+    tx_begin(&reset, base_address);
+    for (int reg = STRESS_FIRST_REG; reg < REGISTER_COUNT; reg++) {
+        tx_stage(&reset, reg, 0xFFFF, 0);
+    }
+    tx_commit(&reset, NULL);
+
+    // Resultados dos processos filhos ficam em uma região anônima compartilhada
+    long *results = mmap(NULL, writers * sizeof(long), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        perror("Erro ao mapear os resultados do estresse");
+        return -1;
+    }
+
+    StressWriter state[STRESS_MAX_WRITERS];
+    pthread_t threads[STRESS_MAX_WRITERS];
+    pid_t pids[STRESS_MAX_WRITERS];
+    double start = monotonic_seconds();
+
+    for (int i = 0; i < writers; i++) {
+        state[i] = (StressWriter){base_address, i, iterations, 0};
+        if (use_processes) {
+            pids[i] = fork();
+            if (pids[i] == 0) {
+                results[i] = stress_writer_run(base_address, i, iterations);
+                _exit(0);
+            }
+        } else {
+            pthread_create(&threads[i], NULL, stress_writer_thread, &state[i]);
+        }
+    }
+
+    long lost = 0;
+    for (int i = 0; i < writers; i++) {
+        if (use_processes) {
+            waitpid(pids[i], NULL, 0);
+            lost += results[i];
+        } else {
+            pthread_join(threads[i], NULL);
+            lost += state[i].lost;
+        }
+    }
+    double elapsed = monotonic_seconds() - start;
+
+    // Confere o valor final de cada contador
+    for (int i = 0; i < writers; i++) {
+        unsigned short word = reg_atomic_load(base_address, STRESS_FIRST_REG + i / 2);
+        if (((word >> ((i % 2) * 8)) & 0xFF) != (iterations & 0xFF)) {
+            lost++;
+        }
+    }
+
+    munmap(results, writers * sizeof(long));
+    *ops_per_sec = (writers * (double)iterations) / elapsed;
+    return lost;
+}
+
+// Escala os escritores de 1 até o número de núcleos
+int run_stress(char *base_address, int use_processes, long iterations) {
+    unsigned short saved[REGISTER_COUNT];
+    memcpy(saved, base_address, sizeof(saved));
+
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) {
+        cores = 1;
+    }
+    if (cores > STRESS_MAX_WRITERS) {
+        cores = STRESS_MAX_WRITERS;
+    }
+
+    long total_lost = 0;
+    printf("writers,lost_updates,ops_per_sec\n");
+    for (int writers = 1; ; writers *= 2) {
+        if (writers > cores) {
+            writers = cores;
+        }
+        double ops_per_sec;
+        long lost = stress_round(base_address, writers, iterations, use_processes, &ops_per_sec);
+        if (lost < 0) {
+            total_lost = -1;
+            break;
+        }
+        printf("%d,%ld,%.0f\n", writers, lost, ops_per_sec);
+        total_lost += lost;
+        if (writers == cores) {
+            break;
+        }
+    }
+    registers_write_all(base_address, saved);
+    return total_lost == 0 ? 0 : -1;
+}
+
+// BENCHMARK DO SEQLOCK
+// Uma thread escritora grava o mesmo contador em R3 e R4 (grupos de 64 bits
+// diferentes) por transação, enquanto leitores tiram cópias consistentes.
+// Uma cópia com R3 != R4 seria uma leitura rasgada.
+typedef struct {
+    char *base_address;
+    int running; // Lido e escrito com __atomic_*
+    long writes;
+} SeqlockWriter;
+
+typedef struct {
+    char *base_address;
+    int *running;
+    long reads;
+    long retries;
+    long torn;
+} SeqlockReader;
+
+void *seqlock_writer_thread(void *arg) {
+    SeqlockWriter *writer = (SeqlockWriter *)arg;
+    RegisterTransaction tx;
+    unsigned short value = 0;
+
+    while (__atomic_load_n(&writer->running, __ATOMIC_ACQUIRE)) {
+        tx_begin(&tx, writer->base_address);
+        tx_stage(&tx, 3, 0xFFFF, value);
+        tx_stage(&tx, 4, 0xFFFF, value);
+        tx_commit(&tx, NULL);
+        value++;
+        writer->writes++;
+    }
+    return NULL;
+}
+
+void *seqlock_reader_thread(void *arg) {
+    SeqlockReader *reader = (SeqlockReader *)arg;
+    RegisterSnapshot snapshot;
+
+    while (__atomic_load_n(reader->running, __ATOMIC_ACQUIRE)) {
+        reader->retries += registers_snapshot(reader->base_address, &snapshot);
+        if (snapshot.regs[3] != snapshot.regs[4]) {
+            reader->torn++;
+        }
+        reader->reads++;
+    }
+    return NULL;
+}
+
+int run_seqlock_bench(char *base_address, int readers, double seconds) {
+    unsigned short saved[REGISTER_COUNT];
+    memcpy(saved, base_address, sizeof(saved));
+
+    if (readers < 1) {
+        readers = 1;
+    }
+    if (readers > 64) {
+        readers = 64;
+    }
+
+    printf("writer,readers,seconds,reads_per_sec,retries_per_read,writes_per_sec,torn_reads\n");
+    for (int with_writer = 0; with_writer <= 1; with_writer++) {
+        RegisterTransaction reset;
+        tx_begin(&reset, base_address);
+        tx_stage(&reset, 3, 0xFFFF, 0);
+        tx_stage(&reset, 4, 0xFFFF, 0);
+        tx_commit(&reset, NULL);
+
+        SeqlockWriter writer = {base_address, 1, 0};
+        SeqlockReader state[64];
+        pthread_t reader_threads[64];
+        pthread_t writer_thread;
+        int writer_started = 0, started = 0, error = 0;
+
+        if (with_writer) {
+            error = pthread_create(&writer_thread, NULL, seqlock_writer_thread, &writer);
+            writer_started = error == 0;
+        }
+        while (error == 0 && started < readers) {
+            state[started] = (SeqlockReader){base_address, &writer.running, 0, 0, 0};
+            error = pthread_create(&reader_threads[started], NULL, seqlock_reader_thread, &state[started]);
+            started += error == 0;
+        }
+
+        if (error == 0) {
+            usleep((useconds_t)(seconds * 1e6));
+        }
+        __atomic_store_n(&writer.running, 0, __ATOMIC_RELEASE);
+
+        long reads = 0, retries = 0, torn = 0;
+        for (int i = 0; i < started; i++) {
+            pthread_join(reader_threads[i], NULL);
+            reads += state[i].reads;
+            retries += state[i].retries;
+            torn += state[i].torn;
+        }
+        if (writer_started) {
+            pthread_join(writer_thread, NULL);
+        }
+        if (error != 0) {
+            fprintf(stderr, "Erro ao criar as threads do benchmark: %s\n", strerror(error));
+            registers_write_all(base_address, saved);
+            return -1;
+        }
+
+        printf("%d,%d,%.2f,%.0f,%.4f,%.0f,%ld\n", with_writer, readers, seconds, reads / seconds,
+               reads ? (double)retries / reads : 0.0, writer.writes / seconds, torn);
+        if (torn != 0) {
+            registers_write_all(base_address, saved);
+            return -1;
+        }
+    }
+
+    // Restaura os registradores originais
+    registers_write_all(base_address, saved);
+    return 0;
+}
+
+// ASSINANTE E BENCHMARK DE NOTIFICAÇÃO
+// Modo --watch: bloqueia até cada alteração e imprime o banco R0-R15
+int run_watch(char *base_address) {
+    unsigned int generation = registers_generation(base_address);
+    RegisterSnapshot snapshot;
+
+    for (;;) {
+        generation = registers_wait_change(base_address, generation, -1);
+        registers_snapshot(base_address, &snapshot);
+        printf("geracao %u:", generation);
+        for (int i = 0; i < REGISTER_COUNT; i++) {
+            printf(" %04x", snapshot.regs[i]);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    return 0;
+}
+
+int compare_long(const void *a, const void *b) {
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+// Percentil (0-100) de um vetor já ordenado
+long percentile_sorted(const long *values, int count, double p) {
+    if (count == 0) {
+        return 0;
+    }
+    int index = (int)(p / 100.0 * (count - 1) + 0.5);
+    return values[index];
+}
+
+typedef struct {
+    char *base_address;
+    int samples;
+    long sent_ns;            // Instante da escrita feita pelo escritor (atômico)
+    int ready;               // Assinante pronto para a próxima amostra (atômico)
+    long *latencies;
+    double idle_cpu_seconds; // CPU gasta pelo assinante enquanto não havia alterações
+} NotifyBench;
+
+void *notify_subscriber_thread(void *arg) {
+    NotifyBench *bench = (NotifyBench *)arg;
+    unsigned int generation = registers_generation(bench->base_address);
+
+    // Mede a CPU gasta durante uma espera ociosa de 1 segundo
+    struct rusage before, after;
+    getrusage(RUSAGE_THREAD, &before);
+    generation = registers_wait_change(bench->base_address, generation, 1000);
+    getrusage(RUSAGE_THREAD, &after);
+    bench->idle_cpu_seconds = (after.ru_utime.tv_sec - before.ru_utime.tv_sec) +
+                              (after.ru_utime.tv_usec - before.ru_utime.tv_usec) / 1e6 +
+                              (after.ru_stime.tv_sec - before.ru_stime.tv_sec) +
+                              (after.ru_stime.tv_usec - before.ru_stime.tv_usec) / 1e6;
+
+    for (int i = 0; i < bench->samples; i++) {
+        generation = registers_generation(bench->base_address);
+        __atomic_store_n(&bench->ready, 1, __ATOMIC_RELEASE);
+        generation = registers_wait_change(bench->base_address, generation, -1);
+        bench->latencies[i] = monotonic_ns() - __atomic_load_n(&bench->sent_ns, __ATOMIC_ACQUIRE);
+    }
+    return NULL;
+}
+
+int run_notify_bench(char *base_address, int samples) {
+    NotifyBench bench = {base_address, samples, 0, 0, malloc(samples * sizeof(long)), 0.0};
+    pthread_t subscriber;
+    unsigned short led = reg_atomic_load(base_address, 2) & (1 << 9);
+
+    if (bench.latencies == NULL) {
+        perror("Erro ao alocar as amostras");
+        return -1;
+    }
+    int error = pthread_create(&subscriber, NULL, notify_subscriber_thread, &bench);
+    if (error != 0) {
+        fprintf(stderr, "Erro ao criar a thread assinante: %s\n", strerror(error));
+        free(bench.latencies);
+        return -1;
+    }
+    for (int i = 0; i < samples; i++) {
+        while (!__atomic_load_n(&bench.ready, __ATOMIC_ACQUIRE)) {
+            usleep(50);
+        }
+        __atomic_store_n(&bench.ready, 0, __ATOMIC_RELAXED);
+        usleep(200); // Garante que o assinante já está dormindo no futex
+        __atomic_store_n(&bench.sent_ns, monotonic_ns(), __ATOMIC_RELEASE);
+        reg_atomic_update(base_address, 2, 1 << 9, (i & 1) ? led : (led ^ (1 << 9)));
+    }
+    pthread_join(subscriber, NULL);
+
+    // Deixa o bit do LED como estava
+    reg_atomic_update(base_address, 2, 1 << 9, led);
+
+    qsort(bench.latencies, samples, sizeof(long), compare_long);
+    printf("samples,idle_cpu_seconds,wake_p50_us,wake_p99_us,wake_max_us\n");
+    printf("%d,%.6f,%.1f,%.1f,%.1f\n", samples, bench.idle_cpu_seconds,
+           percentile_sorted(bench.latencies, samples, 50) / 1000.0,
+           percentile_sorted(bench.latencies, samples, 99) / 1000.0,
+           bench.latencies[samples - 1] / 1000.0);
+    free(bench.latencies);
+    return 0;
+}
+
+// ASSINANTE E BENCHMARK DO REGISTRO DE ALTERAÇÕES
+// Imprime um registro com os campos do mapa que mudaram
+void print_change_record(const ChangeRecord *record) {
+    printf("%llu %llu.%09llu R%d %04x -> %04x", record->sequence,
+           record->timestamp_ns / 1000000000ULL, record->timestamp_ns % 1000000000ULL,
+           record->reg, record->old_value, record->new_value);
+    for (int i = 0; i < REGISTER_FIELD_COUNT; i++) {
+        const RegisterField *field = &register_fields[i];
+        unsigned short mask = FIELD_BITS(field->offset, field->width);
+        if (field->reg == record->reg && ((record->old_value ^ record->new_value) & mask)) {
+            printf(" %s=%d", field->name, (record->new_value & mask) >> field->offset);
+        }
+    }
+    printf("\n");
+}
+
+// Modo --log-follow: acompanha as escritas a partir do registro mais antigo
+// disponível, dormindo no futex de geração quando está em dia
+int run_log_follow(char *base_address) {
+    ChangeLogReader reader;
+    ChangeRecord record;
+    unsigned long long reported_overruns = 0;
+
+    change_log_reader_init(&reader, &change_log, 1);
+    for (;;) {
+        unsigned int generation = registers_generation(base_address);
+        while (change_log_next(&reader, &record)) {
+            if (reader.overruns != reported_overruns) {
+                printf("overrun: %llu registros perdidos\n", reader.overruns - reported_overruns);
+                reported_overruns = reader.overruns;
+            }
+            print_change_record(&record);
+        }
+        fflush(stdout);
+        registers_wait_change(base_address, generation, -1);
+    }
+    return 0;
+}
+
+typedef struct {
+    int delay_every;            // Pausa a cada N registros (0 = assinante rápido)
+    int *done;
+    unsigned long long received;
+    unsigned long long overruns;
+    unsigned long long order_errors; // Sequência fora de ordem
+    unsigned long long chain_errors; // Valor anterior diferente do último valor visto
+} LogBenchReader;
+
+void *log_bench_reader_thread(void *arg) {
+    LogBenchReader *bench = (LogBenchReader *)arg;
+    ChangeLogReader reader;
+    ChangeRecord record;
+    unsigned long long last_sequence = 0;
+    unsigned short last_value[REGISTER_COUNT];
+    unsigned long long seen_at[REGISTER_COUNT] = {0}; // Overruns na última vez que o registrador foi visto
+
+    memset(last_value, 0, sizeof(last_value));
+    for (int reg = 0; reg < REGISTER_COUNT; reg++) {
+        seen_at[reg] = ~0ULL;
+    }
+    change_log_reader_init(&reader, &change_log, 0);
+    for (;;) {
+        if (!change_log_next(&reader, &record)) {
+            // O produtor terminou: uma última leitura pega o que ele escreveu antes de done
+            if (!__atomic_load_n(bench->done, __ATOMIC_ACQUIRE)) {
+                sched_yield();
+                continue;
+            }
+            if (!change_log_next(&reader, &record)) {
+                break;
+            }
+        }
+        bench->received++;
+        if (record.sequence <= last_sequence) {
+            bench->order_errors++;
+        }
+        last_sequence = record.sequence;
+        // Sem perdas desde a última escrita vista neste registrador, o valor
+        // anterior do registro tem de ser o último valor novo visto
+        if (seen_at[record.reg] == reader.overruns && record.old_value != last_value[record.reg]) {
+            bench->chain_errors++;
+        }
+        last_value[record.reg] = record.new_value;
+        seen_at[record.reg] = reader.overruns;
+        if (bench->delay_every && bench->received % bench->delay_every == 0) {
+            usleep(100);
+        }
+    }
+    bench->overruns = reader.overruns;
+    return NULL;
+}
+
+// Aplica uma sequência de setters que cobre R1, R2 e R3
+void log_bench_write(char *base_address, long i) {
+    switch (i & 3) {
+    case 0: set_led_status(base_address, (i >> 2) & 1); break;
+    case 1: set_intensity_R(base_address, i & 0xFF); break;
+    case 2: set_battery_level(base_address, (i >> 2) & 3); break;
+    default: set_led_temperature(base_address, i % 1024); break;
+    }
+}
+
+int run_log_bench(char *base_address, long writes) {
+    unsigned short saved[REGISTER_COUNT];
+    memcpy(saved, base_address, sizeof(saved));
+    int previous_verbose = registers_verbose;
+    registers_verbose = 0;
+
+    // Custo da escrita com e sem o registro
+    printf("log,writes,ns_per_write\n");
+    for (int with_log = 0; with_log <= 1; with_log++) {
+        change_log.registers = with_log ? base_address : NULL;
+        long started = monotonic_ns();
+        for (long i = 0; i < writes; i++) {
+            log_bench_write(base_address, i);
+        }
+        printf("%d,%ld,%.1f\n", with_log, writes, (double)(monotonic_ns() - started) / writes);
+    }
+
+    // Um assinante rápido e um lento acompanhando o mesmo produtor
+    int done = 0;
+    LogBenchReader readers[2] = {{.delay_every = 0, .done = &done}, {.delay_every = 64, .done = &done}};
+    const char *names[] = {"fast", "slow"};
+    pthread_t threads[2];
+    for (int r = 0; r < 2; r++) {
+        pthread_create(&threads[r], NULL, log_bench_reader_thread, &readers[r]);
+    }
+    usleep(10000); // Os assinantes começam no fim do anel
+    unsigned long long first = __atomic_load_n(&change_log.header->head, __ATOMIC_ACQUIRE);
+    for (long i = 0; i < writes; i++) {
+        log_bench_write(base_address, i);
+        if ((i & 255) == 0) {
+            sched_yield();
+        }
+    }
+    unsigned long long produced = __atomic_load_n(&change_log.header->head, __ATOMIC_ACQUIRE) - first;
+    __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+
+    int status = 0;
+    printf("reader,produced,received,overruns,order_errors,chain_errors\n");
+    for (int r = 0; r < 2; r++) {
+        pthread_join(threads[r], NULL);
+        printf("%s,%llu,%llu,%llu,%llu,%llu\n", names[r], produced, readers[r].received, readers[r].overruns,
+               readers[r].order_errors, readers[r].chain_errors);
+        if (readers[r].received + readers[r].overruns != produced || readers[r].order_errors || readers[r].chain_errors) {
+            status = -1;
+        }
+    }
+
+    registers_write_all(base_address, saved);
+    registers_verbose = previous_verbose;
+    return status;
+}
+
+// SERVIDOR DE REGISTRADORES
+// O modo --daemon mantém o único mapeamento de registers.bin e atende
+// clientes locais em registers.sock com um laço epoll em uma thread. Todas as
+// mensagens têm 8 bytes (RegisterMessage, na ordem de bytes da máquina):
+//   op, campo (índice em register_fields), valor do campo e tag do cliente
+// Requisições: GET, SET, SUBSCRIBE e UNSUBSCRIBE (campo 0xFF = todos). Cada
+// uma recebe uma resposta com op | REGISTER_OP_REPLY e a mesma tag, na ordem
+// de chegada, então o cliente pode enviar várias sem esperar (pipeline). Os
+// SETs seguidos de uma mesma leitura são aplicados em uma única transação.
+// Assinantes recebem REGISTER_OP_EVENT com o novo valor de cada campo
+// assinado que mudar, seja por um cliente ou por outro processo que escreva
+// no arquivo (futex de geração).
+#define REGISTER_FIELD_ALL 0xFF
+#define SERVER_INPUT_SIZE 4096
+#define SERVER_OUTPUT_LIMIT (256 * 1024) // Cliente que não lê as respostas é desconectado
+#define SERVER_OUTPUT_COMPACT 4096 // Bytes já enviados a partir dos quais o resto volta ao início
+#define SERVER_MAX_EVENTS 64
+
+enum {
+    REGISTER_OP_GET = 1,
+    REGISTER_OP_SET = 2,
+    REGISTER_OP_SUBSCRIBE = 3,
+    REGISTER_OP_UNSUBSCRIBE = 4,
+    REGISTER_OP_EVENT = 0x40,
+    REGISTER_OP_ERROR = 0x7F, // valor = REGISTER_ERROR_*
+    REGISTER_OP_REPLY = 0x80,
+};
+
+enum { REGISTER_ERROR_OP = 1, REGISTER_ERROR_FIELD = 2, REGISTER_ERROR_VALUE = 3 };
+
+typedef struct {
+    unsigned char op;
+    unsigned char field;
+    unsigned short value;
+    unsigned int tag;
+} RegisterMessage;
+
+_Static_assert(sizeof(RegisterMessage) == 8, "mensagem do protocolo deve ter 8 bytes");
+_Static_assert(REGISTER_FIELD_COUNT <= 32, "as assinaturas usam uma máscara de 32 bits");
+
+typedef struct {
+    int fd;
+    unsigned int subscriptions; // Bit n = campo n de register_fields
+    unsigned char input[SERVER_INPUT_SIZE];
+    int input_length;
+    char *output;
+    size_t output_length, output_sent, output_capacity;
+    int writable_wait; // EPOLLOUT ligado
+    int closing;
+} ServerClient;
+
+typedef struct {
+    char *base_address;
+    int listen_fd, epoll_fd, wake_fd;
+    RegisterWatcher watcher; // wake_fd é o eventfd do observador
+    ServerClient **clients;
+    int client_count, client_capacity;
+    unsigned short published[REGISTER_COUNT]; // Valores já enviados aos assinantes
+    long accepted, requests, transactions, events, dropped;
+} RegisterServer;
+
+volatile sig_atomic_t daemon_stop_requested = 0;
+int daemon_wake_fd = -1;
+
+void daemon_signal_handler(int signal_number) {
+    unsigned long long one = 1;
+    (void)signal_number;
+    daemon_stop_requested = 1;
+    if (write(daemon_wake_fd, &one, sizeof(one)) < 0) {
+        // Nada a fazer: o laço também confere o sinal a cada espera
+    }
+}
+
+// Aumenta o limite de descritores abertos até o máximo permitido
+void raise_open_file_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int server_socket_address(struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strncpy(address->sun_path, REGISTER_SOCKET_PATH, sizeof(address->sun_path) - 1);
+    return 0;
+}
+
+// Liga ou desliga o aviso de escrita disponível para o cliente
+void server_client_watch_output(RegisterServer *server, ServerClient *client, int enable) {
+    if (client->writable_wait != enable) {
+        struct epoll_event event = {EPOLLIN | (enable ? EPOLLOUT : 0), {.ptr = client}};
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+        client->writable_wait = enable;
+    }
+}
+
+// Move o que ainda não foi enviado para o início do buffer de saída
+void server_client_compact(ServerClient *client) {
+    client->output_length -= client->output_sent;
+    memmove(client->output, client->output + client->output_sent, client->output_length);
+    client->output_sent = 0;
+}
+
+void server_client_queue(ServerClient *client, unsigned char op, unsigned char field, unsigned short value, unsigned int tag) {
+    if (client->closing) {
+        return;
+    }
+    if (client->output_length - client->output_sent + sizeof(RegisterMessage) > SERVER_OUTPUT_LIMIT) {
+        client->closing = 1;
+        return;
+    }
+    if (client->output_length + sizeof(RegisterMessage) > client->output_capacity && client->output_sent > 0) {
+        server_client_compact(client);
+    }
+    if (client->output_length + sizeof(RegisterMessage) > client->output_capacity) {
+        size_t capacity = client->output_capacity ? client->output_capacity * 2 : 1024;
+        char *output = realloc(client->output, capacity);
+        if (output == NULL) {
+            client->closing = 1;
+            return;
+        }
+        client->output = output;
+        client->output_capacity = capacity;
+    }
+    RegisterMessage message = {op, field, value, tag};
+    memcpy(client->output + client->output_length, &message, sizeof(message));
+    client->output_length += sizeof(message);
+}
+
+// Envia o que couber no socket; o resto espera por EPOLLOUT
+void server_client_flush(RegisterServer *server, ServerClient *client) {
+    while (client->output_sent < client->output_length) {
+        ssize_t sent = send(client->fd, client->output + client->output_sent,
+                            client->output_length - client->output_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (client->output_sent >= SERVER_OUTPUT_COMPACT) {
+                    server_client_compact(client);
+                }
+                server_client_watch_output(server, client, 1);
+                return;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            client->closing = 1;
+            return;
+        }
+        client->output_sent += sent;
+    }
+    client->output_length = client->output_sent = 0;
+    server_client_watch_output(server, client, 0);
+}
+
+void server_client_close(RegisterServer *server, int index) {
+    ServerClient *client = server->clients[index];
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    free(client->output);
+    free(client);
+    server->clients[index] = server->clients[--server->client_count];
+}
+
+// Envia aos assinantes os campos que mudaram desde a última publicação
+void server_publish(RegisterServer *server) {
+    RegisterSnapshot snapshot;
+    registers_snapshot(server->base_address, &snapshot);
+    if (memcmp(snapshot.regs, server->published, sizeof(server->published)) == 0) {
+        return;
+    }
+
+    unsigned int changed = 0;
+    for (int f = 0; f < REGISTER_FIELD_COUNT; f++) {
+        const RegisterField *field = &register_fields[f];
+        unsigned short mask = FIELD_BITS(field->offset, field->width);
+        if ((snapshot.regs[field->reg] ^ server->published[field->reg]) & mask) {
+            changed |= 1u << f;
+        }
+    }
+    memcpy(server->published, snapshot.regs, sizeof(server->published));
+
+    for (int c = 0; c < server->client_count; c++) {
+        ServerClient *client = server->clients[c];
+        unsigned int fields = client->subscriptions & changed;
+        if (fields == 0) {
+            continue;
+        }
+        while (fields) {
+            int f = __builtin_ctz(fields);
+            const RegisterField *field = &register_fields[f];
+            unsigned short value = (snapshot.regs[field->reg] & FIELD_BITS(field->offset, field->width)) >> field->offset;
+            server_client_queue(client, REGISTER_OP_EVENT, f, value, snapshot.sequence);
+            server->events++;
+            fields &= fields - 1;
+        }
+        server_client_flush(server, client);
+    }
+}
+
+// Processa as mensagens completas recebidas de um cliente. Retorna 1 se
+// algum SET foi aplicado.
+int server_client_process(RegisterServer *server, ServerClient *client) {
+    RegisterTransaction tx;
+    int staged = 0, committed = 0;
+    int offset = 0;
+
+    for (; offset + (int)sizeof(RegisterMessage) <= client->input_length; offset += sizeof(RegisterMessage)) {
+        RegisterMessage request;
+        memcpy(&request, client->input + offset, sizeof(request));
+        server->requests++;
+
+        if (request.op == REGISTER_OP_SUBSCRIBE || request.op == REGISTER_OP_UNSUBSCRIBE) {
+            unsigned int mask;
+            if (request.field == REGISTER_FIELD_ALL) {
+                mask = REGISTER_FIELD_COUNT == 32 ? 0xFFFFFFFFu : (1u << REGISTER_FIELD_COUNT) - 1;
+            } else if (request.field < REGISTER_FIELD_COUNT) {
+                mask = 1u << request.field;
+            } else {
+                server_client_queue(client, REGISTER_OP_ERROR, request.field, REGISTER_ERROR_FIELD, request.tag);
+                continue;
+            }
+            if (request.op == REGISTER_OP_SUBSCRIBE) {
+                client->subscriptions |= mask;
+            } else {
+                client->subscriptions &= ~mask;
+            }
+            server_client_queue(client, request.op | REGISTER_OP_REPLY, request.field, 0, request.tag);
+            continue;
+        }
+        if (request.op != REGISTER_OP_GET && request.op != REGISTER_OP_SET) {
+            server_client_queue(client, REGISTER_OP_ERROR, request.field, REGISTER_ERROR_OP, request.tag);
+            continue;
+        }
+        if (request.field >= REGISTER_FIELD_COUNT) {
+            server_client_queue(client, REGISTER_OP_ERROR, request.field, REGISTER_ERROR_FIELD, request.tag);
+            continue;
+        }
+
+        const RegisterField *field = &register_fields[request.field];
+        unsigned short mask = FIELD_BITS(field->offset, field->width);
+        if (request.op == REGISTER_OP_SET) {
+            if (field->width < 16 && request.value >> field->width) {
+                server_client_queue(client, REGISTER_OP_ERROR, request.field, REGISTER_ERROR_VALUE, request.tag);
+                continue;
+            }
+            if (!staged) {
+                tx_begin(&tx, server->base_address);
+                staged = 1;
+            }
+            tx_stage(&tx, field->reg, mask, request.value << field->offset);
+            server_client_queue(client, REGISTER_OP_SET | REGISTER_OP_REPLY, request.field, request.value, request.tag);
+        } else {
+            // Um GET depois de SETs da mesma leitura precisa enxergá-los
+            if (staged) {
+                tx_commit(&tx, NULL);
+                server->transactions++;
+                staged = 0;
+                committed = 1;
+            }
+            unsigned short value = (reg_atomic_load(server->base_address, field->reg) & mask) >> field->offset;
+            server_client_queue(client, REGISTER_OP_GET | REGISTER_OP_REPLY, request.field, value, request.tag);
+        }
+    }
+    if (staged) {
+        tx_commit(&tx, NULL);
+        server->transactions++;
+        committed = 1;
+    }
+
+    client->input_length -= offset;
+    memmove(client->input, client->input + offset, client->input_length);
+    return committed;
+}
+
+void server_accept(RegisterServer *server) {
+    for (;;) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("Erro ao aceitar cliente");
+            }
+            return;
+        }
+        if (server->client_count == server->client_capacity) {
+            int capacity = server->client_capacity ? server->client_capacity * 2 : 64;
+            ServerClient **clients = realloc(server->clients, capacity * sizeof(ServerClient *));
+            if (clients == NULL) {
+                perror("Erro ao alocar a lista de clientes");
+                close(fd);
+                continue;
+            }
+            server->clients = clients;
+            server->client_capacity = capacity;
+        }
+        ServerClient *client = calloc(1, sizeof(ServerClient));
+        if (client == NULL) {
+            perror("Erro ao alocar cliente");
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        struct epoll_event event = {EPOLLIN, {.ptr = client}};
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        server->clients[server->client_count++] = client;
+        server->accepted++;
+    }
+}
+
+// Lê do cliente até esvaziar o socket, atendendo as mensagens a cada leitura
+int server_client_readable(RegisterServer *server, ServerClient *client) {
+    int committed = 0;
+    for (;;) {
+        ssize_t received = recv(client->fd, client->input + client->input_length,
+                                SERVER_INPUT_SIZE - client->input_length, MSG_DONTWAIT);
+        if (received == 0) {
+            client->closing = 1;
+            break;
+        }
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                client->closing = 1;
+            }
+            break;
+        }
+        client->input_length += received;
+        committed |= server_client_process(server, client);
+        if (client->closing) {
+            break;
+        }
+    }
+    server_client_flush(server, client);
+    return committed;
+}
+
+int run_daemon(char *base_address) {
+    RegisterServer server;
+    memset(&server, 0, sizeof(server));
+    server.base_address = base_address;
+    raise_open_file_limit();
+
+    struct sockaddr_un address;
+    server_socket_address(&address);
+    server.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server.listen_fd < 0) {
+        perror("Erro ao criar o socket");
+        return -1;
+    }
+    // Um socket antigo só é removido se nenhum servidor responder nele
+    if (connect(server.listen_fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+        fprintf(stderr, "Erro: já existe um servidor em %s\n", REGISTER_SOCKET_PATH);
+        close(server.listen_fd);
+        return -1;
+    }
+    unlink(REGISTER_SOCKET_PATH);
+    if (bind(server.listen_fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        listen(server.listen_fd, SOMAXCONN) == -1) {
+        perror("Erro ao abrir o socket do servidor");
+        close(server.listen_fd);
+        return -1;
+    }
+
+    RegisterSnapshot snapshot;
+    registers_snapshot(base_address, &snapshot);
+    memcpy(server.published, snapshot.regs, sizeof(server.published));
+    if (register_watcher_start(&server.watcher, base_address) == -1) {
+        close(server.listen_fd);
+        unlink(REGISTER_SOCKET_PATH);
+        return -1;
+    }
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server.epoll_fd < 0) {
+        perror("Erro ao criar o epoll do servidor");
+        register_watcher_stop(&server.watcher);
+        close(server.listen_fd);
+        unlink(REGISTER_SOCKET_PATH);
+        return -1;
+    }
+    server.wake_fd = server.watcher.event_fd;
+    struct epoll_event event = {EPOLLIN, {.ptr = &server.listen_fd}};
+    int registered = epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &event);
+    event.data.ptr = &server.wake_fd;
+    if (registered == -1 || epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.wake_fd, &event) == -1) {
+        perror("Erro ao registrar o socket do servidor no epoll");
+        register_watcher_stop(&server.watcher);
+        close(server.epoll_fd);
+        close(server.listen_fd);
+        unlink(REGISTER_SOCKET_PATH);
+        return -1;
+    }
+    daemon_wake_fd = server.wake_fd;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = daemon_signal_handler;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    fprintf(stderr, "servidor em %s (pid %d)\n", REGISTER_SOCKET_PATH, getpid());
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!daemon_stop_requested) {
+        int ready = epoll_wait(server.epoll_fd, events, SERVER_MAX_EVENTS, 1000);
+        if (ready < 0 && errno != EINTR) {
+            perror("Erro no epoll_wait");
+            break;
+        }
+        int publish = 0;
+        for (int i = 0; i < ready; i++) {
+            void *source = events[i].data.ptr;
+            if (source == &server.listen_fd) {
+                server_accept(&server);
+            } else if (source == &server.wake_fd) {
+                unsigned long long count;
+                if (read(server.wake_fd, &count, sizeof(count)) > 0) {
+                    publish = 1;
+                }
+            } else {
+                ServerClient *client = source;
+                if (events[i].events & EPOLLOUT) {
+                    server_client_flush(&server, client);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    publish |= server_client_readable(&server, client);
+                }
+            }
+        }
+        if (publish) {
+            server_publish(&server);
+        }
+        for (int c = server.client_count - 1; c >= 0; c--) {
+            if (server.clients[c]->closing) {
+                server.dropped += server.clients[c]->output_length > server.clients[c]->output_sent;
+                server_client_close(&server, c);
+            }
+        }
+    }
+
+    register_watcher_stop(&server.watcher);
+    while (server.client_count > 0) {
+        server_client_close(&server, server.client_count - 1);
+    }
+    free(server.clients);
+    close(server.listen_fd);
+    close(server.epoll_fd);
+    unlink(REGISTER_SOCKET_PATH);
+    fprintf(stderr, "servidor encerrado: %ld clientes, %ld requisições, %ld transações, %ld eventos, %ld desconectados com respostas pendentes\n",
+            server.accepted, server.requests, server.transactions, server.events, server.dropped);
+    return 0;
+}
+
+// GERADOR DE CARGA DO SERVIDOR
+// Abre muitas conexões com o servidor, divididas entre algumas threads, e
+// mantém em cada uma até depth requisições em voo (GETs de campos quaisquer
+// e SETs das cores, enviados em lote). Uma a cada dez conexões também assina
+// todos os campos e conta os eventos. Informa requisições por segundo e a
+// latência de cada requisição (envio até a resposta).
+#define LOAD_MAX_THREADS 4
+#define LOAD_MAX_SAMPLES (1 << 20) // Latências guardadas por thread
+
+typedef struct {
+    int fd;
+    unsigned char input[SERVER_INPUT_SIZE];
+    int input_length;
+    long *sent_ns;        // Instante de envio das requisições em voo (fila circular)
+    int in_flight, oldest;
+    unsigned int next_tag;
+} LoadConnection;
+
+typedef struct {
+    LoadConnection *connections;
+    int count, depth;
+    long deadline_ns;
+    unsigned int seed;
+    long requests, events, errors;
+    long *latencies;
+    long latency_count;
+    int failed;
+} LoadWorker;
+
+int load_connect(void) {
+    struct sockaddr_un address;
+    server_socket_address(&address);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+// Completa as requisições em voo da conexão, todas em um único send
+int load_refill(LoadWorker *worker, LoadConnection *connection) {
+    static const unsigned char color_fields[] = {FIELD_red_INDEX, FIELD_green_INDEX, FIELD_blue_INDEX};
+    RegisterMessage batch[256];
+    int count = 0;
+    long now = monotonic_ns();
+
+    while (connection->in_flight < worker->depth && count < 256) {
+        RegisterMessage *message = &batch[count++];
+        unsigned int r = rand_r(&worker->seed);
+        if ((r & 3) == 0) {
+            message->op = REGISTER_OP_SET;
+            message->field = color_fields[(r >> 2) % 3];
+            message->value = (r >> 4) & ((1u << register_fields[message->field].width) - 1);
+        } else {
+            message->op = REGISTER_OP_GET;
+            message->field = (r >> 2) % REGISTER_FIELD_COUNT;
+            message->value = 0;
+        }
+        message->tag = connection->next_tag++;
+        connection->sent_ns[(connection->oldest + connection->in_flight) % worker->depth] = now;
+        connection->in_flight++;
+    }
+    if (count > 0 && send(connection->fd, batch, count * sizeof(RegisterMessage), MSG_NOSIGNAL) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+void *load_worker_thread(void *arg) {
+    LoadWorker *worker = arg;
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    for (int i = 0; i < worker->count; i++) {
+        LoadConnection *connection = &worker->connections[i];
+        struct epoll_event event = {EPOLLIN, {.ptr = connection}};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection->fd, &event);
+        if (load_refill(worker, connection) == -1) {
+            worker->failed = 1;
+        }
+    }
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!worker->failed && monotonic_ns() < worker->deadline_ns) {
+        int ready = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, 10);
+        long now = monotonic_ns();
+        for (int i = 0; i < ready; i++) {
+            LoadConnection *connection = events[i].data.ptr;
+            ssize_t received = recv(connection->fd, connection->input + connection->input_length,
+                                    SERVER_INPUT_SIZE - connection->input_length, MSG_DONTWAIT);
+            if (received <= 0) {
+                if (received == 0 || (errno != EAGAIN && errno != EINTR)) {
+                    worker->failed = 1;
+                }
+                continue;
+            }
+            connection->input_length += received;
+
+            int offset = 0;
+            for (; offset + (int)sizeof(RegisterMessage) <= connection->input_length; offset += sizeof(RegisterMessage)) {
+                RegisterMessage reply;
+                memcpy(&reply, connection->input + offset, sizeof(reply));
+                if (reply.op == REGISTER_OP_EVENT) {
+                    worker->events++;
+                    continue;
+                }
+                if (reply.op == REGISTER_OP_ERROR) {
+                    worker->errors++;
+                }
+                long latency = now - connection->sent_ns[connection->oldest];
+                connection->oldest = (connection->oldest + 1) % worker->depth;
+                connection->in_flight--;
+                worker->requests++;
+                if (worker->latency_count < LOAD_MAX_SAMPLES) {
+                    worker->latencies[worker->latency_count++] = latency;
+                }
+            }
+            connection->input_length -= offset;
+            memmove(connection->input, connection->input + offset, connection->input_length);
+            if (load_refill(worker, connection) == -1) {
+                worker->failed = 1;
+            }
+        }
+    }
+    close(epoll_fd);
+    return NULL;
+}
+
+// Envia uma requisição e espera a resposta dela, ignorando eventos
+int load_request(int fd, unsigned char op, unsigned char field, unsigned short value, RegisterMessage *reply) {
+    RegisterMessage request = {op, field, value, 0};
+    if (send(fd, &request, sizeof(request), MSG_NOSIGNAL) != sizeof(request)) {
+        return -1;
+    }
+    do {
+        if (recv(fd, reply, sizeof(*reply), MSG_WAITALL) != sizeof(*reply)) {
+            return -1;
+        }
+    } while (reply->op == REGISTER_OP_EVENT);
+    return reply->op == REGISTER_OP_ERROR ? -1 : 0;
+}
+
+int run_daemon_load(int clients, double seconds, int depth) {
+    raise_open_file_limit();
+    int threads = clients < LOAD_MAX_THREADS ? clients : LOAD_MAX_THREADS;
+    LoadConnection *connections = calloc(clients, sizeof(LoadConnection));
+    if (connections == NULL) {
+        perror("Erro ao alocar as conexões");
+        return -1;
+    }
+    LoadWorker workers[LOAD_MAX_THREADS];
+    pthread_t thread_ids[LOAD_MAX_THREADS];
+    const unsigned char color_fields[] = {FIELD_red_INDEX, FIELD_green_INDEX, FIELD_blue_INDEX};
+    unsigned short saved_colors[3];
+    RegisterMessage reply;
+    int result = 0;
+
+    // Conexões ainda não abertas ficam com -1, para a limpeza saber o que fechar
+    for (int i = 0; i < clients; i++) {
+        connections[i].fd = -1;
+    }
+    for (int opened = 0; opened < clients; opened++) {
+        LoadConnection *connection = &connections[opened];
+        connection->fd = load_connect();
+        if (connection->fd == -1) {
+            fprintf(stderr, "Erro ao conectar ao servidor em %s: %s\n", REGISTER_SOCKET_PATH, strerror(errno));
+            result = -1;
+            goto done;
+        }
+        connection->sent_ns = malloc(depth * sizeof(long));
+        if (connection->sent_ns == NULL) {
+            perror("Erro ao alocar as requisições em voo");
+            result = -1;
+            goto done;
+        }
+        // Uma a cada dez conexões também assina todos os campos
+        if (opened % 10 == 0 && load_request(connection->fd, REGISTER_OP_SUBSCRIBE, REGISTER_FIELD_ALL, 0, &reply) == -1) {
+            fprintf(stderr, "Erro: o servidor recusou a assinatura\n");
+            result = -1;
+            goto done;
+        }
+    }
+    // As cores são alteradas pela carga e restauradas no fim
+    for (int i = 0; i < 3; i++) {
+        if (load_request(connections[0].fd, REGISTER_OP_GET, color_fields[i], 0, &reply) == -1) {
+            result = -1;
+            goto done;
+        }
+        saved_colors[i] = reply.value;
+    }
+
+    long started = monotonic_ns();
+    for (int t = 0; t < threads; t++) {
+        LoadWorker *worker = &workers[t];
+        memset(worker, 0, sizeof(*worker));
+        worker->connections = connections + (long)clients * t / threads;
+        worker->count = (int)((long)clients * (t + 1) / threads - (long)clients * t / threads);
+        worker->depth = depth;
+        worker->deadline_ns = started + (long)(seconds * 1e9);
+        worker->seed = 1234 + t;
+        worker->latencies = malloc(LOAD_MAX_SAMPLES * sizeof(long));
+        if (worker->latencies == NULL) {
+            perror("Erro ao alocar as latências");
+            while (t-- > 0) {
+                free(workers[t].latencies);
+            }
+            result = -1;
+            goto done;
+        }
+    }
+    // Se uma thread não puder ser criada, as já iniciadas terminam a carga normalmente
+    int running = 0;
+    for (; running < threads; running++) {
+        int error = pthread_create(&thread_ids[running], NULL, load_worker_thread, &workers[running]);
+        if (error != 0) {
+            fprintf(stderr, "Erro ao criar a thread de carga: %s\n", strerror(error));
+            result = -1;
+            break;
+        }
+    }
+
+    long requests = 0, events = 0, errors = 0, samples = 0;
+    int failed = 0;
+    for (int t = 0; t < running; t++) {
+        pthread_join(thread_ids[t], NULL);
+        requests += workers[t].requests;
+        events += workers[t].events;
+        errors += workers[t].errors;
+        samples += workers[t].latency_count;
+        failed |= workers[t].failed;
+    }
+    double elapsed = (monotonic_ns() - started) / 1e9;
+
+    long *latencies = malloc((samples ? samples : 1) * sizeof(long));
+    long filled = 0;
+    for (int t = 0; t < threads; t++) {
+        if (latencies != NULL) {
+            memcpy(latencies + filled, workers[t].latencies, workers[t].latency_count * sizeof(long));
+            filled += workers[t].latency_count;
+        }
+        free(workers[t].latencies);
+    }
+    if (latencies == NULL) {
+        perror("Erro ao alocar as latências");
+        result = -1;
+    } else {
+        qsort(latencies, samples, sizeof(long), compare_long);
+        printf("clients,depth,seconds,requests,requests_per_sec,p50_us,p99_us,p999_us,max_us,events,errors\n");
+        printf("%d,%d,%.2f,%ld,%.0f,%.1f,%.1f,%.1f,%.1f,%ld,%ld\n", clients, depth, elapsed, requests, requests / elapsed,
+               percentile_sorted(latencies, samples, 50) / 1e3, percentile_sorted(latencies, samples, 99) / 1e3,
+               percentile_sorted(latencies, samples, 99.9) / 1e3, samples ? latencies[samples - 1] / 1e3 : 0.0,
+               events, errors);
+        free(latencies);
+    }
+    if (failed) {
+        fprintf(stderr, "Erro: o servidor fechou conexões durante a carga\n");
+        result = -1;
+    }
+
+    // Conexão nova para restaurar as cores: as antigas podem ter respostas pendentes
+    int fd = load_connect();
+    for (int i = 0; fd != -1 && i < 3; i++) {
+        load_request(fd, REGISTER_OP_SET, color_fields[i], saved_colors[i], &reply);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+
+done:
+    for (int i = 0; i < clients; i++) {
+        if (connections[i].fd != -1) {
+            close(connections[i].fd);
+        }
+        free(connections[i].sent_ns);
+    }
+    free(connections);
+    return result;
+}
+
+// BENCHMARK DAS OPERAÇÕES DE REGISTRADORES
+// Mede cada operação com uma e com várias threads, sobre o arquivo mapeado e
+// sobre um buffer comum em memória com o mesmo layout. A saída é CSV:
+// memória, operação, threads, modo verboso, ns/op, latência p50/p99 e vazão.
+typedef void (*BenchOperation)(char *base_address, long i);
+
+void bench_op_intensity_R(char *base_address, long i) { set_intensity_R(base_address, i & 0xFF); }
+void bench_op_intensity_G(char *base_address, long i) { set_intensity_G(base_address, i & 0xFF); }
+void bench_op_intensity_B(char *base_address, long i) { set_intensity_B(base_address, i & 0xFF); }
+void bench_op_battery(char *base_address, long i) { set_battery_level(base_address, i & 0x3); }
+void bench_op_temperature(char *base_address, long i) { set_led_temperature(base_address, i & 0x3FF); }
+void bench_op_led_status(char *base_address, long i) { set_led_status(base_address, i & 1); }
+void bench_op_color_rgb(char *base_address, long i) { set_color_rgb(base_address, i & 0xFF, (i >> 1) & 0xFF, (i >> 2) & 0xFF, NULL); }
+void bench_op_text_display(char *base_address, long i) { configure_text_display(base_address, (i & 1) ? "HELLO" : "WORLD"); }
+void bench_op_print_message(char *base_address, long i) { print_message_with_color_and_rgb((i & 1) ? "HELLO WORLD" : "OLA MUNDO", base_address); }
+
+typedef struct {
+    const char *name;
+    BenchOperation run;
+} BenchCase;
+
+const BenchCase bench_cases[] = {
+    {"set_intensity_R", bench_op_intensity_R},
+    {"set_intensity_G", bench_op_intensity_G},
+    {"set_intensity_B", bench_op_intensity_B},
+    {"set_battery_level", bench_op_battery},
+    {"set_led_temperature", bench_op_temperature},
+    {"set_led_status", bench_op_led_status},
+    {"set_color_rgb", bench_op_color_rgb},
+    {"configure_text_display", bench_op_text_display},
+    {"print_message_with_color_and_rgb", bench_op_print_message},
+};
+
+typedef struct {
+    char *base_address;
+    BenchOperation run;
+    long iterations;
+    long *latencies; // NULL na rodada de vazão, sem medição por chamada
+} BenchThread;
+
+void *bench_thread(void *arg) {
+    BenchThread *bench = (BenchThread *)arg;
+    if (bench->latencies == NULL) {
+        for (long i = 0; i < bench->iterations; i++) {
+            bench->run(bench->base_address, i);
+        }
+        return NULL;
+    }
+    for (long i = 0; i < bench->iterations; i++) {
+        long start = monotonic_ns();
+        bench->run(bench->base_address, i);
+        bench->latencies[i] = monotonic_ns() - start;
+    }
+    return NULL;
+}
+
+typedef struct {
+    double ns_per_op;
+    long p50_ns;
+    long p99_ns;
+    double ops_per_sec;
+} BenchResult;
+
+BenchResult bench_measure(char *base_address, BenchOperation run, int threads, long iterations) {
+    BenchThread state[64];
+    pthread_t ids[64];
+    long *latencies = malloc(threads * iterations * sizeof(long));
+    BenchResult result;
+
+    // Aquecimento, sem medição
+    for (long i = 0; i < iterations / 10; i++) {
+        run(base_address, i);
+    }
+
+    // Rodada de vazão (sem custo do relógio) e rodada de latência por chamada
+    double elapsed = 0;
+    for (int timed = 0; timed <= 1; timed++) {
+        double start = monotonic_seconds();
+        for (int t = 0; t < threads; t++) {
+            state[t] = (BenchThread){base_address, run, iterations, timed ? latencies + t * iterations : NULL};
+            pthread_create(&ids[t], NULL, bench_thread, &state[t]);
+        }
+        for (int t = 0; t < threads; t++) {
+            pthread_join(ids[t], NULL);
+        }
+        if (!timed) {
+            elapsed = monotonic_seconds() - start;
+        }
+    }
+
+    long total = threads * iterations;
+    qsort(latencies, total, sizeof(long), compare_long);
+    result.ns_per_op = elapsed * 1e9 * threads / total;
+    result.p50_ns = percentile_sorted(latencies, total, 50);
+    result.p99_ns = percentile_sorted(latencies, total, 99);
+    result.ops_per_sec = total / elapsed;
+    free(latencies);
+    return result;
+}
+
+int run_bench(char *mapped_base, long iterations) {
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) {
+        cores = 1;
+    }
+    if (cores > 64) {
+        cores = 64;
+    }
+
+    char *memory_base = aligned_alloc(CACHE_LINE_SIZE, FILE_SIZE);
+    memcpy(memory_base, mapped_base, FILE_SIZE);
+    unsigned short saved[REGISTER_COUNT];
+    memcpy(saved, mapped_base, sizeof(saved));
+
+    // A saída das operações que imprimem vai para /dev/null durante as medições
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    int case_count = sizeof(bench_cases) / sizeof(bench_cases[0]);
+    int thread_counts[2] = {1, cores};
+    int thread_variants = cores > 1 ? 2 : 1;
+    int result_count = 2 * case_count * thread_variants * 2;
+    BenchResult *results = malloc(result_count * sizeof(BenchResult));
+    int previous_verbose = registers_verbose;
+    int r = 0;
+
+    for (int memory = 0; memory < 2; memory++) {
+        char *base_address = memory == 0 ? mapped_base : memory_base;
+        for (int c = 0; c < case_count; c++) {
+            for (int v = 0; v < thread_variants; v++) {
+                for (int verbose = 0; verbose <= 1; verbose++) {
+                    registers_verbose = verbose;
+                    results[r++] = bench_measure(base_address, bench_cases[c].run, thread_counts[v], iterations);
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+    registers_verbose = previous_verbose;
+
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    printf("memory,operation,threads,verbose,ns_per_op,p50_ns,p99_ns,ops_per_sec\n");
+    r = 0;
+    for (int memory = 0; memory < 2; memory++) {
+        for (int c = 0; c < case_count; c++) {
+            for (int v = 0; v < thread_variants; v++) {
+                for (int verbose = 0; verbose <= 1; verbose++) {
+                    BenchResult *result = &results[r++];
+                    printf("%s,%s,%d,%d,%.1f,%ld,%ld,%.0f\n", memory == 0 ? "mmap" : "buffer",
+                           bench_cases[c].name, thread_counts[v], verbose, result->ns_per_op,
+                           result->p50_ns, result->p99_ns, result->ops_per_sec);
+                }
+            }
+        }
+    }
+
+    // Restaura os registradores do arquivo mapeado
+    registers_write_all(mapped_base, saved);
+
+    free(results);
+    free(memory_base);
+    return 0;
+}
+
+// BENCHMARK DO BANCO DE DISPOSITIVOS
+// Atualiza a cor de todos os dispositivos a cada quadro, com e sem
+// MAP_POPULATE/MADV_HUGEPAGE. O primeiro quadro mostra o custo das falhas de
+// página; os demais, a vazão em regime.
+typedef struct {
+    int frame;
+} BankFrame;
+
+void bank_frame_color(char *device_base, void *arg) {
+    BankFrame *frame = (BankFrame *)arg;
+    int level = frame->frame & 0xFF;
+    set_color_rgb(device_base, level, 255 - level, level / 2, NULL);
+}
+
+int run_bank_bench(int devices, int frames) {
+    printf("populate,huge_pages,devices,frames,first_frame_ms,ms_per_frame,devices_per_sec\n");
+    for (int flags = 0; flags <= (BANK_POPULATE | BANK_HUGE_PAGES); flags++) {
+        RegisterBank bank;
+        unlink(BANK_FILE_PATH);
+
+        double open_start = monotonic_seconds();
+        if (bank_open(&bank, BANK_FILE_PATH, devices, flags) == -1) {
+            return -1;
+        }
+
+        BankFrame frame = {0};
+        bank_apply_range(&bank, 0, devices, bank_frame_color, &frame);
+        double first_frame = monotonic_seconds() - open_start;
+
+        double start = monotonic_seconds();
+        for (frame.frame = 1; frame.frame <= frames; frame.frame++) {
+            bank_apply_range(&bank, 0, devices, bank_frame_color, &frame);
+        }
+        double elapsed = monotonic_seconds() - start;
+
+        printf("%d,%d,%d,%d,%.3f,%.3f,%.0f\n", (flags & BANK_POPULATE) != 0, (flags & BANK_HUGE_PAGES) != 0,
+               devices, frames, first_frame * 1e3, elapsed * 1e3 / frames, (double)devices * frames / elapsed);
+        bank_close(&bank);
+    }
+    return 0;
+}
+
+// BENCHMARK DAS CENAS
+// Alterna todos os dispositivos de um banco entre as cenas de exemplo de duas
+// formas: comando a comando pelos setters (script_execute_line, como o painel
+// faria) e pela cena compilada. Antes confere, a partir de estados
+// aleatórios, que as duas formas deixam R0-R15 iguais.
+#define SCENE_BENCH_MAX_LINES 64
+
+static const char scene_bench_text[] =
+    "[alerta]\nled 1\nrgb 255 0 0\ntext ALERTA\nbattery 3\ntemp 900\n"
+    "[noite]\nled 1\ncolor 32 16 64\ntext BOA NOITE\n"
+    "[desligado]\nled 0\ntext\n"
+    "[bateria]\nbattery 1\ntemp 250\ngreen 128\n";
+
+int run_scene_bench(int devices, int passes) {
+    SceneLibrary library = {NULL};
+    char text[sizeof(scene_bench_text)];
+    memcpy(text, scene_bench_text, sizeof(text));
+    int scene_count = scene_library_parse(&library, text, "cenas de exemplo");
+    if (scene_count <= 0) {
+        return -1;
+    }
+
+    // Comandos de cada cena para o caminho pelos setters
+    char commands[sizeof(scene_bench_text)];
+    char *lines[SCENE_BENCH_MAX_LINES];
+    int first_line[SCENE_BENCH_MAX_LINES + 1];
+    int line_count = 0, scene = -1;
+    memcpy(commands, scene_bench_text, sizeof(commands));
+    for (char *line = strtok(commands, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        if (*line == '[') {
+            first_line[++scene] = line_count;
+        } else {
+            lines[line_count++] = line;
+        }
+    }
+    first_line[scene_count] = line_count;
+
+    RegisterBank bank;
+    unlink(BANK_FILE_PATH);
+    if (bank_open(&bank, BANK_FILE_PATH, devices, BANK_POPULATE) == -1) {
+        scene_library_free(&library);
+        return -1;
+    }
+    int previous_verbose = registers_verbose;
+    registers_verbose = 0;
+
+    // Conferência: mesmo estado inicial, setters contra cena compilada
+    long mismatched = 0;
+    srand(1234);
+    for (int i = 0; i < devices; i++) {
+        unsigned short initial[REGISTER_COUNT], by_setters[REGISTER_COUNT];
+        char *device = bank_device(&bank, i);
+        int s = i % scene_count;
+        for (int reg = 0; reg < REGISTER_COUNT; reg++) {
+            initial[reg] = rand() & 0xFFFF;
+        }
+        field_put_text_encoding(initial, TEXT_ENCODING_ASCII); // Cenas com texto gravam ascii
+        registers_write_all(device, initial);
+        for (int l = first_line[s]; l < first_line[s + 1]; l++) {
+            script_execute_line(device, lines[l]);
+        }
+        memcpy(by_setters, device, sizeof(by_setters));
+        registers_write_all(device, initial);
+        scene_apply(device, &library.scenes[s]);
+        mismatched += memcmp(by_setters, device, sizeof(by_setters)) != 0;
+    }
+    printf("check,devices,scenes,mismatched_devices\n");
+    printf("check,%d,%d,%ld\n", devices, scene_count, mismatched);
+
+    printf("path,devices,passes,devices_per_sec,ns_per_device\n");
+    double start = monotonic_seconds();
+    for (int pass = 0; pass < passes; pass++) {
+        int s = pass % scene_count;
+        for (int i = 0; i < devices; i++) {
+            for (int l = first_line[s]; l < first_line[s + 1]; l++) {
+                script_execute_line(bank_device(&bank, i), lines[l]);
+            }
+        }
+    }
+    double elapsed = monotonic_seconds() - start;
+    printf("setters,%d,%d,%.0f,%.1f\n", devices, passes, (double)devices * passes / elapsed,
+           elapsed * 1e9 / ((double)devices * passes));
+
+    start = monotonic_seconds();
+    for (int pass = 0; pass < passes; pass++) {
+        const Scene *next = scene_find(&library, library.scenes[pass % scene_count].name);
+        scene_apply_range(&bank, 0, devices, next);
+    }
+    elapsed = monotonic_seconds() - start;
+    printf("scene,%d,%d,%.0f,%.1f\n", devices, passes, (double)devices * passes / elapsed,
+           elapsed * 1e9 / ((double)devices * passes));
+
+    registers_verbose = previous_verbose;
+    bank_close(&bank);
+    scene_library_free(&library);
+    return mismatched == 0 ? 0 : -1;
+}
+
+// VERIFICAÇÃO E BENCHMARK DOS KERNELS DE COR
+// Compara cada versão dos kernels com o resultado dos setters escalares
+// (set_intensity_R/G/B) e mede a vazão em dispositivos por segundo.
+typedef void (*ColorKernel)(char *base_address, int count, const ColorKernelOp *op);
+
+typedef struct {
+    const char *name;
+    ColorKernel run;
+    int available;
+} ColorKernelVariant;
+
+// Resultado de referência pelos setters: decodifica, aplica a fórmula e regrava
+void color_reference_setters(char *base_address, int count, const ColorKernelOp *op) {
+    for (int i = 0; i < count; i++) {
+        char *device = base_address + (size_t)i * DEVICE_STRIDE;
+        unsigned short *regs = REG_PTR(device, 0);
+        int red = field_get_red(regs), green = field_get_green(regs);
+        set_intensity_R(device, color_component_apply((red << 3) | (red >> 2), op->target[0], op));
+        set_intensity_G(device, color_component_apply((green << 2) | (green >> 4), op->target[1], op));
+        set_intensity_B(device, color_component_apply(field_get_blue(regs), op->target[2], op));
+    }
+}
+
+// Conta os dispositivos cujos registradores R0-R15 diferem
+int color_compare_devices(const char *a, const char *b, int count) {
+    int mismatches = 0;
+    for (int i = 0; i < count; i++) {
+        if (memcmp(a + (size_t)i * DEVICE_STRIDE, b + (size_t)i * DEVICE_STRIDE,
+                   REGISTER_COUNT * sizeof(unsigned short)) != 0) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+int run_color_kernels(int devices, int passes) {
+    size_t size = (size_t)devices * DEVICE_STRIDE;
+    char *original = aligned_alloc(CACHE_LINE_SIZE, size);
+    char *expected = aligned_alloc(CACHE_LINE_SIZE, size);
+    char *actual = aligned_alloc(CACHE_LINE_SIZE, size);
+    unsigned char *planes = malloc(6 * (size_t)devices);
+    unsigned char *red = planes, *green = planes + devices, *blue = planes + 2 * (size_t)devices;
+    unsigned char *out = planes + 3 * (size_t)devices;
+    int failures = 0;
+
+    srand(1234);
+    for (size_t i = 0; i < size; i++) {
+        original[i] = rand() & 0xFF;
+    }
+    for (int i = 0; i < devices; i++) {
+        memset(original + (size_t)i * DEVICE_STRIDE + SEQUENCE_OFFSET, 0, DEVICE_STRIDE - SEQUENCE_OFFSET);
+        red[i] = rand() & 0xFF;
+        green[i] = rand() & 0xFF;
+        blue[i] = rand() & 0xFF;
+    }
+
+    ColorKernelVariant variants[] = {
+        {"scalar", color_kernel_scalar, 1},
+#ifdef HAVE_X86_SIMD
+        {"sse2", color_kernel_sse2, 1},
+        {"avx2", color_kernel_avx2, __builtin_cpu_supports("avx2")},
+#endif
+    };
+    int variant_count = sizeof(variants) / sizeof(variants[0]);
+    ColorKernelOp ops[] = {
+        {256, 0, {0, 0, 0}, 0},       // Identidade
+        {128, 0, {0, 0, 0}, 0},       // Metade do brilho
+        {256, 96, {255, 40, 0}, 0},   // Mistura com laranja
+        {200, 64, {0, 0, 255}, 1},    // Brilho, mistura e gama
+    };
+    int op_count = sizeof(ops) / sizeof(ops[0]);
+    int previous_verbose = registers_verbose;
+    registers_verbose = 0;
+
+    printf("check,variant,mismatched_devices\n");
+
+    // Empacotamento: mesmo resultado que set_intensity_R/G/B com as mesmas cores
+    memcpy(expected, original, size);
+    for (int i = 0; i < devices; i++) {
+        char *device = expected + (size_t)i * DEVICE_STRIDE;
+        set_intensity_R(device, red[i]);
+        set_intensity_G(device, green[i]);
+        set_intensity_B(device, blue[i]);
+    }
+    for (int variant = 0; variant < 2 && variant < variant_count; variant++) {
+        memcpy(actual, original, size);
+        if (variant == 0) {
+            color_pack_scalar(actual, devices, red, green, blue);
+        }
+#ifdef HAVE_X86_SIMD
+        else {
+            color_pack_sse2(actual, devices, red, green, blue);
+        }
+#endif
+        int mismatches = color_compare_devices(expected, actual, devices);
+        printf("pack,%s,%d\n", variants[variant].name, mismatches);
+        failures += mismatches;
+    }
+
+    // Desempacotamento: mesma decodificação dos campos gerados
+    for (int variant = 0; variant < 2 && variant < variant_count; variant++) {
+        if (variant == 0) {
+            color_unpack_scalar(expected, devices, out, out + devices, out + 2 * (size_t)devices);
+        }
+#ifdef HAVE_X86_SIMD
+        else {
+            color_unpack_sse2(expected, devices, out, out + devices, out + 2 * (size_t)devices);
+        }
+#endif
+        int mismatches = 0;
+        for (int i = 0; i < devices; i++) {
+            unsigned short *regs = REG_PTR(expected + (size_t)i * DEVICE_STRIDE, 0);
+            int r = field_get_red(regs), g = field_get_green(regs);
+            if (out[i] != ((r << 3) | (r >> 2)) || out[devices + i] != ((g << 2) | (g >> 4)) ||
+                out[2 * devices + i] != field_get_blue(regs)) {
+                mismatches++;
+            }
+        }
+        printf("unpack,%s,%d\n", variants[variant].name, mismatches);
+        failures += mismatches;
+    }
+
+    // Transformações: cada versão contra os setters
+    for (int o = 0; o < op_count; o++) {
+        memcpy(expected, original, size);
+        color_reference_setters(expected, devices, &ops[o]);
+        for (int variant = 0; variant < variant_count; variant++) {
+            if (!variants[variant].available) {
+                continue;
+            }
+            memcpy(actual, original, size);
+            variants[variant].run(actual, devices, &ops[o]);
+            int mismatches = color_compare_devices(expected, actual, devices);
+            printf("op%d,%s,%d\n", o, variants[variant].name, mismatches);
+            failures += mismatches;
+        }
+    }
+
+    // Vazão
+    printf("variant,devices,passes,devices_per_sec\n");
+    double start = monotonic_seconds();
+    for (int pass = 0; pass < passes; pass++) {
+        color_reference_setters(actual, devices, &ops[3]);
+    }
+    double elapsed = monotonic_seconds() - start;
+    printf("setters,%d,%d,%.0f\n", devices, passes, (double)devices * passes / elapsed);
+    registers_verbose = previous_verbose;
+
+    for (int variant = 0; variant < variant_count; variant++) {
+        if (!variants[variant].available) {
+            continue;
+        }
+        start = monotonic_seconds();
+        for (int pass = 0; pass < passes; pass++) {
+            variants[variant].run(actual, devices, &ops[3]);
+        }
+        elapsed = monotonic_seconds() - start;
+        printf("%s,%d,%d,%.0f\n", variants[variant].name, devices, passes, (double)devices * passes / elapsed);
+    }
+
+    free(planes);
+    free(actual);
+    free(expected);
+    free(original);
+    return failures == 0 ? 0 : -1;
+}
+
+// VERIFICAÇÃO E BENCHMARK DAS TABELAS DE COR
+// Confere as tabelas contra as fórmulas, mede o erro de um gradiente com e
+// sem pontilhamento e compara a conversão em lote por tabela com a conta de
+// bits por chamada (color_pack_scalar/color_unpack_scalar e printf).
+int color_check_gamma(const unsigned char *table, double exponent) {
+    int mismatches = 0;
+    for (int i = 0; i < 256; i++) {
+        mismatches += table[i] != (int)floor(255.0 * pow(i / 255.0, exponent) + 0.5);
+    }
+    return mismatches;
+}
+
+// Erro médio de um gradiente horizontal de vermelho (0-255 em 256 colunas,
+// 4 linhas) medido pela média de cada bloco 4x4, como o olho o percebe
+double color_gradient_error(int flags) {
+    double error = 0;
+    for (int x0 = 0; x0 < 256; x0 += 4) {
+        double wanted = 0, shown = 0;
+        for (int y = 0; y < 4; y++) {
+            for (int x = x0; x < x0 + 4; x++) {
+                unsigned int fields = color_encode_fields(x, 0, 0, color_threshold_row(x, y, flags), flags);
+                unsigned int r, g, b;
+                color_decode_fields(fields, &r, &g, &b, 0);
+                wanted += (flags & COLOR_GAMMA) ? color_gamma_encode[x] : x;
+                shown += r;
+            }
+        }
+        error += fabs(wanted - shown) / 16;
+    }
+    return error / 64;
+}
+
+int run_color_tables(int devices, int passes) {
+    size_t size = (size_t)devices * DEVICE_STRIDE;
+    char *bank = aligned_alloc(CACHE_LINE_SIZE, size);
+    unsigned char *planes = malloc(6 * (size_t)devices);
+    unsigned char *red = planes, *green = planes + devices, *blue = planes + 2 * (size_t)devices;
+    unsigned char *out = planes + 3 * (size_t)devices;
+    char *text = malloc((size_t)devices * COLOR_ESCAPE_MAX);
+    int width = 256;
+    int failures = 0;
+
+    memset(bank, 0, size);
+    srand(1234);
+    for (int i = 0; i < devices; i++) {
+        red[i] = rand() & 0xFF;
+        green[i] = rand() & 0xFF;
+        blue[i] = rand() & 0xFF;
+    }
+
+    printf("check,mismatches\n");
+    int mismatches = color_check_gamma(color_gamma_encode, 2.2) + color_check_gamma(color_gamma_decode, 1 / 2.2);
+    printf("gamma,%d\n", mismatches);
+    failures += mismatches;
+
+    // Expansão por tabela igual à replicação de bits dos kernels
+    mismatches = 0;
+    for (unsigned int fields = 0; fields < 0x10000; fields++) {
+        unsigned int r, g, b, r_bits, g_bits, b_bits;
+        color_decode_fields(fields, &r, &g, &b, 0);
+        color_lane_decode(fields, &r_bits, &g_bits, &b_bits);
+        mismatches += r != r_bits || g != g_bits;
+    }
+    printf("expand,%d\n", mismatches);
+    failures += mismatches;
+
+    // Quantização ao mais próximo e média dos 16 limiares de Bayer
+    mismatches = 0;
+    for (int v = 0; v < 256; v++) {
+        int red_sum = 0, green_sum = 0;
+        for (int row = 0; row < 16; row++) {
+            red_sum += color_red_levels[row][v];
+            green_sum += color_green_levels[row][v];
+        }
+        mismatches += color_red_levels[COLOR_NEAREST_ROW][v] != (int)floor(v * 31 / 255.0 + 0.5);
+        mismatches += color_green_levels[COLOR_NEAREST_ROW][v] != (int)floor(v * 63 / 255.0 + 0.5);
+        mismatches += fabs(red_sum / 16.0 - v * 31 / 255.0) > 0.5 || fabs(green_sum / 16.0 - v * 63 / 255.0) > 0.5;
+    }
+    printf("levels,%d\n", mismatches);
+    failures += mismatches;
+
+    // Ida e volta pelos registradores sem gama e com gama
+    for (int flags = 0; flags <= COLOR_GAMMA; flags += COLOR_GAMMA) {
+        mismatches = 0;
+        color_pack_lut(bank, devices, width, red, green, blue, flags);
+        color_unpack_lut(bank, devices, out, out + devices, out + 2 * (size_t)devices, flags);
+        for (int i = 0; i < devices; i++) {
+            unsigned int expected = color_encode_fields(red[i], green[i], blue[i], COLOR_NEAREST_ROW, flags);
+            mismatches += color_lane_load(bank + (size_t)i * DEVICE_STRIDE) != expected;
+            if (!flags) {
+                mismatches += abs(out[i] - red[i]) > 4 || abs(out[devices + i] - green[i]) > 2 ||
+                              out[2 * (size_t)devices + i] != blue[i];
+            }
+        }
+        printf("%s,%d\n", flags ? "roundtrip_gamma" : "roundtrip", mismatches);
+        failures += mismatches;
+    }
+
+    // Sequências de escape iguais às do printf
+    mismatches = 0;
+    for (int i = 0; i < devices; i++) {
+        char expected[COLOR_ESCAPE_MAX], actual[COLOR_ESCAPE_MAX];
+        int length = snprintf(expected, sizeof(expected), "\x1b[38;2;%d;%d;%dm", red[i], green[i], blue[i]);
+        mismatches += color_escape(actual, red[i], green[i], blue[i]) != length || strcmp(expected, actual) != 0;
+    }
+    printf("escape,%d\n", mismatches);
+    failures += mismatches;
+
+    printf("gradient,mode,mean_error\n");
+    printf("gradient,nearest,%.3f\n", color_gradient_error(COLOR_GAMMA));
+    printf("gradient,dither,%.3f\n", color_gradient_error(COLOR_GAMMA | COLOR_DITHER));
+
+    // Vazão em nanossegundos por dispositivo
+    printf("operation,variant,devices,passes,ns_per_device\n");
+    const char *pack_names[] = {"lut", "lut_gamma", "lut_gamma_dither"};
+    const int pack_flags[] = {0, COLOR_GAMMA, COLOR_GAMMA | COLOR_DITHER};
+    long started = monotonic_ns();
+    for (int pass = 0; pass < passes; pass++) {
+        color_pack_scalar(bank, devices, red, green, blue);
+    }
+    printf("pack,bits,%d,%d,%.2f\n", devices, passes, (double)(monotonic_ns() - started) / devices / passes);
+    for (int v = 0; v < 3; v++) {
+        started = monotonic_ns();
+        for (int pass = 0; pass < passes; pass++) {
+            color_pack_lut(bank, devices, width, red, green, blue, pack_flags[v]);
+        }
+        printf("pack,%s,%d,%d,%.2f\n", pack_names[v], devices, passes, (double)(monotonic_ns() - started) / devices / passes);
+    }
+
+    started = monotonic_ns();
+    for (int pass = 0; pass < passes; pass++) {
+        color_unpack_scalar(bank, devices, out, out + devices, out + 2 * (size_t)devices);
+    }
+    printf("unpack,bits,%d,%d,%.2f\n", devices, passes, (double)(monotonic_ns() - started) / devices / passes);
+    for (int v = 0; v < 2; v++) {
+        started = monotonic_ns();
+        for (int pass = 0; pass < passes; pass++) {
+            color_unpack_lut(bank, devices, out, out + devices, out + 2 * (size_t)devices, pack_flags[v]);
+        }
+        printf("unpack,%s,%d,%d,%.2f\n", pack_names[v], devices, passes, (double)(monotonic_ns() - started) / devices / passes);
+    }
+
+    // Cor do terminal de cada dispositivo a partir dos registradores
+    for (int table = 0; table < 2; table++) {
+        started = monotonic_ns();
+        for (int pass = 0; pass < passes; pass++) {
+            char *cursor = text;
+            for (int i = 0; i < devices; i++) {
+                unsigned int r, g, b;
+                if (table) {
+                    color_decode_fields(color_lane_load(bank + (size_t)i * DEVICE_STRIDE), &r, &g, &b, COLOR_GAMMA);
+                    cursor += color_escape(cursor, r, g, b);
+                } else {
+                    color_lane_decode(color_lane_load(bank + (size_t)i * DEVICE_STRIDE), &r, &g, &b);
+                    r = (int)floor(255.0 * pow(r / 255.0, 1 / 2.2) + 0.5);
+                    g = (int)floor(255.0 * pow(g / 255.0, 1 / 2.2) + 0.5);
+                    b = (int)floor(255.0 * pow(b / 255.0, 1 / 2.2) + 0.5);
+                    cursor += sprintf(cursor, "\x1b[38;2;%u;%u;%um", r, g, b);
+                }
+            }
+        }
+        printf("escape,%s,%d,%d,%.2f\n", table ? "lut_gamma" : "bits_pow_printf", devices, passes,
+               (double)(monotonic_ns() - started) / devices / passes);
+    }
+
+    free(text);
+    free(planes);
+    free(bank);
+    return failures == 0 ? 0 : -1;
+}
+
+// BENCHMARK DOS SNAPSHOTS
+// Sobre um banco grande, altera um número crescente de dispositivos e mede
+// captura, comparação e restauração (que devem acompanhar o número de
+// alterações), contra a captura por varredura da imagem inteira.
+int run_snapshot_bench(int devices) {
+    RegisterBank bank;
+    if (bank_open(&bank, BANK_FILE_PATH, devices, 0) == -1) {
+        return -1;
+    }
+    int previous_verbose = registers_verbose;
+    registers_verbose = 0;
+
+    SnapshotStore store;
+    long started = monotonic_ns();
+    if (snapshot_store_init(&store, bank.base_address, bank.size, devices) == -1) {
+        bank_close(&bank);
+        return -1;
+    }
+    printf("snapshot inicial: %d dispositivos em %.0f us\n", devices, (monotonic_ns() - started) / 1e3);
+    char *original = malloc(bank.size);
+    memcpy(original, bank.base_address, bank.size);
+
+    int status = 0;
+    printf("devices,changed,capture_us,diff_us,changed_words,restore_us,restored_blocks,scan_capture_us,restore_ok\n");
+    for (int changed = 1; ; changed *= 16) {
+        if (changed > devices) {
+            changed = devices;
+        }
+        int previous = store.count - 1;
+        for (int i = 0; i < changed; i++) {
+            char *device = bank_device(&bank, (int)((long)i * devices / changed));
+            set_intensity_B(device, (field_get_blue((const unsigned short *)device) + 1) & 0xFF);
+        }
 
-    // Limpa todos os bits do valor atual do registrador R2
-    //unsigned short value = 0;
+        started = monotonic_ns();
+        int captured = snapshot_capture(&store, 0);
+        double capture_us = (monotonic_ns() - started) / 1e3;
 
-    // Lê o valor atual do registrador R2
-    unsigned short value = *((unsigned short *)(base_address + (2 * sizeof(unsigned short))));
+        started = monotonic_ns();
+        long words = snapshot_diff(&store, previous, captured, NULL);
+        double diff_us = (monotonic_ns() - started) / 1e3;
 
-    // Limpa os bits correspondentes ao componente azul
-    value &= ~BLUE_MASK;
+        started = monotonic_ns();
+        int restored = snapshot_restore(&store, 0);
+        double restore_us = (monotonic_ns() - started) / 1e3;
 
-    // Define a intensidade do componente azul
-    value |= (intensity & 0xFF); // <--- Aqui está a correção
+        // Varredura completa: depois da restauração só os blocos restaurados diferem
+        started = monotonic_ns();
+        int scanned = snapshot_capture(&store, 1);
+        double scan_us = (monotonic_ns() - started) / 1e3;
 
-    // Escreve o novo valor no registrador R2
-    *((unsigned short *)(base_address + (2 * sizeof(unsigned short)))) = value;
-    //printf("Valor do registrador R1 após definir a intensidade do componente azul: %hu\n", value);
-}
+        // Conferência independente da restauração contra a cópia original
+        int restore_ok = snapshot_diff(&store, 0, scanned, NULL) == 0;
+        for (int block = 0; block < devices && restore_ok; block++) {
+            size_t offset = (size_t)block * DEVICE_STRIDE;
+            restore_ok = (block_diff_mask(bank.base_address + offset, original + offset) & ~SNAPSHOT_CONTROL_WORDS) == 0;
+        }
 
-void set_led_status(char* base_address, int status) {
-    // Verifica se o status é válido (0 ou 1)
-    if (status != 0 && status != 1) {
-        fprintf(stderr, "Erro: Status do LED inválido. Deve ser 0 (desligado) ou 1 (ligado).\n");
-        return;
+        printf("%d,%d,%.1f,%.1f,%ld,%.1f,%d,%.1f,%d\n", devices, changed, capture_us, diff_us, words,
+               restore_us, restored, scan_us, restore_ok);
+        if (words != changed || restored != changed || !restore_ok) {
+            status = -1;
+        }
+        if (changed == devices) {
+            break;
+        }
     }
 
-    // Lê o valor atual do registrador de controle
-    unsigned short control_register_value = *((unsigned short *)(base_address + (2 * sizeof(unsigned short))));
+    free(original);
+    snapshot_store_free(&store);
+    bank_close(&bank);
+    registers_verbose = previous_verbose;
+    return status;
+}
+
+// BENCHMARK DO ESCALONADOR DE ANIMAÇÕES
+// Executa 1, 10, ... até N animações sem ncurses (ciclos de cor e piscadas
+// sobre um buffer em memória) e mede atraso, descartes e CPU por quadro.
+int run_animation_bench(int max_animations, double seconds) {
+    if (max_animations > MAX_ANIMATIONS) {
+        max_animations = MAX_ANIMATIONS;
+    }
+    char *buffers = aligned_alloc(CACHE_LINE_SIZE, (size_t)max_animations * DEVICE_STRIDE);
+    Animation *animations = calloc(max_animations, sizeof(Animation));
+    ColorCycleState *cycles = calloc(max_animations, sizeof(ColorCycleState));
+    BlinkState *blinks = calloc(max_animations, sizeof(BlinkState));
+    memset(buffers, 0, (size_t)max_animations * DEVICE_STRIDE);
+    int status = 0;
 
-    // Limpa o bit correspondente ao status do LED (bit 9)
-    control_register_value &= ~(1 << 9);
+    printf("animations,frames,dropped,mean_jitter_us,max_jitter_us,cpu_percent,cpu_us_per_frame\n");
+    for (int count = 1; ; count *= 10) {
+        if (count > max_animations) {
+            count = max_animations;
+        }
+        AnimationScheduler scheduler = {.lock = PTHREAD_MUTEX_INITIALIZER};
+        if (animation_scheduler_start(&scheduler) == -1) {
+            status = -1;
+            break;
+        }
 
-    // Define o novo status do LED
-    control_register_value |= (status << 9);
+        for (int i = 0; i < count; i++) {
+            char *device = buffers + (size_t)i * DEVICE_STRIDE;
+            if (i % 2 == 0) {
+                cycles[i] = (ColorCycleState){device, i % 768};
+                animations[i] = (Animation){.name = "color_cycle", .step = animation_color_cycle_step, .state = &cycles[i]};
+                animation_add(&scheduler, &animations[i], 30 + i % 31);
+            } else {
+                blinks[i] = (BlinkState){device, 0x0F0F, 16, 0};
+                animations[i] = (Animation){.name = "blink", .step = animation_blink_step, .state = &blinks[i]};
+                animation_add(&scheduler, &animations[i], 10 + i % 11);
+            }
+        }
 
-    // Escreve o novo valor no registrador de controle
-    *((unsigned short *)(base_address + (2 * sizeof(unsigned short)))) = control_register_value;
+        struct rusage before, after;
+        getrusage(RUSAGE_SELF, &before);
+        usleep((useconds_t)(seconds * 1e6));
+        getrusage(RUSAGE_SELF, &after);
+        animation_scheduler_stop(&scheduler);
 
-    //printf("Status do LED atualizado para: %d\n", status);
-}
+        long frames = 0, dropped = 0, jitter = 0, max_jitter = 0;
+        for (int i = 0; i < count; i++) {
+            frames += animations[i].frames;
+            dropped += animations[i].dropped;
+            jitter += animations[i].total_jitter_ns;
+            if (animations[i].max_jitter_ns > max_jitter) {
+                max_jitter = animations[i].max_jitter_ns;
+            }
+        }
+        double cpu = (after.ru_utime.tv_sec - before.ru_utime.tv_sec) + (after.ru_utime.tv_usec - before.ru_utime.tv_usec) / 1e6 +
+                     (after.ru_stime.tv_sec - before.ru_stime.tv_sec) + (after.ru_stime.tv_usec - before.ru_stime.tv_usec) / 1e6;
+        printf("%d,%ld,%ld,%.1f,%.1f,%.2f,%.2f\n", count, frames, dropped,
+               frames ? jitter / 1000.0 / frames : 0.0, max_jitter / 1000.0,
+               cpu * 100.0 / seconds, frames ? cpu * 1e6 / frames : 0.0);
+        pthread_cond_destroy(&scheduler.changed);
 
-void set_battery_level(char* base_address, int level) {
-    // Verifica se o nível de bateria é válido (0 a 3)
-    if (level < 0 || level > 3) {
-        fprintf(stderr, "Erro: Nível de bateria inválido. Deve estar entre 0 e 3.\n");
-        return;
+        if (count == max_animations) {
+            break;
+        }
     }
 
-    // Lê o valor atual do registrador R3
-    unsigned short register_value = *((unsigned short *)(base_address + (3 * sizeof(unsigned short))));
+    free(blinks);
+    free(cycles);
+    free(animations);
+    free(buffers);
+    return status;
+}
 
-    // Limpa os bits correspondentes ao nível de bateria (bits 0 e 1)
-    register_value &= ~(0b11);
+// BENCHMARK DA RENDERIZAÇÃO
+// Letreiros e repinturas de menu sobre um terminal descartável, comparando a
+// fila com dirty regions contra o desenho direto (um wrefresh por pedido).
+int run_render_bench(double seconds) {
+    const char *mode_names[] = {"pipeline", "direct"};
+    MarqueeState marquees[8];
+    Animation animations[8];
+    char texts[8][16];
 
-    // Define o novo nível de bateria
-    register_value |= level;
-    int battery_level = register_value & 0b11;
+    printf("mode,requests,wrefresh,cells,bytes,bytes_per_s,requests_per_frame\n");
+    for (int direct = 0; direct <= 1; direct++) {
+        if (render_start(&renderer, 1, direct) == -1) {
+            return -1;
+        }
+        AnimationScheduler scheduler = {.lock = PTHREAD_MUTEX_INITIALIZER};
+        if (animation_scheduler_start(&scheduler) == -1) {
+            render_stop(&renderer);
+            return -1;
+        }
+        for (int i = 0; i < 8; i++) {
+            snprintf(texts[i], sizeof(texts[i]), "marquee %d", i);
+            marquees[i] = (MarqueeState){texts[i], 10 + i, i * 3};
+            animations[i] = (Animation){.name = "marquee", .step = animation_marquee_step, .state = &marquees[i]};
+            animation_add(&scheduler, &animations[i], 10 + i * 5);
+        }
 
-    // Escreve o novo valor no registrador R3
-    *((unsigned short *)(base_address + (3 * sizeof(unsigned short)))) = register_value;
+        // Repinta o menu a cada 20 ms, como faz o laço do painel
+        long started = monotonic_ns();
+        long bytes_before = renderer.bytes;
+        while (monotonic_ns() - started < (long)(seconds * 1e9)) {
+            limpar_linhas_painel();
+            exibir_menu_painel_led();
+            render_text(6, 2, "1");
+            usleep(20000);
+        }
+        double elapsed = (monotonic_ns() - started) / 1e9;
+        animation_scheduler_stop(&scheduler);
+        pthread_cond_destroy(&scheduler.changed);
 
-    //printf("Nível de bateria definido em binário para: %d%d\n", (battery_level >> 1) & 1, battery_level & 1);
+        long requests = renderer.requests, frames = renderer.frames, cells = renderer.cells;
+        render_stop(&renderer);
+        long bytes = renderer.bytes - bytes_before;
+        printf("%s,%ld,%ld,%ld,%ld,%.0f,%.1f\n", mode_names[direct], requests, frames, cells, bytes,
+               bytes / elapsed, frames ? (double)requests / frames : 0.0);
+    }
+    return 0;
 }
 
-void print_message_with_color_and_rgb(const char* message, char* base_address) {
-    // Verifica o status do LED (bit 9)
-    unsigned short control_register_value = *((unsigned short *)(base_address + (2 * sizeof(unsigned short))));
-    int led_status = (control_register_value >> 9) & 0x01;
+// BENCHMARK DA SESSÃO DO PAINEL
+// Roda a sessão com a saída descartada e a entrada vinda de um pipe. Mede o
+// custo de iniciar a sessão, a CPU do processo com a tela parada (só o
+// letreiro animado) e a latência entre escrever uma linha no pipe e a sessão
+// processá-la, inclusive respostas digitadas durante a confirmação.
+double process_cpu_seconds(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
 
-    // Se o LED estiver desligado, não imprime a mensagem
-    if (led_status == 0) {
-        printf("Led está desligado!");
-        return;
-    }
+void *ui_bench_session_thread(void *arg) {
+    ui_session_run((UiSession *)arg);
+    return NULL;
+}
 
-    // Mapeia a mensagem nos registradores de dados (R4 a R15)
-    int i;
-    for (i = 0; i < strlen(message) && (i + 4) < 16; i++) {
-        *((unsigned short *)(base_address + ((i + 4) * sizeof(unsigned short)))) = message[i];
+int run_ui_bench(char *base_address, double seconds, int line_count) {
+    // Percorre todos os menus; as respostas vêm logo após a escolha, sem esperar a confirmação
+    static const char *script[] = {"2", "3", "", "0", "1", "", "3", "500", "", "1", "3", "", "9", ""};
+    const int script_length = sizeof(script) / sizeof(script[0]);
+    unsigned short registers[REGISTER_COUNT];
+    memcpy(registers, base_address, sizeof(registers));
+    int input[2];
+    if (pipe(input) == -1) {
+        perror("Erro ao criar o pipe da entrada");
+        return -1;
     }
 
-    // Preenche os registradores de dados restantes com espaços em branco ou caracteres nulos
-    for (; i < 12; i++) {
-        *((unsigned short *)(base_address + ((i + 4) * sizeof(unsigned short)))) = ' ';
+    UiSession ui = {NULL};
+    long *written_ns = malloc(line_count * sizeof(long));
+    ui.processed_ns = malloc(line_count * sizeof(long));
+    ui.processed_capacity = line_count;
+    if (written_ns == NULL || ui.processed_ns == NULL) {
+        perror("Erro ao alocar as amostras");
+        goto fail;
     }
 
-    unsigned short blue_intensity = *((unsigned short *)(base_address + (2 * sizeof(unsigned short)))) & BLUE_MASK;
-
-    // Calcula o valor RGB com base nos bits de controle
-    int red_on = (control_register_value >> 10) & 0x01;
-    int green_on = (control_register_value >> 11) & 0x01;
-    int blue_on = (control_register_value >> 12) & 0x01;
-    unsigned int color = 0;
-    if (red_on) {
-        color |= 0xFF0000; // Define o componente vermelho como máximo
-        // DEFINE O TOM DO VERMELHO:
-        //color |= ((blue_intensity & 0xFF) << 16); // Ajuste para o deslocamento correto
+    long started = monotonic_ns();
+    if (ui_session_start(&ui, base_address, input[0], 1) == -1) {
+        goto fail;
     }
-    if (green_on) {
-        color |= 0x00FF00; // Define o componente verde como máximo
+    double startup_us = (monotonic_ns() - started) / 1e3;
+    pthread_t session;
+    int error = pthread_create(&session, NULL, ui_bench_session_thread, &ui);
+    if (error != 0) {
+        fprintf(stderr, "Erro ao criar a thread da sessão: %s\n", strerror(error));
+        ui_session_stop(&ui);
+        goto fail;
     }
-    if (blue_on) {
-        //color |= 0x0000FF; // Define o componente azul como máximo
-        color |= ((blue_intensity & 0xFF) << 0);
-    }
-
-    // Imprime a mensagem com a cor especificada
-    printf("\x1b[38;2;%d;%d;%dm", (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF);
-    for (i = 0; i < strlen(message) && (i + 4) < 16; i++) {
-        printf("%c", message[i]);
-    }
-    printf("\x1b[0m\n");
-}
 
-// Função para configurar a mensagem no display de LED
-void configure_text_display(char* base_address, const char* message) {
-    // Calcula o comprimento da mensagem
-    int message_length = strlen(message);
+    // Tela parada: só o letreiro e a renderização trabalham
+    double cpu = process_cpu_seconds();
+    usleep((useconds_t)(seconds * 1e6));
+    double idle_cpu = (process_cpu_seconds() - cpu) * 100.0 / seconds;
 
-    // Verifica se a mensagem excede o limite de 24 caracteres do display
-    if (message_length > LED_DISPLAY_REGISTERS) {
-        fprintf(stderr, "Erro: mensagem excede o limite de caracteres do display\n");
-        return;
+    // Entrada: uma linha a cada 10 ms
+    cpu = process_cpu_seconds();
+    started = monotonic_ns();
+    for (int i = 0; i < line_count; i++) {
+        char line[16];
+        int length = snprintf(line, sizeof(line), "%s\n", script[i % script_length]);
+        written_ns[i] = monotonic_ns();
+        if (write(input[1], line, length) != length) {
+            perror("Erro ao escrever no pipe da entrada");
+            break;
+        }
+        usleep(10000);
     }
+    double input_seconds = (monotonic_ns() - started) / 1e9;
+    double input_cpu = (process_cpu_seconds() - cpu) * 100.0 / input_seconds;
 
-    // Escreve a mensagem nos registradores de dados (R4 a R11)
-    int i;
-    for (i = 0; i < message_length && (i + 3) < LED_DISPLAY_REGISTERS; i++) {
-        *((unsigned short *)(base_address + ((i + 3) * sizeof(unsigned short)))) = message[i];
-    }
+    close(input[1]); // Fim da entrada encerra o laço da sessão
+    pthread_join(session, NULL);
+    // O escalonador ainda roda aqui; o relatório lê os contadores sob o lock dele
+    animation_scheduler_report(&animation_scheduler, stdout);
+    ui_session_stop(&ui);
+    close(input[0]);
 
-    // Preenche os registradores de dados restantes com espaços em branco
-    for (; i < LED_DISPLAY_REGISTERS - 3; i++) {
-        *((unsigned short *)(base_address + ((i + 3) * sizeof(unsigned short)))) = ' ';
+    long processed = ui.lines < line_count ? ui.lines : line_count;
+    long *latencies = malloc((processed ? processed : 1) * sizeof(long));
+    if (latencies == NULL) {
+        perror("Erro ao alocar as latências");
+        registers_write_all(base_address, registers);
+        free(written_ns);
+        free(ui.processed_ns);
+        return -1;
     }
-}
+    for (long i = 0; i < processed; i++) {
+        latencies[i] = ui.processed_ns[i] - written_ns[i];
+    }
+    qsort(latencies, processed, sizeof(long), compare_long);
 
+    printf("startup_us,%.0f\n", startup_us);
+    printf("phase,seconds,cpu_percent,lines,p50_us,p99_us,max_us\n");
+    printf("idle,%.2f,%.2f,0,,,\n", seconds, idle_cpu);
+    printf("input,%.2f,%.2f,%ld,%.1f,%.1f,%.1f\n", input_seconds, input_cpu, processed,
+           percentile_sorted(latencies, processed, 50) / 1e3, percentile_sorted(latencies, processed, 99) / 1e3,
+           processed ? latencies[processed - 1] / 1e3 : 0.0);
 
-// Menu de LED no painel
-void exibir_menu_led(WINDOW *painel) {
-    werase(painel);  // Limpa o painel antes de exibir o novo menu
-    mvwprintw(painel, 1, 2, "Seja bem vindo ao sistema de LED.");
-    mvwprintw(painel, 2, 2, "Digite 0 para desligar o LED");
-    mvwprintw(painel, 3, 2, "Digite 1 para ligar o LED");
-    wrefresh(painel);  // Atualiza o painel para mostrar as mudanças
-}
+    registers_write_all(base_address, registers);
+    free(latencies);
+    free(written_ns);
+    free(ui.processed_ns);
+    return processed == line_count ? 0 : -1;
 
-// Função para exibir o menu de ajuste de intensidade
-void exibir_menu_intensidade(char componente) {
-    printf("\nAjuste a intensidade do componente %c (0-255), ou digite 0 para voltar ao menu principal: ", componente);
+fail:
+    close(input[0]);
+    close(input[1]);
+    free(written_ns);
+    free(ui.processed_ns);
+    return -1;
 }
 
-// Função para imprimir as intensidades de cada componente
-void print_component_intensities(char* base_address) {
-    // Lê o valor atual do registrador R1 (componentes R e G)
-    unsigned short r1_value = *((unsigned short *)(base_address + (1 * sizeof(unsigned short))));
-
-    // Lê o valor atual do registrador R2 (componente B)
-    unsigned short r2_value = *((unsigned short *)(base_address + (2 * sizeof(unsigned short))));
-
-    // Extrai a intensidade do componente vermelho
-    int intensity_R = r1_value & RED_MASK;
-
-    // Extrai a intensidade do componente verde (deslocando 8 bits para a direita)
-    int intensity_G = (r1_value & GREEN_MASK) >> 8;
+// BENCHMARK DO MOTOR DE REGRAS
+// Gera milhares de regras sobre uma imagem em memória e mede o custo por
+// escrita: sem regras, em um campo sem regras, com a temperatura variando
+// aos poucos e aos saltos e com a bateria em ciclo. Compara com um avaliador
+// que relê os registradores e recalcula todas as condições a cada escrita e
+// confere, no fim, as contagens incrementais contra esse recálculo.
+typedef void (*RuleBenchWrite)(char *base_address, long i);
 
-    // Extrai a intensidade do componente azul
-    int intensity_B = r2_value & BLUE_MASK;
+void rule_bench_unwatched(char *base_address, long i) {
+    set_intensity_B(base_address, i & 0xFF);
+}
 
-    // Imprime as intensidades de cada componente
-    printf("Intensidade do componente vermelho: %d\n", intensity_R);
-    printf("Intensidade do componente verde: %d\n", intensity_G);
-    printf("Intensidade do componente azul: %d\n", intensity_B);
+void rule_bench_temperature_step(char *base_address, long i) {
+    int step = i % 206; // Sobe e desce de 10 em 10 graus
+    set_led_temperature(base_address, (step < 103 ? step : 205 - step) * 10);
 }
 
-// Função para exibir o sensor na tela com base no nível de bateria
-void display_battery_sensor(char* base_address) {
-    // Lê o valor atual do registrador R3
-    unsigned short register_value = *((unsigned short *)(base_address + (3 * sizeof(unsigned short))));
+void rule_bench_temperature_jump(char *base_address, long i) {
+    set_led_temperature(base_address, (int)((i * 7919) % 1024));
+}
 
-    // Obtém os dois primeiros bits do valor do registrador R3 (bits 0 e 1)
-    int battery_level = register_value & 0b11;
+void rule_bench_battery(char *base_address, long i) {
+    set_battery_level(base_address, i % 4);
+}
 
-    printf("Sensor de bateria: ");
+int run_rules_bench(int rules, long writes) {
+    static const struct {
+        const char *name;
+        RuleBenchWrite write;
+    } workloads[] = {
+        {"unwatched", rule_bench_unwatched},
+        {"temperature_step", rule_bench_temperature_step},
+        {"temperature_jump", rule_bench_temperature_jump},
+        {"battery_cycle", rule_bench_battery},
+    };
+    char *image = aligned_alloc(CACHE_LINE_SIZE, FILE_SIZE);
+    FILE *text = tmpfile();
+    int *satisfied = malloc(rules * sizeof(int));
+    if (image == NULL || text == NULL || satisfied == NULL) {
+        perror("Erro ao preparar o benchmark de regras");
+        return -1;
+    }
+    memset(image, 0, FILE_SIZE);
+    int previous_verbose = registers_verbose;
+    registers_verbose = 0;
 
-    // Determine a cor do sensor com base no nível de bateria
-    switch (battery_level) {
+    // As ações são "noblink" (sem escrita), para medir só a avaliação e o disparo
+    srand(1234);
+    for (int i = 0; i < rules; i++) {
+        switch (i % 4) {
         case 0:
-            printf("\033[0;31mCRÍTICO"); // Vermelho
+            fprintf(text, "temperature > %d -> noblink\n", rand() % 103);
             break;
         case 1:
-            printf("\033[0;33mBAIXO"); // Amarelo
+            fprintf(text, "temperature <= %d and battery_level == %d -> noblink\n", rand() % 103, rand() % 4);
+            break;
+        case 2:
+            fprintf(text, "battery_level == %d and led_status == 1 -> noblink\n", rand() % 4);
             break;
         default:
-            printf("\033[0;32mNORMAL/ALTO"); // Verde
+            fprintf(text, "text_%d != %d -> noblink\n", rand() % TEXT_REGISTERS, 32 + rand() % 95);
             break;
+        }
     }
+    rewind(text);
 
-    printf("\033[0m\n"); // Restaura a cor padrão do terminal
-}
+    printf("workload,rules,writes,ns_per_write,conditions_per_write,fires_per_write\n");
+    double start = monotonic_seconds();
+    for (long i = 0; i < writes; i++) {
+        rule_bench_temperature_jump(image, i);
+    }
+    printf("no_rules,0,%ld,%.1f,0,0\n", writes, (monotonic_seconds() - start) * 1e9 / writes);
 
+    set_led_status(image, 1);
+    if (rule_engine_load_file(&rule_engine, image, text, "regras geradas") != rules) {
+        registers_verbose = previous_verbose;
+        fclose(text);
+        free(satisfied);
+        free(image);
+        return -1;
+    }
+    fclose(text);
 
-// Função para definir a temperatura do LED nos bits do 6 ao 15 do registrador R3
-void set_led_temperature(char* base_address, int temperature) {
-    // Garante que a temperatura esteja dentro do intervalo válido (0-1023)
-    if (temperature < 0 || temperature > 1023) {
-        fprintf(stderr, "Erro: Temperatura do LED fora do intervalo válido (0-1023)\n");
-        return;
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+        rule_engine.evaluations = rule_engine.fires = 0;
+        start = monotonic_seconds();
+        for (long i = 0; i < writes; i++) {
+            workloads[w].write(image, i);
+        }
+        double elapsed = monotonic_seconds() - start;
+        printf("%s,%d,%ld,%.1f,%.2f,%.3f\n", workloads[w].name, rules, writes, elapsed * 1e9 / writes,
+               (double)rule_engine.evaluations / writes, (double)rule_engine.fires / writes);
     }
 
-    // Lê o valor atual do registrador R3
-    unsigned short register_value = *((unsigned short *)(base_address + (3 * sizeof(unsigned short))));
+    // Avaliador que recalcula tudo a cada escrita (sem o gancho)
+    registers_commit_hook = NULL;
+    long conditions = 0;
+    start = monotonic_seconds();
+    for (long i = 0; i < writes; i++) {
+        RegisterSnapshot snapshot;
+        rule_bench_temperature_jump(image, i);
+        registers_snapshot(image, &snapshot);
+        conditions += rule_engine_recount(&rule_engine, snapshot.regs, satisfied);
+    }
+    printf("rescan,%d,%ld,%.1f,%.2f,\n", rules, writes, (monotonic_seconds() - start) * 1e9 / writes,
+           (double)conditions / writes);
+    registers_commit_hook = rule_engine_after_commit;
 
-    printf("Valor armazenado nos bits do 6 ao 15 antes da escrita: %d\n", register_value);
-    
-    // Limpa os bits do 6 ao 15 do registrador R3
-    register_value &= ~(0b111111111111 << 6);
+    // Conferência das contagens incrementais
+    rule_engine_evaluate(&rule_engine);
+    rule_engine_recount(&rule_engine, rule_engine.values, satisfied);
+    int mismatched = 0;
+    for (int i = 0; i < rules; i++) {
+        mismatched += satisfied[i] != rule_engine.rules[i].satisfied;
+    }
+    printf("check,rules,mismatched_rules\n");
+    printf("check,%d,%d\n", rules, mismatched);
 
-    // Define a temperatura do LED nos bits do 6 ao 15 do registrador R3 (dividida por 10)
-    register_value |= ((temperature / 10) << 6);
+    registers_commit_hook = NULL;
+    rule_engine_free(&rule_engine);
+    registers_verbose = previous_verbose;
+    free(satisfied);
+    free(image);
+    return mismatched == 0 ? 0 : -1;
+}
 
-    // Escreve o novo valor no registrador R3
-    *((unsigned short *)(base_address + (3 * sizeof(unsigned short)))) = register_value;
+// BENCHMARK DA CODIFICAÇÃO DO TEXTO
+// Em cada codificação, confere a ida e volta de mensagens aleatórias
+// (escrita pelos setters e leitura por text_decode) e mede o custo de
+// escrever e de ler uma mensagem que ocupa toda a capacidade.
+int run_text_bench(long iterations) {
+    static char image[FILE_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+    char message[2][TEXT_CAPACITY_MAX + 1];
+    char expected[TEXT_CAPACITY_MAX + 1];
+    char decoded[TEXT_CAPACITY_MAX + 1];
+    RegisterSnapshot snapshot;
+    long errors_total = 0;
 
-    printf("Valor armazenado nos bits do 6 ao 15 após a escrita: %d\n", register_value);
+    printf("encoding,capacity,stores_per_write,ns_per_write,ns_per_read,ns_per_char_written,roundtrip_errors\n");
+    for (int encoding = TEXT_ENCODING_ASCII; encoding <= TEXT_ENCODING_GLYPH; encoding++) {
+        int capacity = text_capacity[encoding];
+        memset(image, 0, sizeof(image));
+        set_text_encoding(image, encoding);
 
-    printf("Temperatura do LED definida como: %d\n", temperature);
-}
+        // Ida e volta: caracteres da tabela de glifos (minúsculas incluídas)
+        long errors = 0;
+        srand(1234 + encoding);
+        for (int round = 0; round < 10000; round++) {
+            int length = rand() % (capacity + 1);
+            for (int i = 0; i < length; i++) {
+                message[0][i] = (rand() % 4 == 0) ? 'a' + rand() % 26 : text_glyphs[rand() % 64];
+                expected[i] = encoding == TEXT_ENCODING_GLYPH ? toupper((unsigned char)message[0][i]) : message[0][i];
+            }
+            message[0][length] = '\0';
+            memset(expected + length, ' ', capacity - length);
+            expected[capacity] = '\0';
+            write_message_registers(image, message[0]);
+            registers_snapshot(image, &snapshot);
+            text_decode(snapshot.regs, decoded);
+            errors += strcmp(decoded, expected) != 0;
+        }
 
-// MENUS VALIDOS PARA BAIXO
+        // Duas mensagens cheias que diferem em todas as palavras
+        for (int i = 0; i < capacity; i++) {
+            message[0][i] = 'A' + i % 26;
+            message[1][i] = 'Z' - i % 26;
+        }
+        message[0][capacity] = message[1][capacity] = '\0';
+        double start = monotonic_seconds();
+        for (long i = 0; i < iterations; i++) {
+            write_message_registers(image, message[i & 1]);
+        }
+        double write_ns = (monotonic_seconds() - start) * 1e9 / iterations;
 
-void exibir_menu_painel_led(WINDOW *painel) {
-    mvwprintw(painel, 1, 2, "Seja bem vindo ao sistema de LED.");
-    mvwprintw(painel, 2, 2, "Digite 0 para ligar ou desligar o LED");
-    mvwprintw(painel, 3, 2, "Digite 1 para manipular as cores");
-    mvwprintw(painel, 4, 2, "Digite 2 para controlar o nível da bateria");
-    mvwprintw(painel, 5, 2, "Digite 3 para controlar o nível da temperatura");
-    wrefresh(painel);
-}
+        volatile char sink; // Mantém a decodificação no laço
+        start = monotonic_seconds();
+        for (long i = 0; i < iterations; i++) {
+            registers_snapshot(image, &snapshot);
+            text_decode(snapshot.regs, decoded);
+            sink = decoded[i % capacity];
+        }
+        (void)sink;
+        double read_ns = (monotonic_seconds() - start) * 1e9 / iterations;
 
-void exibir_menu_liga_led(WINDOW *painel){
-    mvwprintw(painel, 1, 2, "Seja bem vindo ao sistema de LED.");
-    mvwprintw(painel, 2, 2, "Digite 0 para desligar o LED");
-    mvwprintw(painel, 3, 2, "Digite 1 para ligar o LED");
-    wrefresh(painel);
+        printf("%s,%d,%d,%.1f,%.1f,%.2f,%ld\n", text_encoding_names[encoding], capacity, TEXT_WORDS, write_ns,
+               read_ns, write_ns / capacity, errors);
+        errors_total += errors;
+    }
+    return errors_total == 0 ? 0 : -1;
 }
 
-// Função para exibir o menu de manipulação das cores
-void exibir_menu_cores(WINDOW *painel) {
-    mvwprintw(painel, 1, 2, "Escolha qual componente você deseja manipular:");
-    mvwprintw(painel, 2, 2, "R - 1");
-    mvwprintw(painel, 3, 2, "G - 2");
-    mvwprintw(painel, 4, 2, "B - 3");
-    wrefresh(painel);
-}
+// BENCHMARK DE DURABILIDADE
+// Escreve continuamente por alguns segundos em cada modo e informa a vazão,
+// os msync feitos, a latência de cada msync e o atraso até a gravação.
+int run_durability_bench(char *base_address, double seconds) {
+    const char *specs[] = {"none", "periodic:10", "group:64:5", "sync"};
+    Durability saved = registers_durability;
+    unsigned short registers[REGISTER_COUNT];
+    memcpy(registers, base_address, sizeof(registers));
+    durability_stop(&registers_durability);
 
-void exibir_menu_bateria(WINDOW *painel){
-    mvwprintw(painel, 1, 2, "Defina o nível de bateria (0, 1, 2 ou 3): ");
-    wrefresh(painel);
+    printf("mode,commits,commits_per_s,flushes,flush_errors,flush_p50_us,flush_p99_us,flush_max_us,delay_p99_us,delay_max_us\n");
+    Durability results[4];
+    for (int m = 0; m < 4; m++) {
+        Durability *durability = &registers_durability;
+        durability_parse(durability, specs[m]);
+        if (durability_start(durability, base_address, FILE_SIZE) == -1) {
+            return -1;
+        }
+        long started = monotonic_ns();
+        long deadline = started + (long)(seconds * 1e9);
+        long writes = 0;
+        while (monotonic_ns() < deadline) {
+            field_store_led_status(base_address, writes & 1);
+            writes++;
+        }
+        double elapsed = (monotonic_ns() - started) / 1e9;
+        durability_stop(durability);
+
+        printf("%s,%ld,%.0f,%ld,%ld,%ld,%ld,%.0f,%ld,%.0f\n", specs[m], writes, writes / elapsed,
+               durability->flushes, durability->flush_errors,
+               durability_percentile_us(durability->flush_histogram, 50), durability_percentile_us(durability->flush_histogram, 99),
+               durability->max_flush_ns / 1e3, durability_percentile_us(durability->delay_histogram, 99),
+               durability->max_delay_ns / 1e3);
+        results[m] = *durability;
+    }
+
+    for (int m = 1; m < 4; m++) {
+        char label[64];
+        snprintf(label, sizeof(label), "%s msync", specs[m]);
+        durability_print_histogram(stdout, label, results[m].flush_histogram);
+        snprintf(label, sizeof(label), "%s atraso", specs[m]);
+        durability_print_histogram(stdout, label, results[m].delay_histogram);
+    }
+
+    // Volta à política escolhida na linha de comando
+    registers_write_all(base_address, registers);
+    registers_durability.mode = saved.mode;
+    registers_durability.interval_ms = saved.interval_ms;
+    registers_durability.group_writes = saved.group_writes;
+    registers_durability.group_ms = saved.group_ms;
+    return durability_start(&registers_durability, base_address, FILE_SIZE);
 }
 
-void exibir_menu_temperatura(WINDOW *painel){
-    mvwprintw(painel, 1, 2, "Defina a temperatura do LED (de 0-1023):");
-    wrefresh(painel);
+// BENCHMARK DA INSTRUMENTAÇÃO
+// Repete uma mistura de setters e leituras com a instrumentação desligada e
+// ligada e informa o custo por operação de cada caso.
+void stats_bench_ops(char *base_address, long iterations) {
+    RegisterSnapshot snapshot;
+    for (long i = 0; i < iterations; i++) {
+        set_intensity_R(base_address, i & 0xFF);
+        set_led_status(base_address, i & 1);
+        set_led_temperature(base_address, (i * 7) & 1023);
+        set_battery_level(base_address, i & 3);
+        reg_atomic_load(base_address, 1);
+        registers_snapshot(base_address, &snapshot);
+    }
 }
 
-void limpar_linhas_painel(WINDOW *painel){
-    char espacamento[] = "                                               ";
-    mvwprintw(painel, 1, 2, espacamento);
-    mvwprintw(painel, 2, 2, espacamento);
-    mvwprintw(painel, 3, 2, espacamento);
-    mvwprintw(painel, 4, 2, espacamento);
-    mvwprintw(painel, 5, 2, espacamento);
-    mvwprintw(painel, 6, 2, espacamento);
-    mvwprintw(painel, 7, 2, espacamento);
-    wrefresh(painel);
+int run_stats_bench(char *base_address, long iterations) {
+    unsigned short registers[REGISTER_COUNT];
+    memcpy(registers, base_address, sizeof(registers));
+    int saved = registers_stats_enabled;
+    int previous_verbose = registers_verbose;
+    registers_verbose = 0;
+    const int ops_per_iteration = 6;
+    double ns_per_op[2] = {0, 0};
+
+    printf("stats,operacoes,ns_por_operacao\n");
+#ifdef REGISTER_STATS
+    const int runs = 2;
+#else
+    const int runs = 1;
+#endif
+    for (int enabled = 0; enabled < runs; enabled++) {
+        registers_stats_enabled = enabled;
+        stats_bench_ops(base_address, iterations / 10); // Aquecimento
+        long started = monotonic_ns();
+        stats_bench_ops(base_address, iterations);
+        ns_per_op[enabled] = (double)(monotonic_ns() - started) / (iterations * ops_per_iteration);
+        printf("%s,%ld,%.1f\n", enabled ? "ligada" : "desligada", iterations * ops_per_iteration, ns_per_op[enabled]);
+    }
+    registers_stats_enabled = saved;
+    registers_verbose = previous_verbose;
+    registers_write_all(base_address, registers);
+
+#ifdef REGISTER_STATS
+    printf("custo da instrumentação: %.1f%%\n", 100.0 * (ns_per_op[1] - ns_per_op[0]) / ns_per_op[0]);
+    registers_stats_dump(stdout);
+#else
+    printf("instrumentação não compilada: o custo é zero (compile com -DREGISTER_STATS para comparar)\n");
+#endif
+    return 0;
 }
-// Para implementar:
-// se o valor for 0, apresente o menu de controle do LED
 
-void *exibir_animacao_hello_world(void *arg) {
-    char texto[] = "hello world";
-    int comprimento_texto = strlen(texto);
-    int coluna_inicial = 2; // Coluna inicial
-    int linha = 12; // Linha onde o texto será exibido
-    int largura_painel = getmaxx(painel) - 4; // Largura do painel, descontando bordas
+// BENCHMARK DOS BACKENDS DE ARMAZENAMENTO
+// Executa a mesma carga do --stats-bench sobre cada backend, em um arquivo
+// (ou objeto de memória) próprio, e inclui no tempo a gravação final.
+int run_backend_bench(long iterations) {
+    const char *specs[] = {"mmap", "memfd", "shm", "pwrite:1", "pwrite:64", "buffer"};
+    const char *path = "registers_backend_bench.bin";
+    int previous_verbose = registers_verbose;
+    registers_verbose = 0;
+
+    printf("backend,operacoes,ns_por_operacao,gravacoes,bytes_gravados\n");
+    for (int b = 0; b < (int)(sizeof(specs) / sizeof(specs[0])); b++) {
+        RegisterBackend backend = {NULL};
+        if (register_backend_parse(&backend, specs[b]) == -1) {
+            return -1;
+        }
+        char *base_address = register_backend_open(&backend, path, FILE_SIZE);
+        if (base_address == NULL) {
+            return -1;
+        }
+        // O gancho de commit só atua no backend global
+        registers_backend = backend;
 
-    while (true) {
-        for (int i = 0; i <= largura_painel - comprimento_texto; ++i) {
-            mvwprintw(painel, linha, coluna_inicial + i, "%s", texto);
-            wrefresh(painel);
-            usleep(100000); // Pausa de 0,1 segundo
-            mvwprintw(painel, linha, coluna_inicial + i, "           "); // Apaga o texto na posição anterior
+        stats_bench_ops(base_address, iterations / 10); // Aquecimento
+        registers_backend.ops->flush(&registers_backend);
+        registers_backend.flushes = registers_backend.bytes_written = 0;
+        long started = monotonic_ns();
+        stats_bench_ops(base_address, iterations);
+        registers_backend.ops->flush(&registers_backend);
+        double ns_per_op = (double)(monotonic_ns() - started) / (iterations * 6);
+
+        printf("%s,%ld,%.1f,%ld,%ld\n", specs[b], iterations * 6, ns_per_op,
+               registers_backend.flushes, registers_backend.bytes_written);
+        register_backend_close(&registers_backend);
+        memset(&registers_backend, 0, sizeof(registers_backend));
+        if (backend.ops->on_disk) {
+            unlink(path);
+        }
+        if (strcmp(backend.ops->name, "shm") == 0) {
+            char name[256];
+            backend_shm_name(path, name, sizeof(name));
+            shm_unlink(name);
         }
     }
-    return NULL;
+    registers_verbose = previous_verbose;
+    return 0;
 }
 
-void exibir_painel(char* base_address) {
-    // Inicializa o modo ncurses
-    initscr();
+int main(int argc, char *argv[]) {
+    // Opções antes do modo:
+    //   ./programa --record arquivo [modo ...]       grava a sessão
+    //   ./programa --durability politica [modo ...]  none, periodic[:ms], group[:escritas[:ms]] ou sync
+    //   ./programa --stats [modo ...]                contadores e latências dos acessores ao sair
+    //   ./programa --backend nome [modo ...]         mmap, memfd, shm, pwrite[:commits] ou buffer
+    //   ./programa --rules arquivo [modo ...]        regras que reagem às escritas
+    const char *record_path = NULL;
+    const char *rules_path = NULL;
+    while (argc > 1 && (strcmp(argv[1], "--stats") == 0 ||
+                        (argc > 2 && (strcmp(argv[1], "--record") == 0 || strcmp(argv[1], "--durability") == 0 ||
+                                      strcmp(argv[1], "--backend") == 0 || strcmp(argv[1], "--rules") == 0)))) {
+        if (strcmp(argv[1], "--stats") == 0) {
+#ifndef REGISTER_STATS
+            fprintf(stderr, "Erro: instrumentação não compilada (use -DREGISTER_STATS)\n");
+            return EXIT_FAILURE;
+#endif
+            registers_stats_enabled = 1;
+            atexit(registers_stats_dump_stderr);
+            argv[1] = argv[0];
+            argv++;
+            argc--;
+            continue;
+        }
+        if (strcmp(argv[1], "--record") == 0) {
+            record_path = argv[2];
+        } else if (strcmp(argv[1], "--rules") == 0) {
+            rules_path = argv[2];
+        } else if (strcmp(argv[1], "--backend") == 0) {
+            if (register_backend_parse(&registers_backend, argv[2]) == -1) {
+                return EXIT_FAILURE;
+            }
+        } else if (durability_parse(&registers_durability, argv[2]) == -1) {
+            return EXIT_FAILURE;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
 
-    // Desativa o modo de eco de caracteres digitados
-    noecho();
+    // Renderização em thread única: ./programa --render-bench [segundos]
+    if (argc > 1 && strcmp(argv[1], "--render-bench") == 0) {
+        double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+        if (seconds <= 0) {
+            fprintf(stderr, "Erro: a duração deve ser positiva\n");
+            return EXIT_FAILURE;
+        }
+        return run_render_bench(seconds) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    // Define a tecla Enter como fim de entrada
-    keypad(stdscr, TRUE);
+    // Escalonador de animações: ./programa --animation-bench [animacoes] [segundos]
+    if (argc > 1 && strcmp(argv[1], "--animation-bench") == 0) {
+        int animations = argc > 2 ? atoi(argv[2]) : 100;
+        double seconds = argc > 3 ? atof(argv[3]) : 2.0;
+        if (animations < 1 || seconds <= 0) {
+            fprintf(stderr, "Erro: número de animações e duração devem ser positivos\n");
+            return EXIT_FAILURE;
+        }
+        return run_animation_bench(animations, seconds) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    // Obtém as dimensões da tela
-    int linhas, colunas;
-    getmaxyx(stdscr, linhas, colunas);
+    // Snapshots de um banco: ./programa --snapshot-bench [dispositivos]
+    if (argc > 1 && strcmp(argv[1], "--snapshot-bench") == 0) {
+        int devices = argc > 2 ? atoi(argv[2]) : 65536;
+        if (devices < 1) {
+            fprintf(stderr, "Erro: número de dispositivos deve ser positivo\n");
+            return EXIT_FAILURE;
+        }
+        return run_snapshot_bench(devices) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    // Calcula a posição central para o painel
-    int inicio_linha = linhas / 2 - 2; // Diminui 2 para centralizar verticalmente
-    int inicio_coluna = colunas / 2 - 12; // Diminui 12 para centralizar horizontalmente
+    // Kernels de cor em lote: ./programa --color-kernels [dispositivos] [passadas]
+    if (argc > 1 && strcmp(argv[1], "--color-kernels") == 0) {
+        int devices = argc > 2 ? atoi(argv[2]) : 65536;
+        int passes = argc > 3 ? atoi(argv[3]) : 20;
+        if (devices < 1 || passes < 1) {
+            fprintf(stderr, "Erro: número de dispositivos e de passadas deve ser positivo\n");
+            return EXIT_FAILURE;
+        }
+        return run_color_kernels(devices, passes) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    // Cria uma nova janela para o painel
-    painel = newwin(50, 50, 6, 6);
+    // Tabelas de cor: ./programa --color-tables [dispositivos] [passadas]
+    if (argc > 1 && strcmp(argv[1], "--color-tables") == 0) {
+        int devices = argc > 2 ? atoi(argv[2]) : 65536;
+        int passes = argc > 3 ? atoi(argv[3]) : 20;
+        if (devices < 1 || passes < 1) {
+            fprintf(stderr, "Erro: número de dispositivos e de passadas deve ser positivo\n");
+            return EXIT_FAILURE;
+        }
+        return run_color_tables(devices, passes) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    // Define o estilo da janela
-    box(painel, 0, 0); // Adiciona uma borda à janela
+    // Backends de armazenamento: ./programa --backend-bench [iteracoes]
+    if (argc > 1 && strcmp(argv[1], "--backend-bench") == 0) {
+        long iterations = argc > 2 ? atol(argv[2]) : 200000;
+        if (iterations < 1) {
+            fprintf(stderr, "Erro: o número de iterações deve ser positivo\n");
+            return EXIT_FAILURE;
+        }
+        return run_backend_bench(iterations) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
+    // Carga sobre o servidor: ./programa --daemon-load [clientes] [segundos] [profundidade]
+    if (argc > 1 && strcmp(argv[1], "--daemon-load") == 0) {
+        int clients = argc > 2 ? atoi(argv[2]) : 200;
+        double seconds = argc > 3 ? atof(argv[3]) : 3.0;
+        int depth = argc > 4 ? atoi(argv[4]) : 8;
+        if (clients < 1 || seconds <= 0 || depth < 1 || depth > 256) {
+            fprintf(stderr, "Erro: clientes e duração devem ser positivos e a profundidade entre 1 e 256\n");
+            return EXIT_FAILURE;
+        }
+        return run_daemon_load(clients, seconds, depth) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    // Exibe a animação "hello world" na linha 12 do painel
-    exibir_menu_painel_led(painel);
+    // Benchmark do banco de dispositivos: ./programa --bank-bench [dispositivos] [quadros]
+    if (argc > 1 && strcmp(argv[1], "--bank-bench") == 0) {
+        int devices = argc > 2 ? atoi(argv[2]) : 4096;
+        int frames = argc > 3 ? atoi(argv[3]) : 100;
+        if (devices < 1 || frames < 1) {
+            fprintf(stderr, "Erro: número de dispositivos e de quadros deve ser positivo\n");
+            return EXIT_FAILURE;
+        }
+        return run_bank_bench(devices, frames) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    // Cria a thread para a animação
-    pthread_t thread_id;
-    pthread_create(&thread_id, NULL, exibir_animacao_hello_world, NULL);
-    
-    // Atualiza a tela
-    wrefresh(painel);
+    // Benchmark das cenas: ./programa --scene-bench [dispositivos] [passadas]
+    if (argc > 1 && strcmp(argv[1], "--scene-bench") == 0) {
+        int devices = argc > 2 ? atoi(argv[2]) : 4096;
+        int passes = argc > 3 ? atoi(argv[3]) : 100;
+        if (devices < 1 || passes < 1) {
+            fprintf(stderr, "Erro: número de dispositivos e de passadas deve ser positivo\n");
+            return EXIT_FAILURE;
+        }
+        return run_scene_bench(devices, passes) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    // Captura a entrada do usuário
-    char entrada[100];
-    mvwgetstr(painel, 6, 2, entrada); // Ajusta as coordenadas para capturar a entrada
-    
-    int opcao_inicial = atoi(entrada);
-
-// Manipulação para ligar ou desligar o LED
-switch(opcao_inicial) {
-    case 0:
-        mvwprintw(painel, 6, 2, "                                ");
-        mvwprintw(painel, 7, 2, "Funcionou essa merda");
-        wrefresh(painel); // Atualiza o painel após imprimir o texto
-
-        // Aguarda um tempo para que o usuário possa ler a mensagem
-        sleep(1); // Importe <unistd.h> para usar a função sleep
-
-        // Limpa o painel antes de exibir o novo menu
-        limpar_linhas_painel(painel);
-        // Exibe o novo menu
-        exibir_menu_liga_led(painel); // Mostra o novo menu
-        
-        // Obtém a nova entrada do usuário
-        mvwgetstr(painel, 6, 2, entrada);
-        int opcao_led = atoi(entrada);
-        // Atualiza o painel após imprimir o novo menu
-        wrefresh(painel);
+    // Motor de regras: ./programa --rules-bench [regras] [escritas]
+    if (argc > 1 && strcmp(argv[1], "--rules-bench") == 0) {
+        int rules = argc > 2 ? atoi(argv[2]) : 4096;
+        long writes = argc > 3 ? atol(argv[3]) : 200000;
+        if (rules < 1 || writes < 1) {
+            fprintf(stderr, "Erro: número de regras e de escritas deve ser positivo\n");
+            return EXIT_FAILURE;
+        }
+        return run_rules_bench(rules, writes) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-        // Verifica se a entrada é válida (1 ou 0)
-        if (opcao_led == 0 || opcao_led == 1 ) {
-            limpar_linhas_painel(painel);
-            mvwprintw(painel, 7, 2, "Ligar ou desligar o LED");
-            mvwprintw(painel, 8, 2, entrada);
-            set_led_status(base_address, opcao_led);
-            wrefresh(painel); // Atualiza o painel após imprimir o novo menu
-        } else {
-            limpar_linhas_painel(painel);
-            mvwprintw(painel, 7, 2, "Entrada inválida");
-            wrefresh(painel); // Atualiza o painel após imprimir o novo menu
+    // Codificação do texto: ./programa --text-bench [iteracoes]
+    if (argc > 1 && strcmp(argv[1], "--text-bench") == 0) {
+        long iterations = argc > 2 ? atol(argv[2]) : 1000000;
+        if (iterations < 1) {
+            fprintf(stderr, "Erro: número de iterações deve ser positivo\n");
+            return EXIT_FAILURE;
         }
-        break;
-    
-    case 1:
-        mvwprintw(painel, 6, 2, "                                ");
-        mvwprintw(painel, 7, 2, "Funcionou essa merda da cor");
-        wrefresh(painel); // Atualiza o painel após imprimir o texto
-
-        // Aguarda um tempo para que o usuário possa ler a mensagem
-        sleep(1); // Importe <unistd.h> para usar a função sleep
-
-        
-        // Limpa o painel antes de exibir o novo menu
-        //werase(painel);
-        limpar_linhas_painel(painel);
-        exibir_menu_cores(painel); // Mostra o novo menu
-        wrefresh(painel); // Atualiza o painel após imprimir o novo menu
-
-        // Obtém a nova entrada do usuário
-        mvwgetstr(painel, 6, 2, entrada);
-        int opcao_cor = atoi(entrada);
-
-        if (opcao_cor == 1 || opcao_cor == 2 || opcao_cor == 3) {
-            if(opcao_cor == 1){
-                set_valor_R(base_address, opcao_cor);
-                mvwprintw(painel, 7, 2, "VERMELHO");
-            }
-            if(opcao_cor == 2){
-                set_valor_G(base_address, opcao_cor);
-                mvwprintw(painel, 7, 2, "VERDE");
-            }
-            if(opcao_cor == 3){
-                set_intensity_B(base_address, opcao_cor);
-                mvwprintw(painel, 7, 2, "AZUL");
-            }
-            limpar_linhas_painel(painel);
-            mvwprintw(painel, 8, 2, entrada);
-            //set_led_status(base_address, opcao_cor);
-            wrefresh(painel); // Atualiza o painel após imprimir o novo menu
-        } else {
-            limpar_linhas_painel(painel);
-            mvwprintw(painel, 7, 2, "Entrada inválida");
-            wrefresh(painel); // Atualiza o painel após imprimir o novo menu
+        return run_text_bench(iterations) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Abrir o arquivo e mapeá-lo na memória
+    char* map = register_backend_open(&registers_backend, FILE_PATH, FILE_SIZE);
+    if (map == NULL) {
+        return EXIT_FAILURE;
+    }
+    const RegisterBackendOps *backend = registers_backend.ops;
+    if ((record_path != NULL && !(backend->shared && backend->on_disk)) ||
+        ((registers_durability.mode != DURABILITY_NONE || (argc > 1 && strcmp(argv[1], "--durability-bench") == 0)) &&
+         !backend->shared)) {
+        fprintf(stderr, "Erro: --record exige o backend mmap e a durabilidade um backend mapeado (mmap, memfd ou shm)\n");
+        registers_release(map, FILE_SIZE);
+        return EXIT_FAILURE;
+    }
+
+    // Registro das escritas ao lado do arquivo de registros; sem ele o
+    // programa continua funcionando, apenas sem o histórico. Backends fora do
+    // disco também não gravam o registro.
+    if (backend->on_disk) {
+        change_log_open(&change_log, CHANGE_LOG_PATH, map);
+    }
+
+    if (record_path != NULL && trace_recorder_start(&trace_recorder, record_path, FILE_PATH, map) == -1) {
+        registers_release(map, FILE_SIZE);
+        return EXIT_FAILURE;
+    }
+    if (durability_start(&registers_durability, map, FILE_SIZE) == -1) {
+        registers_release(map, FILE_SIZE);
+        return EXIT_FAILURE;
+    }
+    if (rules_path != NULL && rule_engine_load(&rule_engine, map, rules_path) == -1) {
+        registers_release(map, FILE_SIZE);
+        return EXIT_FAILURE;
+    }
+
+    // Regras: ./programa --rules arquivo --rules-run
+    if (argc > 1 && strcmp(argv[1], "--rules-run") == 0) {
+        if (rule_engine.count == 0) {
+            fprintf(stderr, "Erro: nenhuma regra carregada (use --rules arquivo --rules-run)\n");
+            registers_release(map, FILE_SIZE);
+            return EXIT_FAILURE;
         }
-        break;
+        int status = run_rules(map);
+        registers_commit_hook = NULL;
+        rule_engine_free(&rule_engine);
+        registers_release(map, FILE_SIZE);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    case 2:
-        mvwprintw(painel, 6, 2, "                                ");
-        mvwprintw(painel, 7, 2, "Funcionou essa merda da bateria");
-        wrefresh(painel); // Atualiza o painel após imprimir o texto
-
-        // Aguarda um tempo para que o usuário possa ler a mensagem
-        sleep(1); // Importe <unistd.h> para usar a função sleep
-
-        // Limpa o painel antes de exibir o novo menu
-        //werase(painel);
-        limpar_linhas_painel(painel);
-        exibir_menu_bateria(painel); // Mostra o novo menu
-        wrefresh(painel); // Atualiza o painel após imprimir o novo menu
-
-        // Obtém a nova entrada do usuário
-        mvwgetstr(painel, 6, 2, entrada);
-        int opcao_bateria = atoi(entrada);
-        // Verifica se a entrada é válida (1 ou 0)
-        if (opcao_bateria == 0 || opcao_bateria == 1 || opcao_bateria == 2 || opcao_bateria == 3) {
-            limpar_linhas_painel(painel);
-            mvwprintw(painel, 7, 2, "Definicao do nivel de bateria");
-            mvwprintw(painel, 8, 2, entrada);
-            set_battery_level(base_address, opcao_bateria);
-            wrefresh(painel); // Atualiza o painel após imprimir o novo menu
-        } else {
-            limpar_linhas_painel(painel);
-            mvwprintw(painel, 7, 2, "Entrada inválida");
-            wrefresh(painel); // Atualiza o painel após imprimir o novo menu
+    // Políticas de durabilidade: ./programa --durability-bench [segundos]
+    if (argc > 1 && strcmp(argv[1], "--durability-bench") == 0) {
+        double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+        if (seconds <= 0) {
+            fprintf(stderr, "Erro: a duração deve ser positiva\n");
+            registers_release(map, FILE_SIZE);
+            return EXIT_FAILURE;
         }
-        break;
+        int result = run_durability_bench(map, seconds);
+        registers_release(map, FILE_SIZE);
+        return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Sessão do painel: ./programa --ui-bench [segundos] [linhas]
+    if (argc > 1 && strcmp(argv[1], "--ui-bench") == 0) {
+        double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+        int lines = argc > 3 ? atoi(argv[3]) : 200;
+        if (seconds <= 0 || lines < 1) {
+            fprintf(stderr, "Erro: a duração e o número de linhas devem ser positivos\n");
+            registers_release(map, FILE_SIZE);
+            return EXIT_FAILURE;
+        }
+        int result = run_ui_bench(map, seconds, lines);
+        registers_release(map, FILE_SIZE);
+        return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    case 3:
-        mvwprintw(painel, 6, 2, "                                ");
-        mvwprintw(painel, 7, 2, "Funcionou essa merda da temperatura");
-        wrefresh(painel); // Atualiza o painel após imprimir o texto
+    // Servidor dos registradores: ./programa --daemon
+    if (argc > 1 && strcmp(argv[1], "--daemon") == 0) {
+        int result = run_daemon(map);
+        registers_release(map, FILE_SIZE);
+        return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-        // Aguarda um tempo para que o usuário possa ler a mensagem
-        sleep(1); // Importe <unistd.h> para usar a função sleep
+    // Custo da instrumentação: ./programa --stats-bench [iteracoes]
+    if (argc > 1 && strcmp(argv[1], "--stats-bench") == 0) {
+        long iterations = argc > 2 ? atol(argv[2]) : 1000000;
+        if (iterations < 1) {
+            fprintf(stderr, "Erro: o número de iterações deve ser positivo\n");
+            registers_release(map, FILE_SIZE);
+            return EXIT_FAILURE;
+        }
+        int result = run_stats_bench(map, iterations);
+        registers_release(map, FILE_SIZE);
+        return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-        // Limpa o painel antes de exibir o novo menu
-        //werase(painel);
-        limpar_linhas_painel(painel);
-        exibir_menu_temperatura(painel); // Mostra o novo menu
-        wrefresh(painel); // Atualiza o painel após imprimir o novo menu
+    // Texto em rolagem: ./programa --marquee MENSAGEM [quadros_por_segundo] [segundos]
+    if (argc > 2 && strcmp(argv[1], "--marquee") == 0) {
+        int fps = argc > 3 ? atoi(argv[3]) : 8;
+        double seconds = argc > 4 ? atof(argv[4]) : 5.0;
+        if (fps < 1 || seconds <= 0) {
+            fprintf(stderr, "Erro: quadros por segundo e duração devem ser positivos\n");
+            return EXIT_FAILURE;
+        }
+        int result = run_marquee(map, argv[2], fps, seconds);
+        registers_release(map, FILE_SIZE);
+        return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-        // Obtém a nova entrada do usuário
-        mvwgetstr(painel, 6, 2, entrada);
-        int opcao_temp = atoi(entrada);
-        // Atualiza o painel após imprimir o novo menu
-        wrefresh(painel);
+    // Simulação de sensores: ./programa --sensors [segundos] [amostras_por_segundo]
+    if (argc > 1 && strcmp(argv[1], "--sensors") == 0) {
+        double seconds = argc > 2 ? atof(argv[2]) : 5.0;
+        int rate_hz = argc > 3 ? atoi(argv[3]) : 1000;
+        if (seconds <= 0 || rate_hz < 1 || rate_hz > 1000) {
+            fprintf(stderr, "Erro: a duração deve ser positiva e a taxa entre 1 e 1000 amostras/s\n");
+            registers_release(map, FILE_SIZE);
+            return EXIT_FAILURE;
+        }
+        int result = run_sensors(map, seconds, rate_hz);
+        registers_release(map, FILE_SIZE);
+        return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-        // Verifica se a entrada é válida (1 ou 0)
-        if (opcao_temp <= 1033) {
-            limpar_linhas_painel(painel);
-            mvwprintw(painel, 7, 2, "Temperatura definida");
-            mvwprintw(painel, 8, 2, entrada);
-            set_led_temperature(base_address, opcao_temp);
-            wrefresh(painel); // Atualiza o painel após imprimir o novo menu
-        } else {
-            limpar_linhas_painel(painel);
-            mvwprintw(painel, 7, 2, "Entrada inválida");
-            wrefresh(painel); // Atualiza o painel após imprimir o novo menu
+    // Reprodução de uma sessão: ./programa --replay arquivo [realtime|fast]
+    if (argc > 2 && strcmp(argv[1], "--replay") == 0) {
+        int realtime = argc > 3 && strcmp(argv[3], "realtime") == 0;
+        int result = run_replay(map, argv[2], realtime);
+        registers_release(map, FILE_SIZE);
+        return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Histórico de escritas: ./programa --log-follow
+    if (argc > 1 && strcmp(argv[1], "--log-follow") == 0) {
+        if (change_log.header == NULL) {
+            fprintf(stderr, "Erro: registro de alterações indisponível (%s)\n", CHANGE_LOG_PATH);
+            registers_release(map, FILE_SIZE);
+            return EXIT_FAILURE;
         }
-    // Outros casos para outras opções do menu...
-    default:
-        //mvwprintw(painel, 6, 2, "Opção inválida");
-        wrefresh(painel); // Atualiza o painel para exibir a mensagem de opção inválida
-        break;
+        run_log_follow(map);
+        registers_release(map, FILE_SIZE);
+        return EXIT_SUCCESS;
+    }
+
+    // Anel de alterações: ./programa --log-bench [escritas]
+    if (argc > 1 && strcmp(argv[1], "--log-bench") == 0) {
+        long writes = argc > 2 ? atol(argv[2]) : 200000;
+        if (change_log.header == NULL) {
+            fprintf(stderr, "Erro: registro de alterações indisponível (%s)\n", CHANGE_LOG_PATH);
+            registers_release(map, FILE_SIZE);
+            return EXIT_FAILURE;
+        }
+        if (writes < 1) {
+            fprintf(stderr, "Erro: o número de escritas deve ser positivo\n");
+            change_log_close(&change_log);
+            registers_release(map, FILE_SIZE);
+            return EXIT_FAILURE;
+        }
+        int result = run_log_bench(map, writes);
+        change_log_close(&change_log);
+        registers_release(map, FILE_SIZE);
+        return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    // Espera o usuário pressionar uma tecla antes de sair
-    getch();
+    // Modo de estresse: ./programa --stress [threads|processes] [iteracoes]
+    if (argc > 1 && strcmp(argv[1], "--stress") == 0) {
+        int use_processes = argc > 2 && strcmp(argv[2], "processes") == 0;
+        long iterations = argc > 3 ? atol(argv[3]) : 1000000;
+        int status = run_stress(map, use_processes, iterations);
+        registers_release(map, FILE_SIZE);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    // Finaliza a biblioteca ncurses
-    endwin();
-}
+    // Benchmark do seqlock: ./programa --seqlock-bench [leitores] [segundos]
+    if (argc > 1 && strcmp(argv[1], "--seqlock-bench") == 0) {
+        int readers = argc > 2 ? atoi(argv[2]) : 1;
+        double seconds = argc > 3 ? atof(argv[3]) : 1.0;
+        int status = run_seqlock_bench(map, readers, seconds);
+        registers_release(map, FILE_SIZE);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
+    // Assinante de alterações: ./programa --watch
+    if (argc > 1 && strcmp(argv[1], "--watch") == 0) {
+        run_watch(map);
+        registers_release(map, FILE_SIZE);
+        return EXIT_SUCCESS;
+    }
 
-int main() {
-    // Abrir o arquivo e mapeá-lo na memória
-    char* map = registers_map(FILE_PATH, FILE_SIZE);
-    if (map == NULL) {
-        return EXIT_FAILURE;
+    // Latência de notificação: ./programa --notify-bench [amostras]
+    if (argc > 1 && strcmp(argv[1], "--notify-bench") == 0) {
+        int samples = argc > 2 ? atoi(argv[2]) : 1000;
+        if (samples < 1) {
+            samples = 1;
+        }
+        int result = run_notify_bench(map, samples);
+        registers_release(map, FILE_SIZE);
+        return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    int opcao_led;
-    int nivel_bateria;
-    int opcao_principal;
-    int opcao_cores;
-    int valor_componente;
-    int valor_intensidade;
+    // Modo de script: ./programa --script [arquivo|-]
+    if (argc > 1 && strcmp(argv[1], "--script") == 0) {
+        int status = run_script(map, argc > 2 ? argv[2] : NULL);
+        registers_release(map, FILE_SIZE);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    do {
-        exibir_painel(map);
-        //scanf("%d", &opcao_principal);
-    } while (opcao_principal != 100);
+    // Benchmark das operações: ./programa --bench [iteracoes]
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        long iterations = argc > 2 ? atol(argv[2]) : 100000;
+        if (iterations < 10) {
+            iterations = 10;
+        }
+        run_bench(map, iterations);
+        registers_release(map, FILE_SIZE);
+        return EXIT_SUCCESS;
+    }
+
+    // Painel interativo: uma única sessão até o fim da entrada
+    UiSession ui = {NULL};
+    if (ui_session_start(&ui, map, STDIN_FILENO, 0) == 0) {
+        ui_session_run(&ui);
+        ui_session_stop(&ui);
+    }
 
     // Liberar recursos
+    change_log_close(&change_log);
     if (registers_release(map, FILE_SIZE) == -1) {
         return EXIT_FAILURE;
     }